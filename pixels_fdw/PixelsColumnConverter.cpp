@@ -0,0 +1,437 @@
+//
+// Conversion of Pixels column vectors into Postgres Datums.
+//
+
+#include "PixelsColumnConverter.hpp"
+#include <algorithm>
+#include <cstring>
+
+/*
+ * On-disk layout of NUMERIC, as defined in utils/adt/numeric.c: after the
+ * varlena header either a 2-byte short header carrying sign, display scale
+ * and weight, or a 2-byte sign/dscale word followed by a 2-byte weight,
+ * and then the base-NBASE digits, most significant first.
+ */
+#define PIXELS_NBASE 10000
+#define PIXELS_DEC_DIGITS 4
+#define PIXELS_NUMERIC_POS 0x0000
+#define PIXELS_NUMERIC_NEG 0x4000
+#define PIXELS_NUMERIC_SHORT 0x8000
+#define PIXELS_NUMERIC_SHORT_SIGN_MASK 0x2000
+#define PIXELS_NUMERIC_SHORT_DSCALE_SHIFT 7
+#define PIXELS_NUMERIC_SHORT_DSCALE_MAX 0x3F
+#define PIXELS_NUMERIC_SHORT_WEIGHT_SIGN_MASK 0x0040
+#define PIXELS_NUMERIC_SHORT_WEIGHT_MASK 0x003F
+#define PIXELS_NUMERIC_SHORT_WEIGHT_MAX PIXELS_NUMERIC_SHORT_WEIGHT_MASK
+#define PIXELS_NUMERIC_SHORT_WEIGHT_MIN (-(PIXELS_NUMERIC_SHORT_WEIGHT_MASK + 1))
+#define PIXELS_NUMERIC_DSCALE_MASK 0x3FFF
+//! Enough base-NBASE digits for 38 decimal digits plus the scale padding
+#define PIXELS_NUMERIC_MAX_DIGITS 11
+
+static const uint16_t PIXELS_POWERS_OF_TEN[PIXELS_DEC_DIGITS] = {1, 10, 100, 1000};
+
+/*
+ * Builds the NUMERIC for magnitude / 10^scale. The digits are peeled off the
+ * scaled integer from the least significant end: the first one only takes as
+ * many decimal digits as are needed to align the remaining ones with the
+ * decimal point, so the integer never has to be multiplied up first.
+ */
+template <class T>
+static Datum
+PixelsMakeNumeric(T magnitude, bool negative, int scale) {
+	int16_t digits[PIXELS_NUMERIC_MAX_DIGITS];
+	int ndigits = 0;
+	int frac_digits = (scale + PIXELS_DEC_DIGITS - 1) / PIXELS_DEC_DIGITS;
+	int pad = frac_digits * PIXELS_DEC_DIGITS - scale;
+	if (pad > 0) {
+		uint16_t divisor = PIXELS_POWERS_OF_TEN[PIXELS_DEC_DIGITS - pad];
+		digits[ndigits++] = (int16_t) ((magnitude % divisor) * PIXELS_POWERS_OF_TEN[pad]);
+		magnitude /= divisor;
+	}
+	while (magnitude != 0 || ndigits < frac_digits) {
+		digits[ndigits++] = (int16_t) (magnitude % PIXELS_NBASE);
+		magnitude /= PIXELS_NBASE;
+	}
+
+	/* digits[] is least significant first; drop the zeros at both ends */
+	int weight = ndigits - frac_digits - 1;
+	while (ndigits > 0 && digits[ndigits - 1] == 0) {
+		ndigits--;
+		weight--;
+	}
+	int first = 0;
+	while (first < ndigits && digits[first] == 0) {
+		first++;
+	}
+	if (first == ndigits) {
+		negative = false;
+		weight = 0;
+		first = ndigits = 0;
+	}
+
+	int count = ndigits - first;
+	bool is_short = scale <= PIXELS_NUMERIC_SHORT_DSCALE_MAX &&
+	                weight <= PIXELS_NUMERIC_SHORT_WEIGHT_MAX &&
+	                weight >= PIXELS_NUMERIC_SHORT_WEIGHT_MIN;
+	Size header = is_short ? sizeof(uint16_t) : 2 * sizeof(uint16_t);
+	Size length = VARHDRSZ + header + count * sizeof(int16_t);
+	char *result = (char *) palloc(length);
+	SET_VARSIZE(result, length);
+	uint16_t *words = (uint16_t *) VARDATA(result);
+	if (is_short) {
+		words[0] = PIXELS_NUMERIC_SHORT
+		           | (negative ? PIXELS_NUMERIC_SHORT_SIGN_MASK : 0)
+		           | (scale << PIXELS_NUMERIC_SHORT_DSCALE_SHIFT)
+		           | (weight < 0 ? PIXELS_NUMERIC_SHORT_WEIGHT_SIGN_MASK : 0)
+		           | (weight & PIXELS_NUMERIC_SHORT_WEIGHT_MASK);
+	} else {
+		words[0] = (negative ? PIXELS_NUMERIC_NEG : PIXELS_NUMERIC_POS)
+		           | (scale & PIXELS_NUMERIC_DSCALE_MASK);
+		words[1] = (uint16_t) (int16_t) weight;
+	}
+	int16_t *out = (int16_t *) (words + (is_short ? 1 : 2));
+	for (int i = 0; i < count; i++) {
+		out[i] = digits[ndigits - 1 - i];
+	}
+	return PointerGetDatum(result);
+}
+
+Datum
+PixelsMakeNumericDatum(__int128 value, int scale) {
+	unsigned __int128 magnitude = value < 0 ? -(unsigned __int128) value : (unsigned __int128) value;
+	return PixelsMakeNumeric<unsigned __int128>(magnitude, value < 0, scale);
+}
+
+Datum
+PixelsDatumOp::Decimal::Operation(const long &value, const PixelsColumnConverter &converter) {
+	uint64_t magnitude = value < 0 ? -(uint64_t) value : (uint64_t) value;
+	return PixelsMakeNumeric<uint64_t>(magnitude, value < 0, converter.scale);
+}
+
+/* strings that fit take the 1-byte varlena header, the others a 4-byte aligned one */
+static inline bool
+PixelsVarlenaIsShort(uint32_t length) {
+	return length + VARHDRSZ_SHORT <= VARATT_SHORT_MAX;
+}
+
+static inline Size
+PixelsVarlenaStart(Size offset, uint32_t length) {
+	return PixelsVarlenaIsShort(length) ? offset : INTALIGN(offset);
+}
+
+static inline Size
+PixelsVarlenaEnd(Size offset, uint32_t length) {
+	if (PixelsVarlenaIsShort(length)) {
+		return offset + VARHDRSZ_SHORT + length;
+	}
+	return INTALIGN(offset) + VARHDRSZ + length;
+}
+
+PixelsColumnConverter::PixelsColumnConverter(std::shared_ptr<TypeDescription> type,
+											 int attnum,
+											 int vector_index) {
+	this->attnum = attnum;
+	this->vector_index = vector_index;
+	this->category = type->getCategory();
+	this->scale = 0;
+	switch (category) {
+		case TypeDescription::SHORT:
+			SetConvertFunctions<int, PixelsDatumOp::Int16>();
+			break;
+		case TypeDescription::INT:
+			SetConvertFunctions<int, PixelsDatumOp::Int32>();
+			break;
+		case TypeDescription::LONG:
+			SetConvertFunctions<long, PixelsDatumOp::Int64>();
+			break;
+		case TypeDescription::DATE:
+			SetConvertFunctions<int, PixelsDatumOp::Date>();
+			break;
+		case TypeDescription::TIMESTAMP:
+			SetConvertFunctions<long, PixelsDatumOp::Timestamp>();
+			break;
+		case TypeDescription::DECIMAL:
+			/* the decimal column vector holds one long per value */
+			if (type->getPrecision() > PIXELS_FDW_MAX_DEC_WIDTH) {
+				throw PixelsReaderException("Pixels reader do not support longer decimal");
+			}
+			scale = type->getScale();
+			SetConvertFunctions<long, PixelsDatumOp::Decimal>();
+			break;
+		case TypeDescription::VARCHAR:
+		case TypeDescription::CHAR:
+			convert = ConvertString<false>;
+			convert_nulls = ConvertString<true>;
+			break;
+		default:
+			throw PixelsReaderException("Pixels reader do not support other types now");
+	}
+}
+
+template <class T, class OP>
+void
+PixelsColumnConverter::SetConvertFunctions() {
+	convert = TemplatedConvert<T, OP, false>;
+	convert_nulls = TemplatedConvert<T, OP, true>;
+}
+
+/*
+ * Null flags of eight consecutive rows packed into one word, so that runs of
+ * valid or null rows are handled without looking at every flag.
+ */
+#define PIXELS_NULLS_WORD_ROWS 8
+#define PIXELS_ALL_NULLS_WORD UINT64_C(0x0101010101010101)
+
+static inline uint64_t
+PixelsLoadNullsWord(const bool *nulls, uint64_t rows) {
+	uint64_t word = 0;
+	memcpy(&word, nulls, rows);
+	return word;
+}
+
+template <class T, class OP, bool NULLABLE>
+void
+PixelsColumnConverter::TemplatedConvert(PixelsColumnConverter &converter,
+										const uint32_t *selection,
+										uint64_t count) {
+	const T *data = (const T *) converter.data;
+	Datum *values = converter.values.get();
+	if constexpr(!NULLABLE) {
+		if (selection) {
+			for (uint64_t i = 0; i < count; i++) {
+				values[i] = OP::Operation(data[selection[i]], converter);
+			}
+		} else {
+			for (uint64_t i = 0; i < count; i++) {
+				values[i] = OP::Operation(data[i], converter);
+			}
+		}
+	} else {
+		/* null flags are already decoded, only the valid rows are converted */
+		const bool *nulls = converter.nulls.get();
+		for (uint64_t base = 0; base < count; base += PIXELS_NULLS_WORD_ROWS) {
+			uint64_t rows = std::min<uint64_t>(PIXELS_NULLS_WORD_ROWS, count - base);
+			uint64_t word = PixelsLoadNullsWord(nulls + base, rows);
+			if (word == PIXELS_ALL_NULLS_WORD) {
+				continue;
+			}
+			for (uint64_t i = base; i < base + rows; i++) {
+				if (word != 0 && nulls[i]) {
+					continue;
+				}
+				values[i] = OP::Operation(data[selection ? selection[i] : i], converter);
+			}
+		}
+	}
+}
+
+static inline Datum
+PixelsWriteVarlena(char *varlena, const char *data, uint32_t length) {
+	if (PixelsVarlenaIsShort(length)) {
+		SET_VARSIZE_SHORT(varlena, length + VARHDRSZ_SHORT);
+		memcpy(VARDATA_SHORT(varlena), data, length);
+	} else {
+		SET_VARSIZE(varlena, length + VARHDRSZ);
+		memcpy(VARDATA(varlena), data, length);
+	}
+	return PointerGetDatum(varlena);
+}
+
+PixelsStringCache::PixelsStringCache(MemoryContext context, size_t capacity) {
+	this->context = context;
+	this->capacity = capacity;
+	this->enabled = true;
+	entries.reserve(capacity);
+}
+
+Datum
+PixelsStringCache::Lookup(const string_t &value) {
+	std::string_view key(value.GetData(), value.GetSize());
+	auto entry = entries.find(key);
+	if (entry != entries.end()) {
+		return entry->second;
+	}
+	if (entries.size() >= capacity) {
+		enabled = false;
+		return (Datum) 0;
+	}
+	char *varlena = (char *) MemoryContextAlloc(context, PixelsVarlenaEnd(0, key.size()));
+	Datum datum = PixelsWriteVarlena(varlena, key.data(), key.size());
+	/* the key refers to the bytes of the cached varlena, not to the batch */
+	entries.emplace(std::string_view(VARDATA_ANY(varlena), key.size()), datum);
+	return datum;
+}
+
+void
+PixelsStringCache::Reset() {
+	entries.clear();
+	enabled = true;
+}
+
+template <bool NULLABLE>
+void
+PixelsColumnConverter::ConvertString(PixelsColumnConverter &converter,
+									 const uint32_t *selection,
+									 uint64_t count) {
+	uint64_t begin = 0;
+	if (converter.string_cache && converter.string_cache->enabled) {
+		begin = CacheStrings<NULLABLE>(converter, selection, count);
+	}
+	if (begin < count) {
+		BuildStrings<NULLABLE>(converter, selection, begin, count);
+	}
+}
+
+/*
+ * Takes the Datums of the selected rows from the string cache. Returns the
+ * index of the first row that is not converted, which is `count` unless the
+ * column turns out to have too many distinct values for the cache.
+ */
+template <bool NULLABLE>
+uint64_t
+PixelsColumnConverter::CacheStrings(PixelsColumnConverter &converter,
+									const uint32_t *selection,
+									uint64_t count) {
+	const string_t *data = (const string_t *) converter.data;
+	Datum *values = converter.values.get();
+	bool *nulls = converter.nulls.get();
+	PixelsStringCache &cache = *converter.string_cache;
+	for (uint64_t i = 0; i < count; i++) {
+		if constexpr(NULLABLE) {
+			if (nulls[i]) {
+				continue;
+			}
+		}
+		Datum datum = cache.Lookup(data[selection ? selection[i] : i]);
+		if (datum == (Datum) 0) {
+			return i;
+		}
+		values[i] = datum;
+	}
+	return count;
+}
+
+/*
+ * Strings are built in two passes: the first sums up the space of all
+ * selected values, the second lays out their varlenas back to back in one
+ * allocation from the current (per-batch) memory context.
+ */
+template <bool NULLABLE>
+void
+PixelsColumnConverter::BuildStrings(PixelsColumnConverter &converter,
+									const uint32_t *selection,
+									uint64_t begin,
+									uint64_t count) {
+	const string_t *data = (const string_t *) converter.data;
+	Datum *values = converter.values.get();
+	bool *nulls = converter.nulls.get();
+	Size total_length = 0;
+	for (uint64_t i = begin; i < count; i++) {
+		uint64_t row = selection ? selection[i] : i;
+		if constexpr(NULLABLE) {
+			if (nulls[i]) {
+				continue;
+			}
+		}
+		total_length = PixelsVarlenaEnd(total_length, data[row].GetSize());
+	}
+	if (total_length == 0) {
+		return;
+	}
+
+	char *arena = (char *) palloc_extended(total_length, MCXT_ALLOC_HUGE);
+	Size offset = 0;
+	for (uint64_t i = begin; i < count; i++) {
+		uint64_t row = selection ? selection[i] : i;
+		if constexpr(NULLABLE) {
+			if (nulls[i]) {
+				continue;
+			}
+		}
+		const string_t &value = data[row];
+		uint32_t length = value.GetSize();
+		values[i] = PixelsWriteVarlena(arena + PixelsVarlenaStart(offset, length),
+									   value.GetData(), length);
+		offset = PixelsVarlenaEnd(offset, length);
+	}
+}
+
+void
+PixelsColumnConverter::EnableStringCache(MemoryContext context) {
+	if (category == TypeDescription::VARCHAR || category == TypeDescription::CHAR) {
+		string_cache = std::make_unique<PixelsStringCache>(context, PIXELS_FDW_STRING_CACHE_SIZE);
+	}
+}
+
+void
+PixelsColumnConverter::ResetStringCache() {
+	if (string_cache) {
+		string_cache->Reset();
+	}
+}
+
+void
+PixelsColumnConverter::Bind(const std::shared_ptr<ColumnVector> &vector) {
+	switch (category) {
+		case TypeDescription::SHORT:
+		case TypeDescription::INT:
+			data = std::static_pointer_cast<LongColumnVector>(vector)->intVector;
+			break;
+		case TypeDescription::LONG:
+			data = std::static_pointer_cast<LongColumnVector>(vector)->longVector;
+			break;
+		case TypeDescription::DATE:
+			data = std::static_pointer_cast<DateColumnVector>(vector)->dates;
+			break;
+		case TypeDescription::TIMESTAMP:
+			data = std::static_pointer_cast<TimestampColumnVector>(vector)->times;
+			break;
+		case TypeDescription::DECIMAL:
+			data = std::static_pointer_cast<DecimalColumnVector>(vector)->vector;
+			break;
+		case TypeDescription::VARCHAR:
+		case TypeDescription::CHAR:
+			data = std::static_pointer_cast<BinaryColumnVector>(vector)->vector;
+			break;
+		default:
+			throw PixelsReaderException("Pixels reader do not support other types now");
+	}
+	is_null = vector->isNull;
+	has_nulls = !vector->noNulls;
+}
+
+void
+PixelsColumnConverter::Reserve(uint64_t count) {
+	if (count <= capacity) {
+		return;
+	}
+	values = std::make_unique<Datum[]>(count);
+	nulls = std::make_unique<bool[]>(count);
+	capacity = count;
+}
+
+void
+PixelsColumnConverter::DecodeNulls(const uint32_t *selection, uint64_t count) {
+	bool *flags = nulls.get();
+	if (selection) {
+		for (uint64_t i = 0; i < count; i++) {
+			flags[i] = is_null[selection[i]] != 0;
+		}
+	} else {
+		for (uint64_t i = 0; i < count; i++) {
+			flags[i] = is_null[i] != 0;
+		}
+	}
+}
+
+void
+PixelsColumnConverter::Convert(const uint32_t *selection, uint64_t count) {
+	Reserve(count);
+	if (!has_nulls) {
+		memset(nulls.get(), false, count * sizeof(bool));
+		convert(*this, selection, count);
+		return;
+	}
+	DecodeNulls(selection, count);
+	convert_nulls(*this, selection, count);
+}
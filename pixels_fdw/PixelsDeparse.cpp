@@ -0,0 +1,671 @@
+//
+// Translation of planner restriction clauses into PixelsFilter trees.
+//
+
+#include "PixelsDeparse.hpp"
+#include <cmath>
+
+extern "C"
+{
+#include "access/transam.h"
+#include "catalog/pg_collation.h"
+#include "catalog/pg_type.h"
+#include "common/int.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/optimizer.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/lsyscache.h"
+#include "utils/numeric.h"
+#include "utils/pg_locale.h"
+#include "utils/timestamp.h"
+}
+
+/* IN lists longer than this are left to the executor */
+#define PIXELS_MAX_IN_LIST_LENGTH 64
+/* doubles hold integers up to this magnitude exactly */
+#define PIXELS_MAX_EXACT_DOUBLE 9007199254740992.0
+
+typedef struct PixelsDeparseContext
+{
+    RelOptInfo *baserel;
+    Oid         foreigntableid;
+    List      **params;
+    /* values may be expressions over other relations, for join clauses */
+    bool        join_values;
+} PixelsDeparseContext;
+
+static List *
+pixels_make_filter(PixelsFilterType type,
+                   const char *column,
+                   int64 ivalue,
+                   double dvalue,
+                   const char *svalue,
+                   List *lchild,
+                   List *rchild,
+                   List *param)
+{
+    List       *result = NIL;
+
+    result = lappend(result, makeInteger((int) type));
+    result = lappend(result, makeString(pstrdup(column)));
+    result = lappend(result, makeConst(INT8OID, -1, InvalidOid, sizeof(int64),
+                                       Int64GetDatum(ivalue),
+                                       false, FLOAT8PASSBYVAL));
+    result = lappend(result, makeConst(FLOAT8OID, -1, InvalidOid, sizeof(float8),
+                                       Float8GetDatum(dvalue),
+                                       false, FLOAT8PASSBYVAL));
+    result = lappend(result, makeString(pstrdup(svalue)));
+    result = lappend(result, lchild);
+    result = lappend(result, rchild);
+    result = lappend(result, param);
+    return result;
+}
+
+List *
+pixels_serialize_filter(PixelsFilter *filter)
+{
+    string_t    svalue;
+
+    if (!filter)
+        return NIL;
+
+    svalue = filter->getStringValue();
+    return pixels_make_filter(filter->getFilterType(),
+                              filter->getColumnName().c_str(),
+                              filter->getIntegerValue(),
+                              filter->getDecimalValue(),
+                              pnstrdup(svalue.GetData(), svalue.GetSize()),
+                              pixels_serialize_filter(filter->getLChild()),
+                              pixels_serialize_filter(filter->getRChild()),
+                              NIL);
+}
+
+/*
+ * Converts a comparison value into the representation of the filter
+ * kernels: integers, dates and timestamps as integers in the units of the
+ * pixels file, decimals as doubles that are scaled back to the exact
+ * unscaled integer, strings as C strings. Returns false for values the
+ * kernels cannot compare exactly, which are then left to the executor.
+ */
+static bool
+pixels_filter_value(Oid coltype, int32 coltypmod, Oid valtype, Datum value,
+                    int64 *ivalue, double *dvalue, char **svalue)
+{
+    switch (coltype)
+    {
+        case INT2OID:
+        case INT4OID:
+        case INT8OID:
+        {
+            int64       v;
+
+            if (valtype == INT2OID)
+                v = DatumGetInt16(value);
+            else if (valtype == INT4OID)
+                v = DatumGetInt32(value);
+            else if (valtype == INT8OID)
+                v = DatumGetInt64(value);
+            else
+                return false;
+            /* the kernels of narrow columns compare 32-bit values */
+            if (coltype != INT8OID && (v < PG_INT32_MIN || v > PG_INT32_MAX))
+                return false;
+            *ivalue = v;
+            return true;
+        }
+        case DATEOID:
+        {
+            DateADT     d;
+
+            if (valtype != DATEOID)
+                return false;
+            d = DatumGetDateADT(value);
+            if (DATE_NOT_FINITE(d))
+                return false;
+            *ivalue = (int64) d + (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE);
+            return true;
+        }
+        case TIMESTAMPOID:
+        case TIMESTAMPTZOID:
+        {
+            Timestamp   t;
+
+            if (valtype != coltype)
+                return false;
+            t = DatumGetTimestamp(value);
+            if (TIMESTAMP_NOT_FINITE(t))
+                return false;
+            return !pg_add_s64_overflow(t, PIXELS_UNIX_EPOCH_USECS, ivalue);
+        }
+        case NUMERICOID:
+        {
+            Numeric     num;
+            int32       precision;
+            int32       scale;
+            int32       dscale;
+            double      d;
+
+            if (valtype != NUMERICOID || coltypmod < (int32) VARHDRSZ)
+                return false;
+            precision = ((coltypmod - VARHDRSZ) >> 16) & 0xffff;
+            scale = (((coltypmod - VARHDRSZ) & 0x7ff) ^ 1024) - 1024;
+            if (precision > PIXELS_FDW_MAX_DEC_WIDTH || scale < 0)
+                return false;
+            num = DatumGetNumeric(value);
+            if (numeric_is_nan(num) || numeric_is_inf(num))
+                return false;
+            /* a value with more digits than the column would be rounded */
+            dscale = DatumGetInt32(DirectFunctionCall1(numeric_scale, value));
+            if (dscale > scale)
+                return false;
+            d = DatumGetFloat8(DirectFunctionCall1(numeric_float8, value));
+            if (fabs(d) * pow(10, scale) >= PIXELS_MAX_EXACT_DOUBLE)
+                return false;
+            *dvalue = d;
+            return true;
+        }
+        case TEXTOID:
+        case VARCHAROID:
+            if (valtype != TEXTOID && valtype != VARCHAROID)
+                return false;
+            *svalue = TextDatumGetCString(value);
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * The string kernels compare bytes: equality is exact under deterministic
+ * collations, ordering only under the C collation.
+ */
+static bool
+pixels_filter_supported(PixelsFilterType type, Oid coltype, Oid collid)
+{
+    switch (coltype)
+    {
+        case INT2OID:
+        case INT4OID:
+        case INT8OID:
+        case DATEOID:
+        case TIMESTAMPOID:
+        case TIMESTAMPTZOID:
+        case NUMERICOID:
+            return true;
+        case TEXTOID:
+        case VARCHAROID:
+            if (type == PixelsFilterType::COMPARE_EQ || type == PixelsFilterType::COMPARE_NE)
+                return !OidIsValid(collid) || get_collation_isdeterministic(collid);
+            return OidIsValid(collid) && lc_collate_is_c(collid);
+        default:
+            return false;
+    }
+}
+
+static bool
+pixels_filter_type(Oid opno, PixelsFilterType *type)
+{
+    char       *opname;
+
+    /* only the built-in comparison operators are known to mean what they say */
+    if (opno >= FirstGenbkiObjectId)
+        return false;
+    opname = get_opname(opno);
+    if (opname == NULL)
+        return false;
+    if (strcmp(opname, "=") == 0)
+        *type = PixelsFilterType::COMPARE_EQ;
+    else if (strcmp(opname, "<>") == 0)
+        *type = PixelsFilterType::COMPARE_NE;
+    else if (strcmp(opname, "<") == 0)
+        *type = PixelsFilterType::COMPARE_LT;
+    else if (strcmp(opname, "<=") == 0)
+        *type = PixelsFilterType::COMPARE_LTEQ;
+    else if (strcmp(opname, ">") == 0)
+        *type = PixelsFilterType::COMPARE_GT;
+    else if (strcmp(opname, ">=") == 0)
+        *type = PixelsFilterType::COMPARE_GTEQ;
+    else
+        return false;
+    return true;
+}
+
+/* the comparison with its operands swapped */
+static PixelsFilterType
+pixels_commute_filter_type(PixelsFilterType type)
+{
+    switch (type)
+    {
+        case PixelsFilterType::COMPARE_LT:
+            return PixelsFilterType::COMPARE_GT;
+        case PixelsFilterType::COMPARE_LTEQ:
+            return PixelsFilterType::COMPARE_GTEQ;
+        case PixelsFilterType::COMPARE_GT:
+            return PixelsFilterType::COMPARE_LT;
+        case PixelsFilterType::COMPARE_GTEQ:
+            return PixelsFilterType::COMPARE_LTEQ;
+        default:
+            return type;
+    }
+}
+
+/*
+ * The negated comparison. Rows where the column is null fail both, which is
+ * what the executor makes of a NOT over a null comparison as well.
+ */
+static PixelsFilterType
+pixels_negate_filter_type(PixelsFilterType type)
+{
+    switch (type)
+    {
+        case PixelsFilterType::COMPARE_EQ:
+            return PixelsFilterType::COMPARE_NE;
+        case PixelsFilterType::COMPARE_NE:
+            return PixelsFilterType::COMPARE_EQ;
+        case PixelsFilterType::COMPARE_LT:
+            return PixelsFilterType::COMPARE_GTEQ;
+        case PixelsFilterType::COMPARE_LTEQ:
+            return PixelsFilterType::COMPARE_GT;
+        case PixelsFilterType::COMPARE_GT:
+            return PixelsFilterType::COMPARE_LTEQ;
+        case PixelsFilterType::COMPARE_GTEQ:
+            return PixelsFilterType::COMPARE_LT;
+        default:
+            return type;
+    }
+}
+
+static Expr *
+pixels_strip_relabel(Expr *expr)
+{
+    while (expr && IsA(expr, RelabelType))
+        expr = ((RelabelType *) expr)->arg;
+    return expr;
+}
+
+static bool
+pixels_is_column(Expr *expr, PixelsDeparseContext *context)
+{
+    Var        *var = (Var *) expr;
+
+    return IsA(expr, Var) &&
+           var->varno == context->baserel->relid &&
+           var->varlevelsup == 0 &&
+           var->varattno > 0;
+}
+
+static bool
+pixels_refers_to_rel(Node *node, Index *relid)
+{
+    if (node == NULL)
+        return false;
+    if (IsA(node, Var))
+        return ((Var *) node)->varno == *relid && ((Var *) node)->varlevelsup == 0;
+    if (IsA(node, PlaceHolderVar))
+        return true;
+    return expression_tree_walker(node, (bool (*)()) pixels_refers_to_rel, (void *) relid);
+}
+
+static bool
+pixels_is_value(Expr *expr, PixelsDeparseContext *context)
+{
+    if (IsA(expr, Const) ||
+        (IsA(expr, Param) && ((Param *) expr)->paramkind == PARAM_EXTERN))
+        return true;
+    /* computed once per rescan from the current row of the outer relations */
+    return context->join_values &&
+           !pixels_refers_to_rel((Node *) expr, &context->baserel->relid) &&
+           !contain_volatile_functions((Node *) expr) &&
+           !contain_subplans((Node *) expr);
+}
+
+/*
+ * a comparison of the column with a constant, or with a Param or an
+ * expression over other relations filled in later
+ */
+static List *
+pixels_deparse_comparison(PixelsFilterType type, Var *var, Expr *value,
+                          Oid collid, PixelsDeparseContext *context)
+{
+    char       *column = get_attname(context->foreigntableid, var->varattno, false);
+    Oid         valtype = exprType((Node *) value);
+    int64       ivalue = 0;
+    double      dvalue = 0;
+    char       *svalue = nullptr;
+
+    if (!pixels_filter_supported(type, var->vartype, collid))
+        return NIL;
+
+    if (!IsA(value, Const))
+    {
+        List       *param = NIL;
+
+        param = lappend(param, makeInteger(list_length(*context->params)));
+        param = lappend(param, makeInteger((int) valtype));
+        param = lappend(param, makeInteger((int) var->vartype));
+        param = lappend(param, makeInteger(var->vartypmod));
+        *context->params = lappend(*context->params, value);
+        return pixels_make_filter(type, column, 0, 0, "", NIL, NIL, param);
+    }
+
+    if (((Const *) value)->constisnull ||
+        !pixels_filter_value(var->vartype, var->vartypmod, valtype,
+                             ((Const *) value)->constvalue,
+                             &ivalue, &dvalue, &svalue))
+        return NIL;
+    return pixels_make_filter(type, column, ivalue, dvalue, svalue ? svalue : "",
+                              NIL, NIL, NIL);
+}
+
+static List *
+pixels_deparse_expr(Expr *expr, bool negate,
+                    PixelsDeparseContext *context, AttrNumber *attnum);
+
+static List *
+pixels_deparse_opexpr(OpExpr *op, bool negate,
+                      PixelsDeparseContext *context, AttrNumber *attnum)
+{
+    Expr       *left;
+    Expr       *right;
+    PixelsFilterType type;
+
+    if (list_length(op->args) != 2 || !pixels_filter_type(op->opno, &type))
+        return NIL;
+    left = pixels_strip_relabel((Expr *) linitial(op->args));
+    right = pixels_strip_relabel((Expr *) lsecond(op->args));
+    if (!pixels_is_column(left, context))
+    {
+        Expr       *tmp = left;
+
+        left = right;
+        right = tmp;
+        type = pixels_commute_filter_type(type);
+    }
+    if (!pixels_is_column(left, context) || !pixels_is_value(right, context))
+        return NIL;
+    if (negate)
+        type = pixels_negate_filter_type(type);
+
+    *attnum = ((Var *) left)->varattno;
+    return pixels_deparse_comparison(type, (Var *) left, right,
+                                     op->inputcollid, context);
+}
+
+/* column op ANY (array) and column op ALL (array) over a constant array */
+static List *
+pixels_deparse_array_opexpr(ScalarArrayOpExpr *op, bool negate,
+                            PixelsDeparseContext *context, AttrNumber *attnum)
+{
+    Expr       *left;
+    Const      *array;
+    PixelsFilterType type;
+    bool        use_or = op->useOr != negate;
+    ArrayType  *arr;
+    int16       elmlen;
+    bool        elmbyval;
+    char        elmalign;
+    Datum      *elems;
+    bool       *nulls;
+    int         nelems;
+    List       *result = NIL;
+    char       *column;
+
+    if (list_length(op->args) != 2 || !pixels_filter_type(op->opno, &type))
+        return NIL;
+    left = pixels_strip_relabel((Expr *) linitial(op->args));
+    array = (Const *) pixels_strip_relabel((Expr *) lsecond(op->args));
+    if (!pixels_is_column(left, context) || !IsA(array, Const) || array->constisnull)
+        return NIL;
+    if (negate)
+        type = pixels_negate_filter_type(type);
+
+    arr = DatumGetArrayTypeP(array->constvalue);
+    if (ArrayGetNItems(ARR_NDIM(arr), ARR_DIMS(arr)) > PIXELS_MAX_IN_LIST_LENGTH)
+        return NIL;
+    get_typlenbyvalalign(ARR_ELEMTYPE(arr), &elmlen, &elmbyval, &elmalign);
+    deconstruct_array(arr, ARR_ELEMTYPE(arr), elmlen, elmbyval, elmalign,
+                      &elems, &nulls, &nelems);
+
+    column = get_attname(context->foreigntableid, ((Var *) left)->varattno, false);
+    for (int i = 0; i < nelems; i++)
+    {
+        List       *child;
+
+        /*
+         * A null element never makes an ANY true, and leaving one out of an
+         * ALL only lets more rows through to the executor.
+         */
+        if (nulls[i])
+            continue;
+        child = pixels_deparse_comparison(type, (Var *) left,
+                                          (Expr *) makeConst(ARR_ELEMTYPE(arr), -1, InvalidOid,
+                                                             elmlen, elems[i], false, elmbyval),
+                                          op->inputcollid, context);
+        if (child == NIL)
+            return NIL;
+        if (result == NIL)
+            result = child;
+        else
+            result = pixels_make_filter(use_or ? PixelsFilterType::CONJUNCTION_OR
+                                               : PixelsFilterType::CONJUNCTION_AND,
+                                        column, 0, 0, "", result, child, NIL);
+    }
+    *attnum = ((Var *) left)->varattno;
+    return result;
+}
+
+/*
+ * AND and OR of comparisons on one column; NOT is pushed down to the
+ * comparisons. An arm that cannot be translated is dropped from an AND,
+ * which only lets more rows through, but makes an OR untranslatable.
+ */
+static List *
+pixels_deparse_boolexpr(BoolExpr *expr, bool negate,
+                        PixelsDeparseContext *context, AttrNumber *attnum)
+{
+    bool        use_and;
+    List       *result = NIL;
+    AttrNumber  column = InvalidAttrNumber;
+    ListCell   *lc;
+
+    if (expr->boolop == NOT_EXPR)
+        return pixels_deparse_expr((Expr *) linitial(expr->args), !negate, context, attnum);
+
+    use_and = (expr->boolop == AND_EXPR) != negate;
+    foreach (lc, expr->args)
+    {
+        AttrNumber  argcolumn = InvalidAttrNumber;
+        List       *child = pixels_deparse_expr((Expr *) lfirst(lc), negate,
+                                                context, &argcolumn);
+
+        if (child == NIL || (column != InvalidAttrNumber && argcolumn != column))
+        {
+            if (use_and)
+                continue;
+            return NIL;
+        }
+        if (result == NIL)
+        {
+            result = child;
+            column = argcolumn;
+            continue;
+        }
+        result = pixels_make_filter(use_and ? PixelsFilterType::CONJUNCTION_AND
+                                            : PixelsFilterType::CONJUNCTION_OR,
+                                    get_attname(context->foreigntableid, column, false),
+                                    0, 0, "", result, child, NIL);
+    }
+    *attnum = column;
+    return result;
+}
+
+static List *
+pixels_deparse_expr(Expr *expr, bool negate,
+                    PixelsDeparseContext *context, AttrNumber *attnum)
+{
+    switch (nodeTag(expr))
+    {
+        case T_OpExpr:
+            return pixels_deparse_opexpr((OpExpr *) expr, negate, context, attnum);
+        case T_ScalarArrayOpExpr:
+            return pixels_deparse_array_opexpr((ScalarArrayOpExpr *) expr, negate, context, attnum);
+        case T_BoolExpr:
+            return pixels_deparse_boolexpr((BoolExpr *) expr, negate, context, attnum);
+        default:
+            return NIL;
+    }
+}
+
+static List *
+pixels_deparse_clauses(PixelsDeparseContext *context, List *clauses)
+{
+    List       *filters = NIL;
+    ListCell   *lc;
+
+    foreach (lc, clauses)
+    {
+        Expr       *clause = (Expr *) lfirst(lc);
+        AttrNumber  attnum;
+        List       *filter;
+
+        if (IsA(clause, RestrictInfo))
+        {
+            RestrictInfo *rinfo = (RestrictInfo *) clause;
+
+            if (rinfo->pseudoconstant)
+                continue;
+            clause = rinfo->clause;
+        }
+        filter = pixels_deparse_expr(clause, false, context, &attnum);
+        if (filter != NIL)
+            filters = lappend(filters, filter);
+    }
+    return filters;
+}
+
+List *
+pixels_deparse_filters(RelOptInfo *baserel,
+                       Oid foreigntableid,
+                       List *clauses,
+                       List **params)
+{
+    PixelsDeparseContext context;
+
+    context.baserel = baserel;
+    context.foreigntableid = foreigntableid;
+    context.params = params;
+    context.join_values = false;
+    return pixels_deparse_clauses(&context, clauses);
+}
+
+List *
+pixels_deparse_join_filters(RelOptInfo *baserel,
+                            Oid foreigntableid,
+                            List *clauses,
+                            List **params)
+{
+    PixelsDeparseContext context;
+
+    context.baserel = baserel;
+    context.foreigntableid = foreigntableid;
+    context.params = params;
+    context.join_values = true;
+    return pixels_deparse_clauses(&context, clauses);
+}
+
+List *
+pixels_merge_filters(List *filters)
+{
+    List       *merged = NIL;
+    ListCell   *lc;
+
+    foreach (lc, filters)
+    {
+        List       *filter = (List *) lfirst(lc);
+        char       *column = strVal(list_nth(filter, 1));
+        ListCell   *lc2;
+        bool        found = false;
+
+        foreach (lc2, merged)
+        {
+            List       *other = (List *) lfirst(lc2);
+
+            if (strcmp(strVal(list_nth(other, 1)), column) == 0)
+            {
+                lfirst(lc2) = pixels_make_filter(PixelsFilterType::CONJUNCTION_AND,
+                                                 column, 0, 0, "", other, filter, NIL);
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            merged = lappend(merged, filter);
+    }
+    return merged;
+}
+
+/*
+ * Rebuilds a PixelsFilter tree, filling in the values of Params. A
+ * comparison whose value turns out to be null or not exactly comparable is
+ * dropped: from an AND by keeping the other arm, from an OR by dropping the
+ * OR, so that the tree only gets less selective. Returns nullptr if nothing
+ * of the tree is left.
+ */
+PixelsFilter *
+pixels_deserialize_filter(List *serialized, Datum *param_values, bool *param_nulls)
+{
+    PixelsFilterType type;
+    int64       ivalue;
+    double      dvalue;
+    char       *svalue;
+    List       *param;
+
+    if (serialized == NIL)
+        return nullptr;
+
+    type = (PixelsFilterType) intVal(list_nth(serialized, 0));
+    if (type == PixelsFilterType::CONJUNCTION_AND || type == PixelsFilterType::CONJUNCTION_OR)
+    {
+        PixelsFilter *lchild = pixels_deserialize_filter((List *) list_nth(serialized, 5),
+                                                         param_values, param_nulls);
+        PixelsFilter *rchild = pixels_deserialize_filter((List *) list_nth(serialized, 6),
+                                                         param_values, param_nulls);
+        PixelsFilter *filter;
+
+        if (!lchild || !rchild)
+        {
+            if (type == PixelsFilterType::CONJUNCTION_AND)
+                return lchild ? lchild : rchild;
+            delete lchild;
+            delete rchild;
+            return nullptr;
+        }
+        filter = createPixelsFilter(type, std::string(strVal(list_nth(serialized, 1))),
+                                    0, 0, string_t());
+        filter->setLChild(lchild);
+        filter->setRChild(rchild);
+        return filter;
+    }
+
+    ivalue = DatumGetInt64(((Const *) list_nth(serialized, 2))->constvalue);
+    dvalue = DatumGetFloat8(((Const *) list_nth(serialized, 3))->constvalue);
+    svalue = strVal(list_nth(serialized, 4));
+    param = list_length(serialized) > 7 ? (List *) list_nth(serialized, 7) : NIL;
+    if (param != NIL)
+    {
+        int         index = intVal(list_nth(param, 0));
+
+        if (param_values == nullptr || param_nulls[index] ||
+            !pixels_filter_value((Oid) intVal(list_nth(param, 2)),
+                                 intVal(list_nth(param, 3)),
+                                 (Oid) intVal(list_nth(param, 1)),
+                                 param_values[index],
+                                 &ivalue, &dvalue, &svalue))
+            return nullptr;
+    }
+    return createPixelsFilter(type, std::string(strVal(list_nth(serialized, 1))),
+                              ivalue, dvalue, string_t(svalue, strlen(svalue)));
+}
@@ -3,6 +3,9 @@
 //
 
 #include "PixelsFdwExecutionState.hpp"
+#include "PixelsDeparse.hpp"
+#include <algorithm>
+#include <strings.h>
 
 char *
 tolowercase(const char *input, char *output)
@@ -32,34 +35,78 @@ PixelsFdwExecutionState::PixelsFdwExecutionState(List* files,
 	foreach (filter_lc, filters) {
 		filters_list.emplace_back((PixelsFilter*)lfirst(filter_lc));
 	}
-	attrs_used = attrs_used;
+	this->attrs_used = attrs_used;
 	tuple_desc = tupleDesc;
 	shared_ptr<TypeDescription> file_schema;
 	bind_data = PixelsFdwExecutionState::PixelsScanBind(files_list, filters_list, file_schema);
+	PixelsFdwExecutionState::PixelsResolveFilters(bind_data->filters, file_schema);
+	filters_list = bind_data->filters;
+	enable_filter_pushdown = !filters_list.empty();
 	column_map = PixelsFdwExecutionState::PixelsGetColumnMap(file_schema, attrs_used, tuple_desc);
+	converters = PixelsFdwExecutionState::PixelsGetColumnConverters(file_schema, column_map);
+	vector_indexes.assign(tuple_desc->natts, -1);
+	column_types.resize(tuple_desc->natts);
+	for (auto &converter : converters) {
+		vector_indexes[converter.attnum] = converter.vector_index;
+	}
+	for (int i = 0; i < column_map.size(); i++) {
+		if (column_map[i] >= 0) {
+			column_types[column_map[i]] = file_schema->getChildren().at(i);
+		}
+	}
+	batch_cxt = AllocSetContextCreate(CurrentMemoryContext,
+									  "pixels_fdw batch data",
+									  ALLOCSET_DEFAULT_SIZES);
+	morsel_cxt = AllocSetContextCreate(CurrentMemoryContext,
+									   "pixels_fdw morsel data",
+									   ALLOCSET_DEFAULT_SIZES);
+	for (auto &converter : converters) {
+		converter.EnableStringCache(morsel_cxt);
+	}
 	parallel_state = PixelsFdwExecutionState::PixelsScanInitGlobal(*bind_data);
-	scan_data = PixelsFdwExecutionState::PixelsScanInitLocal(*bind_data, *parallel_state, column_map);
+	/*
+	 * The local scan state claims its first file from the scan cursor, so it
+	 * is only set up on the first fetch: a parallel scan attaches the cursor
+	 * in shared memory after BeginForeignScan has already run.
+	 */
 }
 
 PixelsFdwExecutionState::~PixelsFdwExecutionState() {
+	/* the global state shares its initial reader with the bind data */
 	if (bind_data->initialPixelsReader) {
 		bind_data->initialPixelsReader->close();
 	}
 	bind_data.reset();
-	if (parallel_state->initialPixelsReader) {
-		parallel_state->initialPixelsReader->close();
-	}
 	parallel_state.reset();
-	if (scan_data->currReader) {
-		scan_data->currReader->close();
+	ReleaseLocalScan();
+	for (auto filter : filters_list) {
+		delete filter;
 	}
-	if (scan_data->currPixelsRecordReader) {
-		scan_data->currPixelsRecordReader->close();
+	MemoryContextDelete(batch_cxt);
+	MemoryContextDelete(morsel_cxt);
+	if (runtime_cxt) {
+		MemoryContextDelete(runtime_cxt);
 	}
-	if (scan_data->nextPixelsRecordReader) {
-		scan_data->nextPixelsRecordReader->close();
+}
+
+void
+PixelsFdwExecutionState::ReleaseLocalScan() {
+	if (scan_data) {
+		if (scan_data->currReader) {
+			scan_data->currReader->close();
+		}
+		if (scan_data->nextReader && scan_data->nextReader != scan_data->currReader) {
+			scan_data->nextReader->close();
+		}
+		if (scan_data->currPixelsRecordReader) {
+			scan_data->currPixelsRecordReader->close();
+		}
+		if (scan_data->nextPixelsRecordReader) {
+			scan_data->nextPixelsRecordReader->close();
+		}
 	}
 	scan_data.reset();
+	scan_initialized = false;
 }
 
 
@@ -82,8 +129,11 @@ static double PixelsProgress(const PixelsReadBindData *bind_data_p,
 
 static uint32_t PixelsCardinality(const PixelsReadBindData *bind_data) {
 	auto &data = (PixelsReadBindData &)*bind_data;
-
-	return data.initialPixelsReader->getNumberOfRows() * data.files.size();
+	uint64_t row_count = 0;
+	for (auto &stats : PixelsLoadFileStats(data.files)) {
+		row_count += stats->row_count;
+	}
+	return row_count;
 }
 
 unique_ptr<PixelsReadBindData>
@@ -117,34 +167,29 @@ vector<int>
 PixelsFdwExecutionState::PixelsGetColumnMap(const shared_ptr<TypeDescription> file_schema,
 										    set<int> attrs_used,
 											TupleDesc tupleDesc) {
-	vector<int> column_map;
-	column_map.resize(tupleDesc->natts);
+	assert(file_schema->getCategory() == TypeDescription::STRUCT);
+	/* index of the slot attribute each pixels column is read into, -1 if unused */
+	vector<int> column_map(file_schema->getChildren().size(), -1);
     for (int i = 0; i < tupleDesc->natts; i++)
     {
         AttrNumber  attnum = i + 1 - FirstLowInvalidHeapAttributeNumber;
         char        pg_colname[255];
-        const char *attname = NameStr(TupleDescAttr(tupleDesc, i)->attname);
-
-        column_map[i] = -1;
 
         /* Skip columns we don't intend to use in query */
         if (attrs_used.find(attnum) == attrs_used.end())
             continue;
 
         tolowercase(NameStr(TupleDescAttr(tupleDesc, i)->attname), pg_colname);
-		assert(file_schema->getCategory() == TypeDescription::STRUCT);
-		vector<char*> column_names;
-        for (int i = 0; i < file_schema->getChildren().size(); i++)
+        for (int j = 0; j < file_schema->getChildren().size(); j++)
         {
-            auto field_name = file_schema->getFieldNames().at(i);
+            auto field_name = file_schema->getFieldNames().at(j);
             char pixels_colname[255];
             if (field_name.length() > NAMEDATALEN)
                 throw PixelsReaderException("pixels column name is too long");
-            tolowercase(file_schema->getFieldNames().at(i).c_str(), pixels_colname);
+            tolowercase(field_name.c_str(), pixels_colname);
             if (strcmp(pg_colname, pixels_colname) == 0)
             {
-                column_names.push_back(pixels_colname);
-                column_map[i] = column_names.size() - 1;
+                column_map[j] = i;
                 break;
             }
         }
@@ -152,6 +197,66 @@ PixelsFdwExecutionState::PixelsGetColumnMap(const shared_ptr<TypeDescription> fi
 	return column_map;
 }
 
+static void
+PixelsRenameFilter(PixelsFilter *filter, const string &column_name) {
+	if (!filter) {
+		return;
+	}
+	filter->setColumnName(column_name);
+	PixelsRenameFilter(filter->getLChild(), column_name);
+	PixelsRenameFilter(filter->getRChild(), column_name);
+}
+
+/*
+ * Filters name their column the way the query or the table option spells
+ * it, while the reader looks the column up by its name in the file schema.
+ * Filters on columns the file does not have are dropped.
+ */
+void
+PixelsFdwExecutionState::PixelsResolveFilters(vector<PixelsFilter*> &filters,
+											  const shared_ptr<TypeDescription> file_schema) {
+	vector<PixelsFilter*> resolved;
+	for (auto filter : filters) {
+		char filter_colname[255];
+		bool found = false;
+		tolowercase(filter->getColumnName().c_str(), filter_colname);
+		for (const auto &field_name : file_schema->getFieldNames()) {
+			char pixels_colname[255];
+			if (field_name.length() > NAMEDATALEN)
+				throw PixelsReaderException("pixels column name is too long");
+			tolowercase(field_name.c_str(), pixels_colname);
+			if (strcmp(filter_colname, pixels_colname) == 0) {
+				PixelsRenameFilter(filter, field_name);
+				found = true;
+				break;
+			}
+		}
+		if (found) {
+			resolved.emplace_back(filter);
+		} else {
+			delete filter;
+		}
+	}
+	filters = resolved;
+}
+
+vector<PixelsColumnConverter>
+PixelsFdwExecutionState::PixelsGetColumnConverters(const shared_ptr<TypeDescription> file_schema,
+												   const vector<int> &column_map) {
+	vector<PixelsColumnConverter> converters;
+	int vector_index = 0;
+	/* the record reader returns the included columns in schema order */
+	for (int i = 0; i < column_map.size(); i++) {
+		if (column_map[i] < 0) {
+			continue;
+		}
+		converters.emplace_back(file_schema->getChildren().at(i),
+								column_map[i],
+								vector_index++);
+	}
+	return converters;
+}
+
 unique_ptr<PixelsReadGlobalState>
 PixelsFdwExecutionState::PixelsScanInitGlobal(PixelsReadBindData &bind_data) {
 
@@ -162,7 +267,7 @@ PixelsFdwExecutionState::PixelsScanInitGlobal(PixelsReadBindData &bind_data) {
         max_threads = (int) bind_data.files.size();
     }
     result->storageArrayScheduler = std::make_shared<StorageArrayScheduler>(bind_data.files, max_threads);
-    result->file_index.resize(result->storageArrayScheduler->getDeviceSum());
+	result->footer_cache = std::make_shared<PixelsFooterCache>();
 	result->max_threads = max_threads;
 	result->batch_index = 0;
 	return std::move(result);
@@ -192,58 +297,343 @@ PixelsFdwExecutionState::PixelsScanInitLocal(PixelsReadBindData &bind_data,
 	return std::move(result);
 }
 
+/*
+ * Best value the rows of a row group may hold in the column for a sort in
+ * the given direction, with nulls as the best value where they sort first.
+ */
+static PixelsMorselBound
+PixelsRowGroupBound(const pixels::proto::ColumnStatistic &stats,
+					TypeDescription::Category category,
+					bool descending,
+					bool nulls_first) {
+	bool has_null = stats.has_hasnull() ? stats.hasnull() : true;
+	if (nulls_first && has_null) {
+		return PixelsMorselBound{true, true, 0};
+	}
+	/* a chunk of nulls only, sorting last */
+	if (stats.has_numberofvalues() && stats.numberofvalues() == 0) {
+		return PixelsMorselBound{true, true, 0};
+	}
+	switch (category) {
+		case TypeDescription::SHORT:
+		case TypeDescription::INT:
+		case TypeDescription::LONG:
+			if (stats.has_intstatistics()) {
+				return PixelsMorselBound{true, false, descending ? stats.intstatistics().maximum() :
+																	stats.intstatistics().minimum()};
+			}
+			break;
+		case TypeDescription::DATE:
+			if (stats.has_datestatistics()) {
+				return PixelsMorselBound{true, false, descending ? stats.datestatistics().maximum() :
+																	stats.datestatistics().minimum()};
+			}
+			break;
+		case TypeDescription::TIMESTAMP:
+			if (stats.has_timestampstatistics()) {
+				return PixelsMorselBound{true, false, descending ? stats.timestampstatistics().maximum() :
+																	stats.timestampstatistics().minimum()};
+			}
+			break;
+		default:
+			break;
+	}
+	return PixelsMorselBound{false, false, 0};
+}
+
+/* whether rows with bound `a` may sort before rows with bound `b` */
+static bool
+PixelsBoundBefore(const PixelsMorselBound &a,
+				  const PixelsMorselBound &b,
+				  bool descending,
+				  bool nulls_first) {
+	if (!a.known || !b.known) {
+		return !a.known && b.known;
+	}
+	if (a.is_null || b.is_null) {
+		return a.is_null != b.is_null && a.is_null == nulls_first;
+	}
+	return descending ? a.value > b.value : a.value < b.value;
+}
+
+void
+PixelsFdwExecutionState::PixelsScanInitMorsels(const PixelsReadBindData &bind_data,
+											   PixelsReadGlobalState &parallel_state) {
+	auto& StorageInstance = parallel_state.storageArrayScheduler;
+	int morsel_size = std::stoi(ConfigFactory::Instance().getProperty("pixel.morsel.size"));
+	if (morsel_size <= 0 || bind_data.row_limit > 0) {
+		morsel_size = 1;
+	}
+	/* rows in the row groups scheduled so far, for a limited scan */
+	uint64_t scheduled_rows = 0;
+	bool ordered = !bind_data.order_column.empty();
+	bool descending = bind_data.order_descending;
+	bool nulls_first = bind_data.order_nulls_first;
+	vector<PixelsMorselBound> bounds;
+
+	/*
+	 * Interleave the files of the storage devices, so that backends claiming
+	 * consecutive morsels read from different devices.
+	 */
+	int max_file_sum = 0;
+	for (int device_id = 0; device_id < StorageInstance->getDeviceSum(); device_id++) {
+		max_file_sum = std::max(max_file_sum, (int) StorageInstance->getFileSum(device_id));
+	}
+	if (parallel_state.file_stats.empty()) {
+		vector<string> file_names;
+		for (int file_index = 0; file_index < max_file_sum; file_index++) {
+			for (int device_id = 0; device_id < StorageInstance->getDeviceSum(); device_id++) {
+				if (file_index < StorageInstance->getFileSum(device_id)) {
+					file_names.emplace_back(StorageInstance->getFileName(device_id, file_index));
+				}
+			}
+		}
+		/* usually cached already by the planner of this backend */
+		parallel_state.file_stats = PixelsLoadFileStats(file_names);
+	}
+	const auto &file_stats = parallel_state.file_stats;
+
+	parallel_state.morsels.clear();
+	parallel_state.morsel_bounds.clear();
+	parallel_state.morsels_initialized = true;
+	size_t stats_index = 0;
+	bool limit_reached = false;
+	for (int file_index = 0; file_index < max_file_sum && !limit_reached; file_index++) {
+		for (int device_id = 0; device_id < StorageInstance->getDeviceSum(); device_id++) {
+			if (file_index >= StorageInstance->getFileSum(device_id)) {
+				continue;
+			}
+			const PixelsFileStats &stats = *file_stats[stats_index++];
+			const auto &footer = stats.footer;
+			int rg_num = footer.rowgroupinfos_size();
+			/*
+			 * Row groups whose statistics rule out the filters are never
+			 * scheduled; a morsel takes up to morsel_size consecutive row
+			 * groups that survive.
+			 */
+			vector<bool> rg_survives(rg_num, true);
+			if (!bind_data.filters.empty()) {
+				for (int rg_id = 0; rg_id < rg_num && rg_id < footer.rowgroupstats_size(); rg_id++) {
+					rg_survives[rg_id] = PixelsCheckRowGroup(bind_data.filters,
+															 footer.rowgroupstats(rg_id),
+															 stats.schema) != PixelsFilterVerdict::NONE;
+				}
+			}
+			if (!bind_data.row_groups.empty()) {
+				auto picked = bind_data.row_groups.find(stats.path);
+				for (int rg_id = 0; rg_id < rg_num; rg_id++) {
+					rg_survives[rg_id] = rg_survives[rg_id] &&
+										 picked != bind_data.row_groups.end() &&
+										 rg_id < picked->second.size() && picked->second[rg_id];
+				}
+			}
+			int order_col = -1;
+			if (ordered) {
+				const auto &field_names = stats.schema->getFieldNames();
+				for (int i = 0; i < field_names.size(); i++) {
+					if (strcasecmp(field_names.at(i).c_str(), bind_data.order_column.c_str()) == 0) {
+						order_col = i;
+						break;
+					}
+				}
+			}
+			int rg_id = 0;
+			while (rg_id < rg_num) {
+				if (bind_data.row_limit_exact && scheduled_rows >= bind_data.row_limit) {
+					limit_reached = true;
+					break;
+				}
+				if (!rg_survives[rg_id]) {
+					rg_id++;
+					continue;
+				}
+				PixelsMorsel morsel;
+				morsel.device_id = device_id;
+				morsel.file_index = file_index;
+				morsel.rg_start = rg_id;
+				morsel.rg_len = 0;
+				PixelsMorselBound bound{true, false, 0};
+				while (rg_id < rg_num && rg_survives[rg_id] && morsel.rg_len < morsel_size) {
+					scheduled_rows += footer.rowgroupinfos(rg_id).numberofrows();
+					if (ordered) {
+						PixelsMorselBound rg_bound{false, false, 0};
+						if (order_col >= 0 && rg_id < footer.rowgroupstats_size() &&
+							order_col < footer.rowgroupstats(rg_id).columnchunkstats_size()) {
+							rg_bound = PixelsRowGroupBound(footer.rowgroupstats(rg_id).columnchunkstats(order_col),
+														   stats.schema->getChildren().at(order_col)->getCategory(),
+														   descending, nulls_first);
+						}
+						if (morsel.rg_len == 0 || PixelsBoundBefore(rg_bound, bound, descending, nulls_first)) {
+							bound = rg_bound;
+						}
+					}
+					morsel.rg_len++;
+					rg_id++;
+				}
+				parallel_state.morsels.emplace_back(morsel);
+				if (ordered) {
+					bounds.emplace_back(bound);
+				}
+			}
+		}
+	}
+
+	/*
+	 * Most promising morsels first, those without statistics ahead of all,
+	 * so that once a morsel cannot hold a row sorting before some value no
+	 * later morsel can either.
+	 */
+	if (ordered) {
+		vector<size_t> order(bounds.size());
+		for (size_t i = 0; i < order.size(); i++) {
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return PixelsBoundBefore(bounds[a], bounds[b], descending, nulls_first);
+		});
+		vector<PixelsMorsel> morsels;
+		for (size_t i : order) {
+			morsels.emplace_back(parallel_state.morsels[i]);
+			parallel_state.morsel_bounds.emplace_back(bounds[i]);
+		}
+		parallel_state.morsels = std::move(morsels);
+	}
+	if (bind_data.keep_file_order) {
+		std::unordered_map<string, size_t> positions;
+		for (size_t i = 0; i < bind_data.files.size(); i++) {
+			positions.emplace(bind_data.files[i], i);
+		}
+		std::stable_sort(parallel_state.morsels.begin(), parallel_state.morsels.end(),
+						 [&](const PixelsMorsel &a, const PixelsMorsel &b) {
+			return positions[StorageInstance->getFileName(a.device_id, a.file_index)] <
+				   positions[StorageInstance->getFileName(b.device_id, b.file_index)];
+		});
+	}
+}
+
+void
+PixelsFdwExecutionState::PixelsScanInitCursor(const PixelsReadBindData &bind_data,
+											  PixelsReadGlobalState &parallel_state) {
+	if (!parallel_state.morsels_initialized) {
+		PixelsScanInitMorsels(bind_data, parallel_state);
+	}
+	parallel_state.local_desc = std::make_unique<char[]>(PixelsParallelScanDescSize(parallel_state.morsels.size()));
+	parallel_state.parallel_desc = (PixelsParallelScanDesc *) parallel_state.local_desc.get();
+	PixelsParallelScanDescInit(parallel_state.parallel_desc, parallel_state.morsels);
+}
+
+Size
+PixelsFdwExecutionState::PixelsParallelScanDescSize(uint32 morsel_sum) {
+	return add_size(offsetof(PixelsParallelScanDesc, morsels),
+					mul_size(morsel_sum, sizeof(PixelsMorsel)));
+}
+
+void
+PixelsFdwExecutionState::PixelsParallelScanDescInit(PixelsParallelScanDesc *desc,
+													const vector<PixelsMorsel> &morsels) {
+	pg_atomic_init_u32(&desc->next_morsel, 0);
+	desc->morsel_sum = morsels.size();
+	if (!morsels.empty()) {
+		memcpy(desc->morsels, morsels.data(), morsels.size() * sizeof(PixelsMorsel));
+	}
+}
+
+/* whether the morsel may hold a row sorting before the sort threshold */
+static bool
+PixelsMorselMayBeatThreshold(const PixelsReadBindData &bind_data,
+							 const PixelsReadGlobalState &parallel_state,
+							 uint32_t morsel_index) {
+	if (!parallel_state.has_sort_threshold || morsel_index >= parallel_state.morsel_bounds.size()) {
+		return true;
+	}
+	const PixelsMorselBound &bound = parallel_state.morsel_bounds[morsel_index];
+	if (!bound.known) {
+		return true;
+	}
+	if (bound.is_null) {
+		return bind_data.order_nulls_first;
+	}
+	return bind_data.order_descending ? bound.value >= parallel_state.sort_threshold :
+										bound.value <= parallel_state.sort_threshold;
+}
+
 bool
 PixelsFdwExecutionState::PixelsParallelStateNext(const PixelsReadBindData &bind_data,
                                                  PixelsReadLocalState &scan_data,
                                                  PixelsReadGlobalState &parallel_state,
                                                  bool is_init_state) {
-    unique_lock<mutex> parallel_lock(parallel_state.lock);
-    if (parallel_state.error_opening_file) {
-        throw InvalidArgumentException("PixelsScanInitLocal: file open error.");
-    }
+	PixelsParallelScanDesc *desc = parallel_state.parallel_desc;
 
-    auto& StorageInstance = parallel_state.storageArrayScheduler;
-    if ((is_init_state &&
-		 parallel_state.file_index.at(scan_data.deviceID) >= StorageInstance->getFileSum(scan_data.deviceID)) ||
-         scan_data.next_file_index >= StorageInstance->getFileSum(scan_data.deviceID)) {
+	/* the last claimed morsel is already being read, nothing is left to scan */
+	if (!is_init_state && scan_data.nextPixelsRecordReader == nullptr) {
 		::BufferPool::Reset();
-        parallel_lock.unlock();
-        return false;
-    }
+		return false;
+	}
+	/*
+	 * Morsels ordered by a sort column are visited best first: once the
+	 * claimed one cannot beat the threshold, no later one can, and it is
+	 * left unread.
+	 */
+	if (!is_init_state && !PixelsMorselMayBeatThreshold(bind_data, parallel_state, scan_data.next_morsel_index)) {
+		::BufferPool::Reset();
+		return false;
+	}
+
+	uint32 morsel_index = pg_atomic_fetch_add_u32(&desc->next_morsel, 1);
+	bool has_next_morsel = morsel_index < desc->morsel_sum;
+	if (is_init_state && !has_next_morsel) {
+		::BufferPool::Reset();
+		return false;
+	}
 
+    auto& StorageInstance = parallel_state.storageArrayScheduler;
     scan_data.curr_file_index = scan_data.next_file_index;
     scan_data.curr_batch_index = scan_data.next_batch_index;
-    scan_data.next_file_index = parallel_state.file_index.at(scan_data.deviceID);
-    scan_data.next_batch_index = StorageInstance->getBatchID(scan_data.deviceID, scan_data.next_file_index);
     scan_data.curr_file_name = scan_data.next_file_name;
-    parallel_state.file_index.at(scan_data.deviceID)++;
-    parallel_lock.unlock();    
+	scan_data.curr_morsel = scan_data.next_morsel;
+	scan_data.curr_morsel_index = scan_data.next_morsel_index;
 
-    if(scan_data.currReader != nullptr) {
-        scan_data.currReader->close();
+	/* consecutive morsels of the same file share one reader */
+	std::shared_ptr<PixelsReader> prevReader = scan_data.currReader;
+    scan_data.currReader = scan_data.nextReader;
+    if (prevReader != nullptr && prevReader != scan_data.currReader) {
+        prevReader->close();
     }
 
     ::BufferPool::Switch();
-    scan_data.currReader = scan_data.nextReader;
     scan_data.currPixelsRecordReader = scan_data.nextPixelsRecordReader;
 	if (scan_data.currPixelsRecordReader != nullptr) {
         auto currPixelsRecordReader = std::static_pointer_cast<PixelsRecordReaderImpl>(scan_data.currPixelsRecordReader);
         currPixelsRecordReader->read();
     }
-    if(scan_data.next_file_index < StorageInstance->getFileSum(scan_data.deviceID)) {
-        auto footerCache = std::make_shared<PixelsFooterCache>();
-        auto builder = std::make_shared<PixelsReaderBuilder>();
-        std::shared_ptr<::Storage> storage = StorageFactory::getInstance()->getStorage(::Storage::file);
-        scan_data.next_file_name = StorageInstance->getFileName(scan_data.deviceID, scan_data.next_file_index);
-        scan_data.nextReader = builder->setPath(scan_data.next_file_name)
-                					  ->setStorage(storage)
-                					  ->setPixelsFooterCache(footerCache)
-                					  ->build();
+    if (has_next_morsel) {
+		const PixelsMorsel &morsel = desc->morsels[morsel_index];
+		scan_data.next_morsel = morsel;
+		scan_data.next_morsel_index = morsel_index;
+		scan_data.next_file_index = morsel.file_index;
+		scan_data.next_batch_index = StorageInstance->getBatchID(morsel.device_id, morsel.file_index);
+        scan_data.next_file_name = StorageInstance->getFileName(morsel.device_id, morsel.file_index);
+		if (scan_data.currReader != nullptr && scan_data.next_file_name == scan_data.curr_file_name) {
+			scan_data.nextReader = scan_data.currReader;
+		} else {
+			auto builder = std::make_shared<PixelsReaderBuilder>();
+			std::shared_ptr<::Storage> storage = StorageFactory::getInstance()->getStorage(::Storage::file);
+			scan_data.nextReader = builder->setPath(scan_data.next_file_name)
+										  ->setStorage(storage)
+										  ->setPixelsFooterCache(parallel_state.footer_cache)
+										  ->build();
+		}
 
         PixelsReaderOption option = GetPixelsReaderOption(scan_data, parallel_state);
         scan_data.nextPixelsRecordReader = scan_data.nextReader->read(option);
-        auto nextPixelsRecordReader = std::static_pointer_cast<PixelsRecordReaderImpl>(scan_data.nextPixelsRecordReader);
-        nextPixelsRecordReader->read();
+		/*
+		 * a scan whose every row counts towards its limit may be done before
+		 * it gets to the next morsel; one whose filters drop rows likely is not
+		 */
+		if (!bind_data.row_limit_exact) {
+			auto nextPixelsRecordReader = std::static_pointer_cast<PixelsRecordReaderImpl>(scan_data.nextPixelsRecordReader);
+			nextPixelsRecordReader->read();
+		}
     } else {
         scan_data.nextReader = nullptr;
         scan_data.nextPixelsRecordReader = nullptr;
@@ -259,7 +649,7 @@ PixelsFdwExecutionState::GetPixelsReaderOption(PixelsReadLocalState &local_state
     option.setTolerantSchemaEvolution(true);
     option.setEnableEncodedColumnVector(true);
     option.setIncludeCols(local_state.column_names);
-	option.setRGRange(0, local_state.nextReader->getRowGroupNum());
+	option.setRGRange(local_state.next_morsel.rg_start, local_state.next_morsel.rg_len);
     option.setQueryId(1);
 	option.setEnabledFilterPushDown(true);
 	option.setFilters(local_state.filters);
@@ -268,36 +658,201 @@ PixelsFdwExecutionState::GetPixelsReaderOption(PixelsReadLocalState &local_state
     return option;
 }
 
-void PixelsFdwExecutionState::GetNextOffsets() {
-	auto currPixelsRecordReader = std::static_pointer_cast<PixelsRecordReaderImpl>(scan_data->currPixelsRecordReader);
-	if (cur_row_index == -1) {
-		scan_data->vectorizedRowBatch->increment(-1);
-		masked_next_offsets.clear();
-		int masked_next_offset = 1;
-        for (int j = 0; j < scan_data->vectorizedRowBatch->count(); j++) {
-            if (enable_filter_pushdown && !currPixelsRecordReader->getFilterMask()->get(j)) {
-				masked_next_offset++;
-            }
-			else {
-				masked_next_offsets.insert(std::make_pair(j - masked_next_offset, masked_next_offset));
-				masked_next_offset = 1;
+uint64_t
+PixelsFdwExecutionState::PixelsBuildSelection(PixelsBitMask &filterMask,
+											  uint64_t count,
+											  uint32_t *selection) {
+	/* the mask keeps the bit of row i in bit i % 8 of byte i / 8 */
+	const uint8_t *mask = filterMask.mask;
+	uint64_t selected = 0;
+	for (uint64_t base = 0; base < count; base += 64) {
+		uint64_t word = 0;
+		memcpy(&word, mask + base / 8, std::min<uint64_t>(8, (count - base + 7) / 8));
+		if (count - base < 64) {
+			word &= (1ULL << (count - base)) - 1;
+		}
+		if (selection == nullptr) {
+			selected += __builtin_popcountll(word);
+			continue;
+		}
+		while (word) {
+			selection[selected++] = base + __builtin_ctzll(word);
+			word &= word - 1;
+		}
+	}
+	return selected;
+}
+
+void PixelsFdwExecutionState::GetSelection(const std::shared_ptr<PixelsRecordReaderImpl> &currPixelsRecordReader) {
+	uint64_t count = scan_data->vectorizedRowBatch->count();
+	selection_index = 0;
+	selection_all = true;
+	selection_count = count;
+	if (!enable_filter_pushdown || count == 0 || batch_verdict == PixelsFilterVerdict::ALL) {
+		return;
+	}
+	if (batch_verdict == PixelsFilterVerdict::NONE) {
+		selection_count = 0;
+		return;
+	}
+	auto filterMask = currPixelsRecordReader->getFilterMask();
+	/* count first, so that batches where all or no rows pass need no per-row work */
+	selection_count = PixelsBuildSelection(*filterMask, count, nullptr);
+	if (selection_count == count || selection_count == 0) {
+		return;
+	}
+	selection_all = false;
+	if (selection.size() < count) {
+		selection.resize(count);
+	}
+	PixelsBuildSelection(*filterMask, count, selection.data());
+}
+
+void PixelsFdwExecutionState::ReadNextBatch(const std::shared_ptr<PixelsRecordReaderImpl> &currPixelsRecordReader) {
+	SetStrideVerdicts();
+	scan_data->vectorizedRowBatch = currPixelsRecordReader->readBatch(false);
+	GetSelection(currPixelsRecordReader);
+	if (selection_count == 0) {
+		return;
+	}
+	/*
+	 * By-reference Datums of the previous batch are no longer referenced by
+	 * the scan slot, so the whole batch is released at once.
+	 */
+	MemoryContextReset(batch_cxt);
+	MemoryContext oldcxt = MemoryContextSwitchTo(batch_cxt);
+	const uint32_t *rows = selection_all ? nullptr : selection.data();
+	for (auto &converter : converters) {
+		converter.Bind(scan_data->vectorizedRowBatch->cols.at(converter.vector_index));
+		converter.Convert(rows, selection_count);
+	}
+	MemoryContextSwitchTo(oldcxt);
+}
+
+/*
+ * Called whenever the scan moves on to a new morsel. The slot no longer
+ * refers to Datums of the previous morsel once the next batch is requested.
+ */
+void
+PixelsFdwExecutionState::ResetMorselData() {
+	for (auto &converter : converters) {
+		converter.ResetStringCache();
+	}
+	for (auto &converter : deferred_converters) {
+		converter.ResetStringCache();
+	}
+	MemoryContextReset(morsel_cxt);
+}
+
+/*
+ * Checks the filters against the statistics of every pixel stride in the
+ * current morsel. Batches are one stride long, so the n-th batch of the
+ * morsel covers the n-th stride as long as no row group but the last ends
+ * with a partial stride; otherwise the batches are filtered row by row.
+ */
+void
+PixelsFdwExecutionState::LoadStrideVerdicts() {
+	stride_verdicts.clear();
+	stride_index = 0;
+	auto &filters = scan_data->filters;
+	if (!enable_filter_pushdown || scan_data->currReader == nullptr) {
+		return;
+	}
+	const PixelsMorsel &morsel = scan_data->curr_morsel;
+	auto footer = scan_data->currReader->getFooter();
+	auto schema = scan_data->currReader->getFileSchema();
+	uint64_t stride = std::stoul(ConfigFactory::Instance().getProperty("pixel.stride"));
+	const auto &field_names = schema->getFieldNames();
+	vector<int> filter_columns;
+	for (auto filter : filters) {
+		int column = -1;
+		for (int i = 0; i < field_names.size(); i++) {
+			if (strcasecmp(field_names.at(i).c_str(), filter->getColumnName().c_str()) == 0) {
+				column = i;
+				break;
 			}
-        }
-		for (std::pair<int, int> offset : masked_next_offsets) {
-			std::cout << "offset: " << offset.first << " " << offset.second << std::endl;
 		}
+		filter_columns.emplace_back(column);
 	}
-	if (masked_next_offsets.find(cur_row_index) == masked_next_offsets.end()) {
-		scan_data->vectorizedRowBatch->increment(scan_data->vectorizedRowBatch->count());
-		cur_row_index = PIXELS_FDW_MAX_COLUMN_LENGTH;
+
+	vector<PixelsFilterVerdict> verdicts;
+	uint32_t rg_end = morsel.rg_start + morsel.rg_len;
+	for (uint32_t rg_id = morsel.rg_start; rg_id < rg_end; rg_id++) {
+		if (rg_id >= footer.rowgroupinfos_size()) {
+			return;
+		}
+		uint64_t rg_rows = footer.rowgroupinfos(rg_id).numberofrows();
+		if (rg_rows % stride != 0 && rg_id + 1 < rg_end) {
+			return;
+		}
+		uint64_t stride_num = (rg_rows + stride - 1) / stride;
+		/* every stride passes when the whole row group does, no need for its footer */
+		if (rg_id < footer.rowgroupstats_size() &&
+			PixelsCheckRowGroup(filters, footer.rowgroupstats(rg_id), schema) == PixelsFilterVerdict::ALL) {
+			verdicts.insert(verdicts.end(), stride_num * filters.size(), PixelsFilterVerdict::ALL);
+			continue;
+		}
+		auto rg_footer = scan_data->currReader->getRowGroupFooter(rg_id);
+		const auto &rg_index = rg_footer.rowgroupindexentry();
+		for (uint64_t stride_id = 0; stride_id < stride_num; stride_id++) {
+			for (size_t i = 0; i < filters.size(); i++) {
+				int column = filter_columns[i];
+				if (column < 0 || column >= rg_index.columnchunkindexentries_size() ||
+					rg_index.columnchunkindexentries(column).pixelstatistics_size() != stride_num) {
+					verdicts.emplace_back(PixelsFilterVerdict::SOME);
+					continue;
+				}
+				const auto &chunk_index = rg_index.columnchunkindexentries(column);
+				verdicts.emplace_back(filters[i]->CheckStatistics(chunk_index.pixelstatistics(stride_id).statistic(),
+																  schema->getChildren().at(column)));
+			}
+		}
+	}
+	stride_verdicts = std::move(verdicts);
+}
+
+/*
+ * Hands the verdicts of the stride the next batch covers to the filters
+ * before the record reader applies them.
+ */
+void
+PixelsFdwExecutionState::SetStrideVerdicts() {
+	auto &filters = scan_data->filters;
+	batch_verdict = PixelsFilterVerdict::SOME;
+	if (filters.empty()) {
+		return;
+	}
+	size_t offset = stride_index * filters.size();
+	bool known = offset + filters.size() <= stride_verdicts.size();
+	stride_index++;
+	if (!known) {
+		for (auto filter : filters) {
+			filter->setStrideVerdict(PixelsFilterVerdict::SOME);
+		}
+		return;
+	}
+	batch_verdict = PixelsFilterVerdict::ALL;
+	for (size_t i = 0; i < filters.size(); i++) {
+		batch_verdict = std::min(batch_verdict, stride_verdicts[offset + i]);
 	}
-	else {
-		scan_data->vectorizedRowBatch->increment(masked_next_offsets[cur_row_index]);
-    	cur_row_index += masked_next_offsets[cur_row_index];
+	/* no filter needs to run once one of them rules out the stride */
+	for (size_t i = 0; i < filters.size(); i++) {
+		filters[i]->setStrideVerdict(batch_verdict == PixelsFilterVerdict::NONE ?
+									 PixelsFilterVerdict::NONE : stride_verdicts[offset + i]);
 	}
 }
 
 bool PixelsFdwExecutionState::GetNextBatch() {
+	if (!scan_initialized) {
+		if (runtime_pending) {
+			ResolveRuntimeFilters();
+		}
+		if (parallel_state->parallel_desc == nullptr) {
+			PixelsScanInitCursor(*bind_data, *parallel_state);
+		}
+		scan_data = PixelsFdwExecutionState::PixelsScanInitLocal(*bind_data, *parallel_state, column_map);
+		scan_initialized = true;
+	}
 	if (!scan_data) {
 		return false;
 	}
@@ -305,127 +860,307 @@ bool PixelsFdwExecutionState::GetNextBatch() {
         if(!PixelsParallelStateNext(*bind_data, *scan_data, *parallel_state)) {
             return false;
         }
+		ResetMorselData();
+		LoadStrideVerdicts();
     }
     auto currPixelsRecordReader = std::static_pointer_cast<PixelsRecordReaderImpl>(scan_data->currPixelsRecordReader);
-	if (scan_data->vectorizedRowBatch == nullptr) {
-        scan_data->vectorizedRowBatch = currPixelsRecordReader->readBatch(false);
-		cur_row_index = -1;
-		GetNextOffsets();
-    }
-	while (scan_data->vectorizedRowBatch->isEndOfFile()) {
+	while (selection_index >= selection_count) {
 		if (currPixelsRecordReader->isEndOfFile()) {
 			currPixelsRecordReader.reset();
        		if(!PixelsParallelStateNext(*bind_data, *scan_data, *parallel_state)) {
             	return false;
         	}
+			ResetMorselData();
+			LoadStrideVerdicts();
 			currPixelsRecordReader = std::static_pointer_cast<PixelsRecordReaderImpl>(scan_data->currPixelsRecordReader);
-			if (scan_data->vectorizedRowBatch == nullptr) {
-        		scan_data->vectorizedRowBatch = currPixelsRecordReader->readBatch(false);
-				cur_row_index = -1;
-				GetNextOffsets();
-   		 	}
-		}
-		else {
-			scan_data->vectorizedRowBatch = currPixelsRecordReader->readBatch(false);
-			cur_row_index = -1;
-			GetNextOffsets();
+			continue;
 		}
+		ReadNextBatch(currPixelsRecordReader);
 	}
 	return true;
 }
 
+/*
+ * Limits the scan to the row groups flagged in `row_groups`, by file path;
+ * has to be called before the first fetch.
+ */
+void
+PixelsFdwExecutionState::RestrictRowGroups(std::unordered_map<std::string, std::vector<bool>> row_groups) {
+	Assert(!scan_initialized);
+	bind_data->row_groups = std::move(row_groups);
+}
+
+/*
+ * The morsels and the cursor over them are made again on the next fetch,
+ * for a scan that is not parallel, from the footer statistics loaded for
+ * the first ones.
+ */
+void
+PixelsFdwExecutionState::ResetMorsels() {
+	Assert(!scan_initialized && !shared_desc);
+	parallel_state->morsels_initialized = false;
+	parallel_state->parallel_desc = nullptr;
+	parallel_state->local_desc.reset();
+}
+
+/*
+ * Tells the scan that it is asked for at most `row_limit` rows; `exact`
+ * when every row read is returned, without quals or filters to drop some.
+ * Has to be called before the first fetch or after a rescan, and never on
+ * a parallel scan, whose morsels are shared already.
+ */
+void
+PixelsFdwExecutionState::SetRowLimit(uint64_t row_limit, bool exact) {
+	exact = exact && row_limit > 0;
+	if (bind_data->row_limit == row_limit && bind_data->row_limit_exact == exact) {
+		return;
+	}
+	bind_data->row_limit = row_limit;
+	bind_data->row_limit_exact = exact;
+	ResetMorsels();
+}
+
+/*
+ * Visits the morsels in the order of the best value their row groups may
+ * hold in the column of slot attribute `attnum`, for a sort on it; same
+ * restrictions as SetRowLimit.
+ */
+void
+PixelsFdwExecutionState::OrderRowGroups(int attnum, bool descending, bool nulls_first) {
+	string column;
+	for (int i = 0; i < column_map.size(); i++) {
+		if (column_map[i] == attnum) {
+			column = bind_data->fileSchema->getFieldNames().at(i);
+			break;
+		}
+	}
+	bind_data->order_column = column;
+	bind_data->order_descending = descending;
+	bind_data->order_nulls_first = nulls_first;
+	ResetMorsels();
+}
+
+/*
+ * Visits the files one after the other in the order they were given, for
+ * files sorted one after the other; same restrictions as SetRowLimit.
+ */
+void
+PixelsFdwExecutionState::KeepFileOrder() {
+	bind_data->keep_file_order = true;
+	ResetMorsels();
+}
+
+/*
+ * From now on the scan only has to return rows sorting before `value` in
+ * the column the morsels are ordered by; it ends at the first morsel
+ * whose row groups hold none.
+ */
+void
+PixelsFdwExecutionState::SetSortThreshold(int64_t value) {
+	parallel_state->sort_threshold = value;
+	parallel_state->has_sort_threshold = true;
+}
+
+/*
+ * Makes the scan take its filters from `serialized_filters` on the first
+ * fetch and after every rescan, with the values of the Params evaluated in
+ * `econtext` at that time, for the scan of a parameterized path; the
+ * filters the scan was made with are replaced. Same restrictions as
+ * SetRowLimit.
+ */
+void
+PixelsFdwExecutionState::SetRuntimeFilters(List *serialized_filters,
+										   List *param_states,
+										   ExprContext *econtext) {
+	runtime_filters = serialized_filters;
+	runtime_params = param_states;
+	runtime_econtext = econtext;
+	if (!runtime_cxt) {
+		runtime_cxt = AllocSetContextCreate(CurrentMemoryContext,
+											"pixels_fdw runtime filters",
+											ALLOCSET_SMALL_SIZES);
+	}
+	runtime_pending = true;
+}
+
+/*
+ * Rebuilds the filters from the current values of the Params and makes
+ * the morsels again, so that the row groups are pruned with them.
+ */
+void
+PixelsFdwExecutionState::ResolveRuntimeFilters() {
+	int param_count = list_length(runtime_params);
+	int param_index = 0;
+	ListCell *lc;
+
+	runtime_pending = false;
+	for (auto filter : filters_list) {
+		delete filter;
+	}
+	filters_list.clear();
+	/* the old filters may have pointed into the context */
+	MemoryContextReset(runtime_cxt);
+	MemoryContext old_cxt = MemoryContextSwitchTo(runtime_cxt);
+	Datum *param_values = (Datum *) palloc(sizeof(Datum) * Max(param_count, 1));
+	bool *param_nulls = (bool *) palloc(sizeof(bool) * Max(param_count, 1));
+	foreach (lc, runtime_params) {
+		param_values[param_index] = ExecEvalExpr((ExprState *) lfirst(lc),
+												 runtime_econtext,
+												 &param_nulls[param_index]);
+		param_index++;
+	}
+	foreach (lc, runtime_filters) {
+		PixelsFilter *filter = pixels_deserialize_filter((List *) lfirst(lc), param_values, param_nulls);
+		if (filter) {
+			filters_list.emplace_back(filter);
+		}
+	}
+	MemoryContextSwitchTo(old_cxt);
+	PixelsResolveFilters(filters_list, bind_data->fileSchema);
+	bind_data->filters = filters_list;
+	enable_filter_pushdown = !filters_list.empty();
+	ResetMorsels();
+}
+
 bool PixelsFdwExecutionState::next(TupleTableSlot* slot) {
 	if (!GetNextBatch()) {
 		return false;
 	}
-	for (int i = 0; i < scan_data->column_ids.size(); i++) {
-		int column_id = scan_data->column_ids.at(i);
-		auto col = scan_data->vectorizedRowBatch->cols.at(i);
-		auto colSchema = bind_data->fileSchema->getChildren().at(column_id);
-		switch (colSchema->getCategory()) {
-			case TypeDescription::SHORT: {
-			    auto intCol = std::static_pointer_cast<LongColumnVector>(col);
-                slot->tts_isnull[column_id] = false;
-				slot->tts_values[column_id] = Int16GetDatum(*((short*)(intCol->current())));
-			    break;
-			}
-			case TypeDescription::INT: {
-				auto intCol = std::static_pointer_cast<LongColumnVector>(col);
-                slot->tts_isnull[column_id] = false;
-				slot->tts_values[column_id] = Int32GetDatum(*((int*)(intCol->current())));
-			    break;
-		    }
-			case TypeDescription::LONG: {
-				auto intCol = std::static_pointer_cast<LongColumnVector>(col);
-                slot->tts_isnull[column_id] = false;
-				slot->tts_values[column_id] = Int64GetDatum(*((long*)(intCol->current())));
-			    break;
-			}
-			case TypeDescription::DATE: {
-				auto intCol = std::static_pointer_cast<DateColumnVector>(col);
-                slot->tts_isnull[column_id] = false;
-				slot->tts_values[column_id] = DateADTGetDatum(*((int*)(intCol->current())) + (UNIX_EPOCH_JDATE - POSTGRES_EPOCH_JDATE));
-			    break;
-		    }
-			case TypeDescription::DECIMAL: {
-				auto decimalCol = std::static_pointer_cast<DecimalColumnVector>(col);
-				if (decimalCol->getPrecision() > 18) {
-					throw PixelsReaderException("Pixels reader do not support longer decimal");
-				}
-				// lose precision
-				Datum numeric_data = DirectFunctionCall1(float8_numeric,
-													 	 Float8GetDatum(float8(*((long*)(decimalCol->current())) / std::pow(10, decimalCol->getScale()))));
-                slot->tts_isnull[column_id] = false;
-				slot->tts_values[column_id] = numeric_data;
-			    break;
-		    }
-			case TypeDescription::VARCHAR:
-			case TypeDescription::CHAR:
-		    {
-			    auto binaryCol = std::static_pointer_cast<BinaryColumnVector>(col);
-	            string_t *string_value = (string_t*)(binaryCol->current());
-            	int64 bytea_len = string_value->GetSize() + VARHDRSZ;
-            	bytea *b = (bytea*)palloc0(bytea_len);
-            	SET_VARSIZE(b, bytea_len);
-            	memcpy(VARDATA(b), string_value->GetData(), string_value->GetSize());
-                slot->tts_isnull[column_id] = false;
-				slot->tts_values[column_id] = PointerGetDatum(b);
-			    break;
-		    }
-            default: {
-				throw PixelsReaderException("Pixels reader do not support other types now");
-				break;
-			}	
-		}       
-    }
-	if (masked_next_offsets.find(cur_row_index) == masked_next_offsets.end()) {
-		scan_data->vectorizedRowBatch->increment(scan_data->vectorizedRowBatch->count());
-		cur_row_index = PIXELS_FDW_MAX_COLUMN_LENGTH;
+	FillSlot(slot, selection_index++);
+    return true;
+}
+
+void
+PixelsFdwExecutionState::LimitConversion(const set<int> &attnums) {
+	vector<PixelsColumnConverter> converted;
+	for (auto &converter : converters) {
+		if (attnums.count(converter.attnum)) {
+			converted.emplace_back(std::move(converter));
+		} else {
+			deferred_converters.emplace_back(std::move(converter));
+		}
+	}
+	converters = std::move(converted);
+}
+
+/*
+ * Converts the columns left out by LimitConversion for `count` rows of the
+ * current batch, given by their index in the batch. Their Datums live as
+ * long as those of the batch.
+ */
+void
+PixelsFdwExecutionState::ConvertDeferred(const uint32_t *rows, uint64_t count) {
+	MemoryContext oldcxt = MemoryContextSwitchTo(batch_cxt);
+	for (auto &converter : deferred_converters) {
+		converter.Bind(scan_data->vectorizedRowBatch->cols.at(converter.vector_index));
+		converter.Convert(rows, count);
 	}
-	else {
-		scan_data->vectorizedRowBatch->increment(masked_next_offsets[cur_row_index]);
-    	cur_row_index += masked_next_offsets[cur_row_index];
+	MemoryContextSwitchTo(oldcxt);
+}
+
+bool
+PixelsFdwExecutionState::NextBatch() {
+	/* the rows of the current batch are done with */
+	selection_index = selection_count;
+	return GetNextBatch();
+}
+
+const uint32_t *
+PixelsFdwExecutionState::GetSelection() {
+	return selection_all ? nullptr : selection.data();
+}
+
+uint64_t
+PixelsFdwExecutionState::GetSelectionCount() {
+	return selection_count;
+}
+
+std::shared_ptr<ColumnVector>
+PixelsFdwExecutionState::GetColumnVector(int attnum) {
+	if (vector_indexes[attnum] < 0) {
+		return nullptr;
+	}
+	return scan_data->vectorizedRowBatch->cols.at(vector_indexes[attnum]);
+}
+
+std::shared_ptr<TypeDescription>
+PixelsFdwExecutionState::GetColumnType(int attnum) {
+	return column_types[attnum];
+}
+
+void
+PixelsFdwExecutionState::InitSlot(TupleTableSlot *slot) {
+	/*
+	 * Columns that are not read stay null, so that the slot is safe to
+	 * materialize even when it is passed up with the full relation width.
+	 */
+	if (!slot_initialized) {
+		memset(slot->tts_isnull, true, slot->tts_tupleDescriptor->natts * sizeof(bool));
+		slot_initialized = true;
+	}
+}
+
+void
+PixelsFdwExecutionState::FillDeferred(TupleTableSlot *slot, uint64_t index) {
+	InitSlot(slot);
+	for (auto &converter : deferred_converters) {
+		slot->tts_values[converter.attnum] = converter.values[index];
+		slot->tts_isnull[converter.attnum] = converter.nulls[index];
+	}
+}
+
+void
+PixelsFdwExecutionState::FillSlot(TupleTableSlot *slot, uint64_t index) {
+	InitSlot(slot);
+	for (auto &converter : converters) {
+		slot->tts_values[converter.attnum] = converter.values[index];
+		slot->tts_isnull[converter.attnum] = converter.nulls[index];
 	}
 	ExecStoreVirtualTuple(slot);
-    return true;
 }
 
 void
 PixelsFdwExecutionState::PixelsFdwExecutionState::rescan() {
-	bind_data->initialPixelsReader->close();
-	bind_data.reset();
-	parallel_state->initialPixelsReader->close();
-	parallel_state.reset();
-	scan_data->currReader->close();
-	scan_data->currPixelsRecordReader->close();
-	scan_data->nextPixelsRecordReader->close();
-	scan_data.reset();
-	shared_ptr<TypeDescription> file_schema;
-	bind_data = PixelsFdwExecutionState::PixelsScanBind(files_list, filters_list, file_schema);
-	column_map = PixelsFdwExecutionState::PixelsGetColumnMap(file_schema, attrs_used, tuple_desc);
-	parallel_state = PixelsFdwExecutionState::PixelsScanInitGlobal(*bind_data);
-	scan_data = PixelsFdwExecutionState::PixelsScanInitLocal(*bind_data, *parallel_state, column_map);
+	if (scan_data) {
+		::BufferPool::Reset();
+	}
+	ReleaseLocalScan();
+	/* the shared cursor of a parallel scan is reset by ReInitializeParallelScan */
+	if (!shared_desc && parallel_state->parallel_desc) {
+		pg_atomic_write_u32(&parallel_state->parallel_desc->next_morsel, 0);
+	}
+	selection_index = 0;
+	selection_count = 0;
+	parallel_state->has_sort_threshold = false;
+	MemoryContextReset(batch_cxt);
+	ResetMorselData();
+	runtime_pending = runtime_params != NIL;
+}
+
+Size
+PixelsFdwExecutionState::EstimateParallelScan() {
+	if (!parallel_state->morsels_initialized) {
+		PixelsScanInitMorsels(*bind_data, *parallel_state);
+	}
+	return PixelsParallelScanDescSize(parallel_state->morsels.size());
+}
 
+void
+PixelsFdwExecutionState::InitializeParallelScan(void *coordinate) {
+	shared_desc = (PixelsParallelScanDesc *) coordinate;
+	PixelsParallelScanDescInit(shared_desc, parallel_state->morsels);
+	parallel_state->parallel_desc = shared_desc;
+}
+
+void
+PixelsFdwExecutionState::ReInitializeParallelScan(void *coordinate) {
+	pg_atomic_write_u32(&((PixelsParallelScanDesc *) coordinate)->next_morsel, 0);
+}
+
+void
+PixelsFdwExecutionState::AttachParallelScan(void *coordinate) {
+	shared_desc = (PixelsParallelScanDesc *) coordinate;
+	parallel_state->parallel_desc = shared_desc;
 }
 
 PixelsFdwExecutionState*
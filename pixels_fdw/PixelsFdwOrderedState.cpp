@@ -0,0 +1,223 @@
+//
+// Ordered scan of a table whose pixels files are each sorted on a key.
+//
+
+#include "PixelsFdwOrderedState.hpp"
+#include "PixelsDeparse.hpp"
+#include <algorithm>
+#include <strings.h>
+
+extern "C" {
+#include "miscadmin.h"
+#include "utils/typcache.h"
+}
+
+//! Range of the sort column in a file, in the sort order
+struct PixelsFileRange {
+	size_t file;
+	bool known;
+	int64_t first;
+	int64_t last;
+};
+
+static PixelsFileRange
+PixelsGetFileRange(const PixelsFileStats &stats, size_t file, const std::string &column, bool descending) {
+	PixelsFileRange range{file, false, 0, 0};
+	const auto &field_names = stats.schema->getFieldNames();
+	int col = -1;
+	for (int i = 0; i < field_names.size(); i++) {
+		if (strcasecmp(field_names.at(i).c_str(), column.c_str()) == 0) {
+			col = i;
+			break;
+		}
+	}
+	const auto &footer = stats.footer;
+	if (col < 0 || footer.rowgroupinfos_size() == 0 ||
+		footer.rowgroupstats_size() < footer.rowgroupinfos_size()) {
+		return range;
+	}
+	auto category = stats.schema->getChildren().at(col)->getCategory();
+	int64_t minimum = 0;
+	int64_t maximum = 0;
+	for (int rg_id = 0; rg_id < footer.rowgroupinfos_size(); rg_id++) {
+		if (col >= footer.rowgroupstats(rg_id).columnchunkstats_size()) {
+			return range;
+		}
+		const auto &chunk = footer.rowgroupstats(rg_id).columnchunkstats(col);
+		if (!chunk.has_hasnull() || chunk.hasnull()) {
+			return range;
+		}
+		int64_t rg_min;
+		int64_t rg_max;
+		if ((category == TypeDescription::SHORT || category == TypeDescription::INT ||
+			 category == TypeDescription::LONG) && chunk.has_intstatistics()) {
+			rg_min = chunk.intstatistics().minimum();
+			rg_max = chunk.intstatistics().maximum();
+		} else if (category == TypeDescription::DATE && chunk.has_datestatistics()) {
+			rg_min = chunk.datestatistics().minimum();
+			rg_max = chunk.datestatistics().maximum();
+		} else if (category == TypeDescription::TIMESTAMP && chunk.has_timestampstatistics()) {
+			rg_min = chunk.timestampstatistics().minimum();
+			rg_max = chunk.timestampstatistics().maximum();
+		} else {
+			return range;
+		}
+		minimum = rg_id == 0 ? rg_min : std::min(minimum, rg_min);
+		maximum = rg_id == 0 ? rg_max : std::max(maximum, rg_max);
+	}
+	range.known = true;
+	range.first = descending ? maximum : minimum;
+	range.last = descending ? minimum : maximum;
+	return range;
+}
+
+/*
+ * Interval partitioning: files are taken by the start of their range and
+ * appended to the first run they follow, which leaves as many runs as
+ * ranges overlap at most.
+ */
+std::vector<std::vector<size_t>>
+PixelsSortedRuns(const std::vector<std::shared_ptr<const PixelsFileStats>> &file_stats,
+				 const std::string &column,
+				 bool descending,
+				 bool strict) {
+	std::vector<std::vector<size_t>> runs;
+	std::vector<PixelsFileRange> ranges;
+	for (size_t i = 0; i < file_stats.size(); i++) {
+		PixelsFileRange range = PixelsGetFileRange(*file_stats[i], i, column, descending);
+		if (range.known) {
+			ranges.emplace_back(range);
+		} else {
+			runs.emplace_back(std::vector<size_t>{i});
+		}
+	}
+	auto before = [descending](int64_t a, int64_t b) {
+		return descending ? a > b : a < b;
+	};
+	std::stable_sort(ranges.begin(), ranges.end(), [&](const PixelsFileRange &a, const PixelsFileRange &b) {
+		return before(a.first, b.first);
+	});
+
+	std::vector<int64_t> run_lasts;
+	size_t first_ranged_run = runs.size();
+	for (const auto &range : ranges) {
+		size_t run = 0;
+		for (; run < run_lasts.size(); run++) {
+			int64_t last = run_lasts[run];
+			if (before(last, range.first) || (!strict && last == range.first)) {
+				break;
+			}
+		}
+		if (run == run_lasts.size()) {
+			runs.emplace_back();
+			run_lasts.emplace_back(range.last);
+		}
+		runs[first_ranged_run + run].emplace_back(range.file);
+		run_lasts[run] = range.last;
+	}
+	return runs;
+}
+
+PixelsFdwOrderedState::PixelsFdwOrderedState(List *files,
+											 List *serialized_filters,
+											 Datum *param_values,
+											 bool *param_nulls,
+											 set<int> attrs_used,
+											 TupleDesc tuple_desc,
+											 vector<PixelsOrderKey> keys) {
+	vector<string> paths;
+	ListCell *lc;
+	foreach (lc, files) {
+		paths.emplace_back(strVal(lfirst(lc)));
+	}
+	const PixelsOrderKey &first = keys[0];
+	auto file_runs = PixelsSortedRuns(PixelsLoadFileStats(paths),
+									  NameStr(TupleDescAttr(tuple_desc, first.attnum)->attname),
+									  first.descending,
+									  keys.size() > 1);
+
+	List *run_files = NIL;
+	List *filters = NIL;
+	if (file_runs.size() == 1) {
+		for (size_t file : file_runs[0]) {
+			run_files = lappend(run_files, list_nth(files, file));
+		}
+	} else {
+		run_files = files;
+	}
+	foreach (lc, serialized_filters) {
+		PixelsFilter *filter = pixels_deserialize_filter((List *) lfirst(lc), param_values, param_nulls);
+		if (filter) {
+			filters = lappend(filters, filter);
+		}
+	}
+	scan.reset(createPixelsFdwExecutionState(run_files, filters, attrs_used, tuple_desc));
+	if (file_runs.size() == 1) {
+		scan->KeepFileOrder();
+		return;
+	}
+
+	/*
+	 * The files were rewritten since the query was planned, and a cached
+	 * plan still expects the rows in order: they are sorted here, as a Sort
+	 * above the scan would have.
+	 */
+	int nkeys = keys.size();
+	AttrNumber *attnums = (AttrNumber *) palloc(nkeys * sizeof(AttrNumber));
+	Oid *operators = (Oid *) palloc(nkeys * sizeof(Oid));
+	Oid *collations = (Oid *) palloc(nkeys * sizeof(Oid));
+	bool *nulls_first = (bool *) palloc(nkeys * sizeof(bool));
+	for (int k = 0; k < nkeys; k++) {
+		Form_pg_attribute attr = TupleDescAttr(tuple_desc, keys[k].attnum);
+		TypeCacheEntry *typentry = lookup_type_cache(attr->atttypid,
+													 TYPECACHE_LT_OPR | TYPECACHE_GT_OPR);
+		attnums[k] = keys[k].attnum + 1;
+		operators[k] = keys[k].descending ? typentry->gt_opr : typentry->lt_opr;
+		collations[k] = attr->attcollation;
+		nulls_first[k] = keys[k].nulls_first;
+	}
+	/* the filters are resolved once, so a rescan returns the same rows */
+	sort = tuplesort_begin_heap(tuple_desc, nkeys, attnums, operators, collations, nulls_first,
+								work_mem, NULL, TUPLESORT_RANDOMACCESS);
+	sort_slot = MakeSingleTupleTableSlot(tuple_desc, &TTSOpsMinimalTuple);
+}
+
+PixelsFdwOrderedState::~PixelsFdwOrderedState() {
+	scan.reset();
+	if (sort) {
+		tuplesort_end(sort);
+	}
+	if (sort_slot) {
+		ExecDropSingleTupleTableSlot(sort_slot);
+	}
+}
+
+bool
+PixelsFdwOrderedState::next(TupleTableSlot *slot) {
+	if (!sort) {
+		return scan->next(slot);
+	}
+	if (!sorted) {
+		while (scan->next(slot)) {
+			CHECK_FOR_INTERRUPTS();
+			tuplesort_puttupleslot(sort, slot);
+			ExecClearTuple(slot);
+		}
+		tuplesort_performsort(sort);
+		sorted = true;
+	}
+	if (!tuplesort_gettupleslot(sort, true, false, sort_slot, NULL)) {
+		return false;
+	}
+	ExecCopySlot(slot, sort_slot);
+	return true;
+}
+
+void
+PixelsFdwOrderedState::rescan() {
+	if (sorted) {
+		tuplesort_rescan(sort);
+		return;
+	}
+	scan->rescan();
+}
@@ -5,6 +5,8 @@
 #include "PixelsFdwPlanState.hpp"
 #include "physical/StorageArrayScheduler.h"
 #include "profiler/CountProfiler.h"
+#include <algorithm>
+#include <strings.h>
 
 PixelsFdwPlanState::PixelsFdwPlanState(List* files,
 									   List* col_filters,
@@ -22,27 +24,23 @@ PixelsFdwPlanState::PixelsFdwPlanState(List* files,
 		filters_list = lappend(filters_list, lfirst(filter_lc));
 	}
 
-	auto footerCache = std::make_shared<PixelsFooterCache>();
-	auto builder = std::make_shared<PixelsReaderBuilder>();
-
-	std::shared_ptr<::Storage> storage = StorageFactory::getInstance()->getStorage(::Storage::file);
-	std::shared_ptr<PixelsReader> pixelsReader = builder->setPath(string(strVal(lfirst(list_head(files_list)))))
-	                                 					->setStorage(storage)
-	                                 					->setPixelsFooterCache(footerCache)
-	                                 					->build();
-	initialPixelsReader = pixelsReader;
-    row_count = initialPixelsReader->getNumberOfRows();
+	/* the footers of every file, so that uneven files are counted right */
+	std::vector<std::string> paths;
+	foreach (file_lc, files_list) {
+		paths.emplace_back(strVal(lfirst(file_lc)));
+	}
+	file_stats = PixelsLoadFileStats(paths);
+	row_count = 0;
+	total_bytes = 0;
+	for (auto &stats : file_stats) {
+		row_count += stats->row_count;
+		total_bytes += stats->data_bytes;
+	}
+	scanned_row_count = row_count;
     plan_options = options;
 	attrs_used = bms_make_singleton(1 - FirstLowInvalidHeapAttributeNumber);
 }
 
-PixelsFdwPlanState::~PixelsFdwPlanState() {
-	if (initialPixelsReader) {
-		initialPixelsReader->close();
-	}
-	initialPixelsReader.reset();
-}
-
 List*&
 PixelsFdwPlanState::getFilesList() {
     return files_list;
@@ -58,6 +56,150 @@ PixelsFdwPlanState::getRowCount() {
     return row_count;
 }
 
+uint64_t
+PixelsFdwPlanState::getTotalBytes() {
+    return total_bytes;
+}
+
+const std::vector<std::shared_ptr<const PixelsFileStats>> &
+PixelsFdwPlanState::getFileStats() {
+    return file_stats;
+}
+
+uint64_t
+PixelsFdwPlanState::getScannedRowCount() {
+    return scanned_row_count;
+}
+
+/*
+ * Checks the filters against the row group statistics, the way the scan
+ * prunes row groups, to count the rows that are actually read.
+ */
+void
+PixelsFdwPlanState::EstimateRowGroupPruning(const std::vector<PixelsFilter*> &filters) {
+    scanned_row_count = row_count;
+    if (filters.empty()) {
+        return;
+    }
+    scanned_row_count = 0;
+    file_scanned_rows.clear();
+    for (auto &stats : file_stats) {
+        const auto &footer = stats->footer;
+        uint64_t file_rows = 0;
+        for (int rg_id = 0; rg_id < footer.rowgroupinfos_size(); rg_id++) {
+            if (rg_id >= footer.rowgroupstats_size() ||
+                PixelsCheckRowGroup(filters, footer.rowgroupstats(rg_id), stats->schema) != PixelsFilterVerdict::NONE) {
+                file_rows += footer.rowgroupinfos(rg_id).numberofrows();
+            }
+        }
+        file_scanned_rows.emplace_back(file_rows);
+        scanned_row_count += file_rows;
+    }
+}
+
+/*
+ * Bytes read for `columns`, or for every column when `columns` is empty,
+ * from the row groups that survive pruning. Columns are looked up in the
+ * schema of each file by name.
+ */
+double
+PixelsFdwPlanState::EstimateScanBytes(const std::vector<std::string> &columns) {
+    double bytes = 0;
+    for (size_t i = 0; i < file_stats.size(); i++) {
+        const PixelsFileStats &stats = *file_stats[i];
+        if (stats.row_count == 0) {
+            continue;
+        }
+        double file_bytes = 0;
+        const auto &field_names = stats.schema->getFieldNames();
+        for (size_t j = 0; j < field_names.size() && j < stats.column_bytes.size(); j++) {
+            bool projected = columns.empty();
+            for (auto &column : columns) {
+                if (strcasecmp(field_names.at(j).c_str(), column.c_str()) == 0) {
+                    projected = true;
+                    break;
+                }
+            }
+            if (projected) {
+                file_bytes += stats.column_bytes[j];
+            }
+        }
+        uint64_t rows = i < file_scanned_rows.size() ? file_scanned_rows[i] : stats.row_count;
+        bytes += file_bytes * rows / stats.row_count;
+    }
+    return bytes;
+}
+
+/*
+ * Share of the rows an equality lookup on `column` reads for a value not
+ * known yet: a row group is read when the value falls within the range of
+ * its statistics, the value being taken as uniform over the range of the
+ * column. Row groups without integer, date or timestamp statistics are
+ * always read.
+ */
+double
+PixelsFdwPlanState::EstimateLookupFraction(const std::string &column) {
+    struct Range {
+        bool known;
+        int64_t minimum;
+        int64_t maximum;
+        uint64_t rows;
+    };
+    std::vector<Range> ranges;
+    bool any_known = false;
+    int64_t minimum = 0;
+    int64_t maximum = 0;
+    uint64_t rows = 0;
+    for (auto &stats : file_stats) {
+        const auto &footer = stats->footer;
+        const auto &field_names = stats->schema->getFieldNames();
+        int col = -1;
+        for (int i = 0; i < field_names.size(); i++) {
+            if (strcasecmp(field_names.at(i).c_str(), column.c_str()) == 0) {
+                col = i;
+                break;
+            }
+        }
+        for (int rg_id = 0; rg_id < footer.rowgroupinfos_size(); rg_id++) {
+            Range range{false, 0, 0, footer.rowgroupinfos(rg_id).numberofrows()};
+            rows += range.rows;
+            if (col >= 0 && rg_id < footer.rowgroupstats_size() &&
+                col < footer.rowgroupstats(rg_id).columnchunkstats_size()) {
+                const auto &chunk = footer.rowgroupstats(rg_id).columnchunkstats(col);
+                if (chunk.has_intstatistics()) {
+                    range = Range{true, chunk.intstatistics().minimum(), chunk.intstatistics().maximum(), range.rows};
+                } else if (chunk.has_datestatistics()) {
+                    range = Range{true, chunk.datestatistics().minimum(), chunk.datestatistics().maximum(), range.rows};
+                } else if (chunk.has_timestampstatistics()) {
+                    range = Range{true, chunk.timestampstatistics().minimum(),
+                                  chunk.timestampstatistics().maximum(), range.rows};
+                }
+            }
+            if (range.known) {
+                minimum = any_known ? std::min(minimum, range.minimum) : range.minimum;
+                maximum = any_known ? std::max(maximum, range.maximum) : range.maximum;
+                any_known = true;
+            }
+            ranges.emplace_back(range);
+        }
+    }
+    if (!any_known || rows == 0 || maximum <= minimum) {
+        return 1.0;
+    }
+
+    /* a row group holds at least its share of the values */
+    double width = (double) maximum - (double) minimum;
+    double read_rows = 0;
+    for (auto &range : ranges) {
+        double probability = 1.0;
+        if (range.known) {
+            probability = std::max(((double) range.maximum - (double) range.minimum) / width,
+                                   (double) range.rows / rows);
+        }
+        read_rows += range.rows * std::min(probability, 1.0);
+    }
+    return read_rows / rows;
+}
 
 PixelsFdwPlanState*
 createPixelsFdwPlanState(List* files,
@@ -0,0 +1,1208 @@
+//
+// Execution of an upper ForeignScan.
+//
+
+#include "PixelsFdwUpperState.hpp"
+#include "PixelsDeparse.hpp"
+#include <algorithm>
+
+extern "C" {
+#include "access/table.h"
+#include "executor/executor.h"
+#include "miscadmin.h"
+#include "optimizer/optimizer.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/tuplesort.h"
+#include "utils/typcache.h"
+}
+
+PixelsFdwUpperState::PixelsFdwUpperState(ForeignScanState *node,
+										 List *files,
+										 List *filters,
+										 set<int> attrs_used,
+										 List *upper) {
+	ListCell *lc;
+	foreach (lc, files) {
+		files_list.emplace_back(std::string(strVal(lfirst(lc))));
+	}
+	kind = (PixelsUpperKind) intVal(linitial(upper));
+	relid = linitial_oid((List *) lsecond(upper));
+	scan_tlist = ((ForeignScan *) node->ss.ps.plan)->fdw_scan_tlist;
+	switch (kind) {
+		case PIXELS_UPPER_METADATA:
+			ComputeMetadata();
+			computed = true;
+			group_count = 1;
+			break;
+		case PIXELS_UPPER_AGGREGATE:
+			InitAggregates(node, files, filters, attrs_used, (List *) lthird(upper));
+			break;
+		case PIXELS_UPPER_LIMIT:
+			InitLimit(node, files, filters, attrs_used, upper);
+			break;
+		case PIXELS_UPPER_TOPN:
+			InitTopN(node, files, filters, attrs_used, upper);
+			break;
+		case PIXELS_UPPER_JOIN:
+			InitJoin(node, files, filters, attrs_used, upper);
+			break;
+		default:
+			elog(ERROR, "pixels_fdw: unknown upper scan kind %d", kind);
+	}
+}
+
+PixelsFdwUpperState::~PixelsFdwUpperState() {
+	table_scan.reset();
+	probe_scan.reset();
+	if (table_slot) {
+		ExecDropSingleTupleTableSlot(table_slot);
+	}
+	if (probe_slot) {
+		ExecDropSingleTupleTableSlot(probe_slot);
+	}
+	if (top_sort) {
+		tuplesort_end(top_sort);
+	}
+	if (top_slot) {
+		ExecDropSingleTupleTableSlot(top_slot);
+	}
+	if (result_cxt) {
+		MemoryContextDelete(result_cxt);
+	}
+	if (row_cxt) {
+		MemoryContextDelete(row_cxt);
+	}
+}
+
+/*
+ * Every entry of the scan tuple is an aggregate the planner found to be
+ * answerable from the footers. The files may have been rewritten since, so
+ * statistics that went missing are an error rather than a wrong answer.
+ */
+void
+PixelsFdwUpperState::ComputeMetadata() {
+	auto file_stats = PixelsLoadFileStats(files_list);
+	ListCell *lc;
+	foreach (lc, scan_tlist) {
+		Aggref *aggref = (Aggref *) ((TargetEntry *) lfirst(lc))->expr;
+		PixelsAggregateKind agg_kind;
+		Expr *arg;
+		Datum value = (Datum) 0;
+		bool isnull = true;
+
+		if (!IsA(aggref, Aggref) || !pixels_aggregate_kind(aggref, &agg_kind, &arg) ||
+			(arg && !IsA(arg, Var)) ||
+			!pixels_footer_aggregate(file_stats, agg_kind,
+									 arg ? get_attname(relid, ((Var *) arg)->varattno, false) : NULL,
+									 arg ? ((Var *) arg)->vartype : InvalidOid,
+									 &value, &isnull)) {
+			elog(ERROR, "pixels_fdw: footer statistics no longer answer the aggregates, plan the query again");
+		}
+		values.emplace_back(value);
+		nulls.emplace_back(isnull);
+	}
+}
+
+/*
+ * Sets up the scan of the table: only the columns of the restriction
+ * clauses are converted into Datums, the aggregates and the grouping
+ * columns read the others straight from the column vectors. The entries of
+ * the scan tuple that are no aggregates are the grouping columns.
+ */
+void
+PixelsFdwUpperState::InitAggregates(ForeignScanState *node,
+									List *files,
+									List *filters,
+									set<int> attrs_used,
+									List *quals) {
+	Relation rel = table_open(relid, NoLock);
+	TupleDesc desc = CreateTupleDescCopy(RelationGetDescr(rel));
+	table_close(rel, NoLock);
+	table_slot = MakeSingleTupleTableSlot(desc, &TTSOpsVirtual);
+	table_scan.reset(createPixelsFdwExecutionState(files, filters, attrs_used, desc));
+
+	set<int> qual_attnums;
+	ListCell *lc;
+	foreach (lc, pull_var_clause((Node *) quals, PVC_RECURSE_PLACEHOLDERS)) {
+		qual_attnums.insert(((Var *) lfirst(lc))->varattno - 1);
+	}
+	table_scan->LimitConversion(qual_attnums);
+	if (quals != NIL) {
+		qual = ExecInitQual(quals, NULL);
+		qual_cxt = CreateExprContext(node->ss.ps.state);
+		qual_cxt->ecxt_scantuple = table_slot;
+	}
+
+	vector<shared_ptr<TypeDescription>> column_types;
+	for (int i = 0; i < desc->natts; i++) {
+		column_types.emplace_back(table_scan->GetColumnType(i));
+	}
+	vector<PixelsGroupKey> keys;
+	foreach (lc, scan_tlist) {
+		Expr *expr = ((TargetEntry *) lfirst(lc))->expr;
+		PixelsAggregateState state;
+		Expr *arg;
+
+		if (IsA(expr, Var)) {
+			tlist_keys.emplace_back(keys.size());
+			tlist_aggregates.emplace_back(-1);
+			keys.emplace_back(PixelsGroupKey{((Var *) expr)->varattno - 1, ((Var *) expr)->vartype});
+			continue;
+		}
+		if (!IsA(expr, Aggref) || !pixels_aggregate_kind((Aggref *) expr, &state.kind, &arg)) {
+			elog(ERROR, "pixels_fdw: unexpected entry in the scan tuple of an aggregation");
+		}
+		state.result_type = ((Aggref *) expr)->aggtype;
+		if (arg) {
+			state.arg = pixels_compile_aggregate_arg(arg);
+			if (!state.arg || !pixels_bind_aggregate_arg(*state.arg, column_types)) {
+				elog(ERROR, "pixels_fdw: the columns of the files do not fit the aggregates, plan the query again");
+			}
+		}
+		tlist_keys.emplace_back(-1);
+		tlist_aggregates.emplace_back(aggregates.size());
+		aggregates.emplace_back(std::move(state));
+	}
+	if (!keys.empty()) {
+		group_table = std::make_unique<PixelsGroupTable>(keys, *table_scan);
+	} else {
+		/* an aggregation without groups returns one row even for no rows */
+		group_count = 1;
+		ResizeAggregates(group_count);
+	}
+	result_cxt = AllocSetContextCreate(CurrentMemoryContext,
+									   "pixels_fdw aggregate results",
+									   ALLOCSET_SMALL_SIZES);
+	row_cxt = AllocSetContextCreate(CurrentMemoryContext,
+									"pixels_fdw aggregate row",
+									ALLOCSET_SMALL_SIZES);
+}
+
+static __int128
+PixelsPowerOfTen(int exponent) {
+	__int128 result = 1;
+	while (exponent-- > 0) {
+		result *= 10;
+	}
+	return result;
+}
+
+template <class T>
+static void
+PixelsLoadValues(const void *data, const uint32_t *rows, uint64_t count, __int128 *values) {
+	const T *typed = (const T *) data;
+	if (rows) {
+		for (uint64_t i = 0; i < count; i++) {
+			values[i] = typed[rows[i]];
+		}
+	} else {
+		for (uint64_t i = 0; i < count; i++) {
+			values[i] = typed[i];
+		}
+	}
+}
+
+/*
+ * Computes the argument for `count` rows of the batch, taking the rows
+ * listed in `rows` or the first `count` rows if it is null. Returns whether
+ * any of the values is null; columns that are only counted get no values.
+ */
+static bool
+PixelsEvalArg(const PixelsAggregateArg &arg,
+			  PixelsFdwExecutionState &scan,
+			  const uint32_t *rows,
+			  uint64_t count,
+			  __int128 *values,
+			  uint8_t *nulls) {
+	switch (arg.op) {
+		case PIXELS_ARG_CONST:
+			std::fill(values, values + count, arg.value);
+			memset(nulls, 0, count);
+			return false;
+		case PIXELS_ARG_COLUMN: {
+			auto column = scan.GetColumnVector(arg.attnum);
+			auto type = scan.GetColumnType(arg.attnum);
+			switch (type->getCategory()) {
+				case TypeDescription::SHORT:
+				case TypeDescription::INT:
+					PixelsLoadValues<int>(std::static_pointer_cast<LongColumnVector>(column)->intVector,
+										  rows, count, values);
+					break;
+				case TypeDescription::LONG:
+					PixelsLoadValues<long>(std::static_pointer_cast<LongColumnVector>(column)->longVector,
+										   rows, count, values);
+					break;
+				case TypeDescription::DATE:
+					PixelsLoadValues<int>(std::static_pointer_cast<DateColumnVector>(column)->dates,
+										  rows, count, values);
+					break;
+				case TypeDescription::TIMESTAMP:
+					PixelsLoadValues<long>(std::static_pointer_cast<TimestampColumnVector>(column)->times,
+										   rows, count, values);
+					break;
+				case TypeDescription::DECIMAL:
+					PixelsLoadValues<long>(std::static_pointer_cast<DecimalColumnVector>(column)->vector,
+										   rows, count, values);
+					break;
+				default:
+					break;
+			}
+			if (column->noNulls) {
+				memset(nulls, 0, count);
+				return false;
+			}
+			bool has_nulls = false;
+			for (uint64_t i = 0; i < count; i++) {
+				nulls[i] = column->isNull[rows ? rows[i] : i] != 0;
+				has_nulls |= nulls[i];
+			}
+			return has_nulls;
+		}
+		default: {
+			vector<__int128> right_values(count);
+			vector<uint8_t> right_nulls(count);
+			bool has_nulls = PixelsEvalArg(*arg.left, scan, rows, count, values, nulls);
+			if (PixelsEvalArg(*arg.right, scan, rows, count, right_values.data(), right_nulls.data())) {
+				for (uint64_t i = 0; i < count; i++) {
+					nulls[i] |= right_nulls[i];
+				}
+				has_nulls = true;
+			}
+			if (arg.op == PIXELS_ARG_MUL) {
+				for (uint64_t i = 0; i < count; i++) {
+					values[i] *= right_values[i];
+				}
+				return has_nulls;
+			}
+			/* both sides are brought to the scale of the result */
+			__int128 left_factor = PixelsPowerOfTen(arg.scale - arg.left->scale);
+			__int128 right_factor = PixelsPowerOfTen(arg.scale - arg.right->scale);
+			if (arg.op == PIXELS_ARG_SUB) {
+				right_factor = -right_factor;
+			}
+			for (uint64_t i = 0; i < count; i++) {
+				values[i] = values[i] * left_factor + right_values[i] * right_factor;
+			}
+			return has_nulls;
+		}
+	}
+}
+
+/*
+ * Folds the rows into the states of their groups. Without a group table
+ * every row belongs to the one group, and the loops are instantiated
+ * without the group lookup.
+ */
+template <bool GROUPED>
+static void
+PixelsAccumulate(PixelsAggregateState &state,
+				 const __int128 *values,
+				 const uint8_t *nulls,
+				 bool has_nulls,
+				 uint64_t count,
+				 const uint32_t *groups) {
+	int64 *counts = state.counts.data();
+	switch (state.kind) {
+		case PIXELS_AGG_COUNT_STAR:
+			if (!GROUPED) {
+				counts[0] += count;
+				break;
+			}
+			for (uint64_t i = 0; i < count; i++) {
+				counts[groups[i]]++;
+			}
+			break;
+		case PIXELS_AGG_COUNT:
+			for (uint64_t i = 0; i < count; i++) {
+				counts[GROUPED ? groups[i] : 0] += !(has_nulls && nulls[i]);
+			}
+			break;
+		case PIXELS_AGG_SUM:
+		case PIXELS_AGG_AVG: {
+			__int128 *sums = state.sums.data();
+			for (uint64_t i = 0; i < count; i++) {
+				if (has_nulls && nulls[i]) {
+					continue;
+				}
+				uint32_t group = GROUPED ? groups[i] : 0;
+				__int128 sum;
+				/* the sum moves into a NUMERIC before it would overflow */
+				if (__builtin_add_overflow(sums[group], values[i], &sum)) {
+					Datum addend = PixelsMakeNumericDatum(sums[group], state.arg->scale);
+					Datum &overflow = state.sum_overflows[group];
+					overflow = overflow == (Datum) 0 ? addend :
+						DirectFunctionCall2(numeric_add, overflow, addend);
+					sum = values[i];
+				}
+				sums[group] = sum;
+				counts[group]++;
+			}
+			break;
+		}
+		case PIXELS_AGG_MIN:
+		case PIXELS_AGG_MAX: {
+			__int128 *bounds = state.bounds.data();
+			bool is_min = state.kind == PIXELS_AGG_MIN;
+			for (uint64_t i = 0; i < count; i++) {
+				if (has_nulls && nulls[i]) {
+					continue;
+				}
+				uint32_t group = GROUPED ? groups[i] : 0;
+				if (counts[group]++ == 0 ||
+					(is_min ? values[i] < bounds[group] : values[i] > bounds[group])) {
+					bounds[group] = values[i];
+				}
+			}
+			break;
+		}
+	}
+}
+
+void
+PixelsFdwUpperState::AggregateBatch(PixelsAggregateState &state,
+									const uint32_t *rows,
+									uint64_t count,
+									const uint32_t *groups) {
+	bool has_nulls = false;
+	if (state.arg) {
+		has_nulls = PixelsEvalArg(*state.arg, *table_scan, rows, count,
+								  arg_values.data(), arg_nulls.data());
+	}
+	if (groups) {
+		PixelsAccumulate<true>(state, arg_values.data(), arg_nulls.data(), has_nulls, count, groups);
+	} else {
+		PixelsAccumulate<false>(state, arg_values.data(), arg_nulls.data(), has_nulls, count, groups);
+	}
+}
+
+void
+PixelsFdwUpperState::ResizeAggregates(uint32_t group_count) {
+	for (auto &state : aggregates) {
+		state.counts.resize(group_count, 0);
+		if (state.kind == PIXELS_AGG_SUM || state.kind == PIXELS_AGG_AVG) {
+			state.sums.resize(group_count, 0);
+			state.sum_overflows.resize(group_count, (Datum) 0);
+		} else if (state.kind == PIXELS_AGG_MIN || state.kind == PIXELS_AGG_MAX) {
+			state.bounds.resize(group_count, 0);
+		}
+	}
+}
+
+/*
+ * The results are what the Postgres aggregates would return: sum of int2
+ * and int4 is an int8, every other sum and average a NUMERIC, and averages
+ * are divided by numeric_div just as int8_avg and numeric_avg do.
+ */
+Datum
+PixelsFdwUpperState::FinalizeAggregate(PixelsAggregateState &state, uint32_t group, bool *isnull) {
+	int64 count = state.counts[group];
+	*isnull = false;
+	if (state.kind == PIXELS_AGG_COUNT_STAR || state.kind == PIXELS_AGG_COUNT) {
+		return Int64GetDatum(count);
+	}
+	if (count == 0) {
+		*isnull = true;
+		return (Datum) 0;
+	}
+	if (state.kind == PIXELS_AGG_MIN || state.kind == PIXELS_AGG_MAX) {
+		if (state.arg->type == NUMERICOID) {
+			return PixelsMakeNumericDatum(state.bounds[group], state.arg->scale);
+		}
+		return pixels_statistic_datum(state.arg->type, (int64_t) state.bounds[group]);
+	}
+	__int128 sum_value = state.sums[group];
+	Datum overflow = state.sum_overflows[group];
+	if (state.kind == PIXELS_AGG_SUM && state.result_type == INT8OID) {
+		if (overflow != (Datum) 0 || sum_value > PG_INT64_MAX || sum_value < PG_INT64_MIN) {
+			ereport(ERROR,
+					(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+					 errmsg("bigint out of range")));
+		}
+		return Int64GetDatum((int64) sum_value);
+	}
+	Datum sum = PixelsMakeNumericDatum(sum_value, state.arg->scale);
+	if (overflow != (Datum) 0) {
+		sum = DirectFunctionCall2(numeric_add, overflow, sum);
+	}
+	if (state.kind == PIXELS_AGG_SUM) {
+		return sum;
+	}
+	return DirectFunctionCall2(numeric_div, sum, NumericGetDatum(int64_to_numeric(count)));
+}
+
+void
+PixelsFdwUpperState::ComputeAggregates() {
+	MemoryContext oldcxt = MemoryContextSwitchTo(result_cxt);
+	while (table_scan->NextBatch()) {
+		CHECK_FOR_INTERRUPTS();
+		const uint32_t *rows = table_scan->GetSelection();
+		uint64_t count = table_scan->GetSelectionCount();
+		if (qual) {
+			ResetExprContext(qual_cxt);
+			passed.clear();
+			for (uint64_t i = 0; i < count; i++) {
+				ExecClearTuple(table_slot);
+				table_scan->FillSlot(table_slot, i);
+				if (ExecQual(qual, qual_cxt)) {
+					passed.emplace_back(rows ? rows[i] : i);
+				}
+			}
+			rows = passed.data();
+			count = passed.size();
+			if (count == 0) {
+				continue;
+			}
+		}
+		if (arg_values.size() < count) {
+			arg_values.resize(count);
+			arg_nulls.resize(count);
+			groups.resize(count);
+		}
+		if (group_table) {
+			group_table->FindGroups(rows, count, groups.data());
+			if (group_table->GroupCount() > group_count) {
+				group_count = group_table->GroupCount();
+				ResizeAggregates(group_count);
+			}
+		}
+		for (auto &state : aggregates) {
+			AggregateBatch(state, rows, count, group_table ? groups.data() : nullptr);
+		}
+	}
+	MemoryContextSwitchTo(oldcxt);
+}
+
+/*
+ * The scan tuple of a limited scan holds columns of the table, read with
+ * the restriction columns into a row of the table.
+ */
+void
+PixelsFdwUpperState::InitLimit(ForeignScanState *node,
+							   List *files,
+							   List *filters,
+							   set<int> attrs_used,
+							   List *upper) {
+	List *quals = (List *) lthird(upper);
+	Relation rel = table_open(relid, NoLock);
+	TupleDesc desc = CreateTupleDescCopy(RelationGetDescr(rel));
+	table_close(rel, NoLock);
+	table_slot = MakeSingleTupleTableSlot(desc, &TTSOpsVirtual);
+	table_scan.reset(createPixelsFdwExecutionState(files, filters, attrs_used, desc));
+	if (quals != NIL) {
+		qual = ExecInitQual(quals, NULL);
+		qual_cxt = CreateExprContext(node->ss.ps.state);
+		qual_cxt->ecxt_scantuple = table_slot;
+	}
+	if (lfourth(upper)) {
+		limit_count = ExecInitExpr((Expr *) lfourth(upper), &node->ss.ps);
+	}
+	if (list_nth(upper, 4)) {
+		limit_offset = ExecInitExpr((Expr *) list_nth(upper, 4), &node->ss.ps);
+	}
+	limit_cxt = node->ss.ps.ps_ExprContext;
+	/* a filter or qual may drop any row, so the limit bounds no row group */
+	exact_limit = quals == NIL && filters == NIL;
+}
+
+/* same checks as ExecLimit() */
+void
+PixelsFdwUpperState::ComputeLimit() {
+	bool isnull;
+
+	count = -1;
+	offset = 0;
+	returned = 0;
+	skipped = 0;
+	if (limit_offset) {
+		Datum value = ExecEvalExprSwitchContext(limit_offset, limit_cxt, &isnull);
+		if (!isnull) {
+			offset = DatumGetInt64(value);
+			if (offset < 0) {
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_ROW_COUNT_IN_RESULT_OFFSET_CLAUSE),
+						 errmsg("OFFSET must not be negative")));
+			}
+		}
+	}
+	if (limit_count) {
+		Datum value = ExecEvalExprSwitchContext(limit_count, limit_cxt, &isnull);
+		if (!isnull) {
+			count = DatumGetInt64(value);
+			if (count < 0) {
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_ROW_COUNT_IN_LIMIT_CLAUSE),
+						 errmsg("LIMIT must not be negative")));
+			}
+		}
+	}
+	/*
+	 * a top-N scan reads every row group that may beat its threshold, so its
+	 * bound limits no morsel; it is read like an unlimited scan
+	 */
+	if (kind == PIXELS_UPPER_TOPN || count < 0) {
+		table_scan->SetRowLimit(0, false);
+	} else {
+		table_scan->SetRowLimit((uint64_t) offset + count, exact_limit);
+	}
+}
+
+bool
+PixelsFdwUpperState::NextLimited(TupleTableSlot *slot) {
+	while (count < 0 || returned < count) {
+		ExecClearTuple(table_slot);
+		if (!table_scan->next(table_slot)) {
+			return false;
+		}
+		if (qual) {
+			ResetExprContext(qual_cxt);
+			if (!ExecQual(qual, qual_cxt)) {
+				continue;
+			}
+		}
+		if (skipped < offset) {
+			skipped++;
+			continue;
+		}
+		returned++;
+		ProjectTableRow(table_slot, slot);
+		return true;
+	}
+	return false;
+}
+
+/* stores the columns of the scan tuple, taken from a row of the table */
+void
+PixelsFdwUpperState::ProjectTableRow(TupleTableSlot *from, TupleTableSlot *slot) {
+	int i = 0;
+	ListCell *lc;
+	slot_getallattrs(from);
+	foreach (lc, scan_tlist) {
+		AttrNumber attnum = ((Var *) ((TargetEntry *) lfirst(lc))->expr)->varattno;
+		slot->tts_values[i] = from->tts_values[attnum - 1];
+		slot->tts_isnull[i] = from->tts_isnull[attnum - 1];
+		i++;
+	}
+	ExecStoreVirtualTuple(slot);
+}
+
+/*
+ * A top-N scan reads its rows as a limited scan does, and keeps the best
+ * LIMIT plus OFFSET of them in a heap. Only the sort keys and the columns
+ * of the quals are read for every row, straight from the column vectors;
+ * the other columns are converted for the rows that get into the heap.
+ * The row groups are visited best first by the statistics of the first
+ * sort key, so that once the heap is full the scan ends at the first row
+ * group that cannot hold a better row.
+ */
+void
+PixelsFdwUpperState::InitTopN(ForeignScanState *node,
+							  List *files,
+							  List *filters,
+							  set<int> attrs_used,
+							  List *upper) {
+	InitLimit(node, files, filters, attrs_used, upper);
+	/* every row group may hold a better row than those read first */
+	exact_limit = false;
+
+	set<int> qual_attnums;
+	ListCell *lc;
+	foreach (lc, pull_var_clause((Node *) lthird(upper), PVC_RECURSE_PLACEHOLDERS)) {
+		qual_attnums.insert(((Var *) lfirst(lc))->varattno - 1);
+	}
+	table_scan->LimitConversion(qual_attnums);
+	foreach (lc, (List *) list_nth(upper, 5)) {
+		List *key = (List *) lfirst(lc);
+		int attnum = linitial_int(key) - 1;
+		auto type = table_scan->GetColumnType(attnum);
+		if (!type) {
+			throw PixelsReaderException("sort column is not in the pixels file");
+		}
+		switch (type->getCategory()) {
+			case TypeDescription::SHORT:
+			case TypeDescription::INT:
+			case TypeDescription::LONG:
+			case TypeDescription::DATE:
+			case TypeDescription::TIMESTAMP:
+				break;
+			default:
+				throw PixelsReaderException("pixels_fdw cannot sort by this column type");
+		}
+		sort_keys.emplace_back(PixelsSortKey{attnum, lsecond_int(key) != 0, lthird_int(key) != 0});
+	}
+	key_values.resize(sort_keys.size());
+	key_nulls.resize(sort_keys.size());
+	table_scan->OrderRowGroups(sort_keys[0].attnum, sort_keys[0].descending, sort_keys[0].nulls_first);
+	top_slot = MakeSingleTupleTableSlot(table_slot->tts_tupleDescriptor, &TTSOpsMinimalTuple);
+	result_cxt = AllocSetContextCreate(CurrentMemoryContext,
+									   "pixels_fdw top-n rows",
+									   ALLOCSET_DEFAULT_SIZES);
+}
+
+/* whether the row of the batch sorts before the kept row */
+bool
+PixelsFdwUpperState::RowBefore(uint64_t row, const PixelsTopNRow &kept) {
+	for (size_t k = 0; k < sort_keys.size(); k++) {
+		bool isnull = key_nulls[k][row];
+		if (isnull || kept.nulls[k]) {
+			if (isnull == (bool) kept.nulls[k]) {
+				continue;
+			}
+			return isnull == sort_keys[k].nulls_first;
+		}
+		int64_t value = key_values[k][row];
+		if (value != kept.keys[k]) {
+			return sort_keys[k].descending ? value > kept.keys[k] : value < kept.keys[k];
+		}
+	}
+	return false;
+}
+
+bool
+PixelsFdwUpperState::KeptBefore(const PixelsTopNRow &a, const PixelsTopNRow &b) {
+	for (size_t k = 0; k < sort_keys.size(); k++) {
+		if (a.nulls[k] || b.nulls[k]) {
+			if (a.nulls[k] == b.nulls[k]) {
+				continue;
+			}
+			return (bool) a.nulls[k] == sort_keys[k].nulls_first;
+		}
+		if (a.keys[k] != b.keys[k]) {
+			return sort_keys[k].descending ? a.keys[k] > b.keys[k] : a.keys[k] < b.keys[k];
+		}
+	}
+	return false;
+}
+
+/*
+ * Takes `count` rows of the batch that passed the quals, by their index in
+ * the batch and their position in the selection. The rows are first checked
+ * against the last kept row, which is cheap; those that may get in have
+ * their other columns converted and are pushed into the heap one by one.
+ */
+void
+PixelsFdwUpperState::TopNBatch(const uint32_t *rows, const uint32_t *positions, uint64_t count) {
+	auto heap_before = [this](const PixelsTopNRow &a, const PixelsTopNRow &b) {
+		return KeptBefore(a, b);
+	};
+
+	if (top_sort) {
+		candidate_rows.clear();
+		for (uint64_t i = 0; i < count; i++) {
+			candidate_rows.emplace_back(rows ? rows[i] : i);
+		}
+		table_scan->ConvertDeferred(candidate_rows.data(), candidate_rows.size());
+		for (uint64_t i = 0; i < count; i++) {
+			ExecClearTuple(table_slot);
+			table_scan->FillDeferred(table_slot, i);
+			table_scan->FillSlot(table_slot, positions ? positions[i] : i);
+			tuplesort_puttupleslot(top_sort, table_slot);
+		}
+		return;
+	}
+	for (size_t k = 0; k < sort_keys.size(); k++) {
+		key_values[k].resize(count);
+		key_nulls[k].resize(count);
+		PixelsLoadIntegerKeys(table_scan->GetColumnVector(sort_keys[k].attnum),
+							  table_scan->GetColumnType(sort_keys[k].attnum)->getCategory(),
+							  rows, count, key_values[k].data(), key_nulls[k].data());
+	}
+	candidates.clear();
+	candidate_rows.clear();
+	for (uint64_t i = 0; i < count; i++) {
+		if (top_rows.size() < top_bound || RowBefore(i, top_rows.front())) {
+			candidates.emplace_back(i);
+			candidate_rows.emplace_back(rows ? rows[i] : i);
+		}
+	}
+	if (candidates.empty()) {
+		return;
+	}
+
+	table_scan->ConvertDeferred(candidate_rows.data(), candidate_rows.size());
+	MemoryContext oldcxt = MemoryContextSwitchTo(result_cxt);
+	for (size_t c = 0; c < candidates.size(); c++) {
+		uint32_t i = candidates[c];
+		bool full = top_rows.size() >= top_bound;
+		if (full && !RowBefore(i, top_rows.front())) {
+			continue;
+		}
+		PixelsTopNRow row;
+		for (size_t k = 0; k < sort_keys.size(); k++) {
+			row.keys.emplace_back(key_values[k][i]);
+			row.nulls.emplace_back(key_nulls[k][i]);
+		}
+		ExecClearTuple(table_slot);
+		table_scan->FillDeferred(table_slot, c);
+		table_scan->FillSlot(table_slot, positions ? positions[i] : i);
+		row.tuple = ExecCopySlotMinimalTuple(table_slot);
+		if (full) {
+			std::pop_heap(top_rows.begin(), top_rows.end(), heap_before);
+			pfree(top_rows.back().tuple);
+			top_rows.back() = std::move(row);
+		} else {
+			top_rows.emplace_back(std::move(row));
+		}
+		std::push_heap(top_rows.begin(), top_rows.end(), heap_before);
+	}
+	MemoryContextSwitchTo(oldcxt);
+
+	const PixelsTopNRow &last = top_rows.front();
+	if (top_rows.size() >= top_bound && !last.nulls[0]) {
+		table_scan->SetSortThreshold(last.keys[0]);
+	}
+	if (MemoryContextMemAllocated(result_cxt, true) > (Size) work_mem * 1024L) {
+		TopNToSort();
+	}
+}
+
+/*
+ * Hands the rows kept so far to a tuplesort, which takes the rows of the
+ * next batches and spills them to disk past work_mem, as a Sort above the
+ * scan would. The sort threshold already set still holds, since the rows
+ * it stops the scan for could not get into the heap.
+ */
+void
+PixelsFdwUpperState::TopNToSort() {
+	TupleDesc desc = table_slot->tts_tupleDescriptor;
+	int nkeys = sort_keys.size();
+	AttrNumber *attnums = (AttrNumber *) palloc(nkeys * sizeof(AttrNumber));
+	Oid *operators = (Oid *) palloc(nkeys * sizeof(Oid));
+	Oid *collations = (Oid *) palloc(nkeys * sizeof(Oid));
+	bool *nulls_first = (bool *) palloc(nkeys * sizeof(bool));
+
+	for (int k = 0; k < nkeys; k++) {
+		Form_pg_attribute attr = TupleDescAttr(desc, sort_keys[k].attnum);
+		TypeCacheEntry *typentry = lookup_type_cache(attr->atttypid,
+													 TYPECACHE_LT_OPR | TYPECACHE_GT_OPR);
+		attnums[k] = sort_keys[k].attnum + 1;
+		operators[k] = sort_keys[k].descending ? typentry->gt_opr : typentry->lt_opr;
+		collations[k] = attr->attcollation;
+		nulls_first[k] = sort_keys[k].nulls_first;
+	}
+	/* the sort outlives the rows of the heap, which are freed below */
+	MemoryContext oldcxt = MemoryContextSwitchTo(MemoryContextGetParent(result_cxt));
+	top_sort = tuplesort_begin_heap(desc, nkeys, attnums, operators, collations, nulls_first,
+									work_mem, NULL, TUPLESORT_NONE);
+	if (top_bound <= (uint64_t) PG_INT64_MAX) {
+		tuplesort_set_bound(top_sort, (int64) top_bound);
+	}
+	MemoryContextSwitchTo(oldcxt);
+	for (auto &row : top_rows) {
+		ExecStoreMinimalTuple(row.tuple, top_slot, false);
+		tuplesort_puttupleslot(top_sort, top_slot);
+	}
+	ExecClearTuple(top_slot);
+	top_rows.clear();
+	MemoryContextReset(result_cxt);
+}
+
+void
+PixelsFdwUpperState::ComputeTopN() {
+	auto heap_before = [this](const PixelsTopNRow &a, const PixelsTopNRow &b) {
+		return KeptBefore(a, b);
+	};
+
+	ComputeLimit();
+	/* LIMIT NULL keeps every row, too many for the heap */
+	top_bound = count < 0 ? UINT64_MAX : (uint64_t) offset + count;
+	if (top_bound == 0) {
+		return;
+	}
+	if (top_bound == UINT64_MAX) {
+		TopNToSort();
+	}
+	while (table_scan->NextBatch()) {
+		CHECK_FOR_INTERRUPTS();
+		const uint32_t *rows = table_scan->GetSelection();
+		uint64_t row_count = table_scan->GetSelectionCount();
+		const uint32_t *batch_positions = nullptr;
+		if (qual) {
+			ResetExprContext(qual_cxt);
+			passed.clear();
+			positions.clear();
+			for (uint64_t i = 0; i < row_count; i++) {
+				ExecClearTuple(table_slot);
+				table_scan->FillSlot(table_slot, i);
+				if (ExecQual(qual, qual_cxt)) {
+					passed.emplace_back(rows ? rows[i] : i);
+					positions.emplace_back(i);
+				}
+			}
+			rows = passed.data();
+			row_count = passed.size();
+			batch_positions = positions.data();
+			if (row_count == 0) {
+				continue;
+			}
+		}
+		TopNBatch(rows, batch_positions, row_count);
+	}
+	if (top_sort) {
+		tuplesort_performsort(top_sort);
+		tuplesort_skiptuples(top_sort, offset, true);
+		return;
+	}
+	std::sort_heap(top_rows.begin(), top_rows.end(), heap_before);
+	next_row = offset;
+}
+
+/* the kind of values a join key holds, -1 for those the table cannot take */
+static int
+PixelsJoinKeyClass(const std::shared_ptr<TypeDescription> &type) {
+	switch (type->getCategory()) {
+		case TypeDescription::SHORT:
+		case TypeDescription::INT:
+		case TypeDescription::LONG:
+			return 0;
+		case TypeDescription::DATE:
+			return 1;
+		case TypeDescription::TIMESTAMP:
+			return 2;
+		case TypeDescription::VARCHAR:
+		case TypeDescription::CHAR:
+			return 3;
+		default:
+			return -1;
+	}
+}
+
+/*
+ * A join reads the built table as an aggregation does, its join columns
+ * being the grouping columns, and keeps every row that passed its quals.
+ * The probed table is read batch by batch: only the columns of its quals
+ * are converted for every row, its join columns are looked up straight from
+ * the column vectors, and the other columns are converted for the rows
+ * whose keys are in the table.
+ */
+void
+PixelsFdwUpperState::InitJoin(ForeignScanState *node,
+							  List *files,
+							  List *filters,
+							  set<int> attrs_used,
+							  List *upper) {
+	List *build_quals = (List *) lthird(upper);
+	List *probe_quals = (List *) lfourth(upper);
+	List *probe = (List *) list_nth(upper, 4);
+	ListCell *lc;
+	ListCell *lc2;
+
+	Relation rel = table_open(relid, NoLock);
+	TupleDesc desc = CreateTupleDescCopy(RelationGetDescr(rel));
+	table_close(rel, NoLock);
+	table_slot = MakeSingleTupleTableSlot(desc, &TTSOpsVirtual);
+	top_slot = MakeSingleTupleTableSlot(desc, &TTSOpsMinimalTuple);
+	table_scan.reset(createPixelsFdwExecutionState(files, filters, attrs_used, desc));
+	if (build_quals != NIL) {
+		qual = ExecInitQual(build_quals, NULL);
+		qual_cxt = CreateExprContext(node->ss.ps.state);
+		qual_cxt->ecxt_scantuple = table_slot;
+	}
+
+	rel = table_open(lsecond_oid((List *) lsecond(upper)), NoLock);
+	desc = CreateTupleDescCopy(RelationGetDescr(rel));
+	table_close(rel, NoLock);
+	probe_slot = MakeSingleTupleTableSlot(desc, &TTSOpsVirtual);
+	List *probe_filters = NIL;
+	foreach (lc, (List *) lsecond(probe)) {
+		PixelsFilter *filter = pixels_deserialize_filter((List *) lfirst(lc), NULL, NULL);
+		if (filter) {
+			probe_filters = lappend(probe_filters, filter);
+		}
+	}
+	set<int> probe_attrs_used;
+	foreach (lc, (List *) lthird(probe)) {
+		probe_attrs_used.insert(lfirst_int(lc));
+	}
+	probe_scan.reset(createPixelsFdwExecutionState((List *) linitial(probe), probe_filters,
+												   probe_attrs_used, desc));
+	set<int> qual_attnums;
+	foreach (lc, pull_var_clause((Node *) probe_quals, PVC_RECURSE_PLACEHOLDERS)) {
+		qual_attnums.insert(((Var *) lfirst(lc))->varattno - 1);
+	}
+	probe_scan->LimitConversion(qual_attnums);
+	if (probe_quals != NIL) {
+		probe_qual = ExecInitQual(probe_quals, NULL);
+		probe_qual_cxt = CreateExprContext(node->ss.ps.state);
+		probe_qual_cxt->ecxt_scantuple = probe_slot;
+	}
+
+	vector<PixelsGroupKey> keys;
+	forboth (lc, (List *) list_nth(upper, 5), lc2, (List *) list_nth(upper, 6)) {
+		int build_attnum = lfirst_int(lc) - 1;
+		int probe_attnum = lfirst_int(lc2) - 1;
+		auto build_type = table_scan->GetColumnType(build_attnum);
+		auto probe_type = probe_scan->GetColumnType(probe_attnum);
+		if (!build_type || !probe_type) {
+			throw PixelsReaderException("join column is not in the pixels file");
+		}
+		if (PixelsJoinKeyClass(build_type) < 0 ||
+			PixelsJoinKeyClass(build_type) != PixelsJoinKeyClass(probe_type)) {
+			throw PixelsReaderException("pixels_fdw cannot join on these column types");
+		}
+		keys.emplace_back(PixelsGroupKey{build_attnum, TupleDescAttr(table_slot->tts_tupleDescriptor,
+																	 build_attnum)->atttypid});
+		probe_keys.emplace_back(probe_attnum);
+	}
+	group_table = std::make_unique<PixelsGroupTable>(keys, *table_scan);
+	forboth (lc, (List *) list_nth(upper, 7), lc2, (List *) list_nth(upper, 8)) {
+		tlist_sides.emplace_back(lfirst_int(lc));
+		tlist_attnums.emplace_back(lfirst_int(lc2) - 1);
+	}
+	result_cxt = AllocSetContextCreate(CurrentMemoryContext,
+									   "pixels_fdw join rows",
+									   ALLOCSET_DEFAULT_SIZES);
+}
+
+/*
+ * Reads the built table into the group table, chaining the rows of every
+ * group, before the first row is joined.
+ */
+void
+PixelsFdwUpperState::ComputeJoinTable() {
+	MemoryContext oldcxt = MemoryContextSwitchTo(result_cxt);
+	while (table_scan->NextBatch()) {
+		CHECK_FOR_INTERRUPTS();
+		const uint32_t *rows = table_scan->GetSelection();
+		uint64_t count = table_scan->GetSelectionCount();
+		if (qual) {
+			ResetExprContext(qual_cxt);
+		}
+		passed.clear();
+		for (uint64_t i = 0; i < count; i++) {
+			ExecClearTuple(table_slot);
+			table_scan->FillSlot(table_slot, i);
+			if (qual && !ExecQual(qual, qual_cxt)) {
+				continue;
+			}
+			passed.emplace_back(rows ? rows[i] : i);
+			join_rows.emplace_back(ExecCopySlotMinimalTuple(table_slot));
+		}
+		if (passed.empty()) {
+			continue;
+		}
+		groups.resize(passed.size());
+		group_table->FindGroups(passed.data(), passed.size(), groups.data());
+		group_first.resize(group_table->GroupCount(), UINT32_MAX);
+		uint32_t row = join_rows.size() - passed.size();
+		row_next.resize(join_rows.size());
+		for (size_t i = 0; i < passed.size(); i++, row++) {
+			row_next[row] = group_first[groups[i]];
+			group_first[groups[i]] = row;
+		}
+	}
+	MemoryContextSwitchTo(oldcxt);
+}
+
+/* moves on to the next probe batch with rows to join, false at the end */
+bool
+PixelsFdwUpperState::ProbeBatch() {
+	while (probe_scan->NextBatch()) {
+		CHECK_FOR_INTERRUPTS();
+		const uint32_t *rows = probe_scan->GetSelection();
+		uint64_t count = probe_scan->GetSelectionCount();
+		const uint32_t *batch_positions = nullptr;
+		if (probe_qual) {
+			ResetExprContext(probe_qual_cxt);
+			passed.clear();
+			positions.clear();
+			for (uint64_t i = 0; i < count; i++) {
+				ExecClearTuple(probe_slot);
+				probe_scan->FillSlot(probe_slot, i);
+				if (ExecQual(probe_qual, probe_qual_cxt)) {
+					passed.emplace_back(rows ? rows[i] : i);
+					positions.emplace_back(i);
+				}
+			}
+			rows = passed.data();
+			count = passed.size();
+			batch_positions = positions.data();
+			if (count == 0) {
+				continue;
+			}
+		}
+		groups.resize(count);
+		group_table->LookupGroups(*probe_scan, probe_keys, rows, count, groups.data());
+		match_rows.clear();
+		match_positions.clear();
+		match_groups.clear();
+		for (uint64_t i = 0; i < count; i++) {
+			if (groups[i] != PIXELS_FDW_NO_GROUP) {
+				match_rows.emplace_back(rows ? rows[i] : i);
+				match_positions.emplace_back(batch_positions ? batch_positions[i] : i);
+				match_groups.emplace_back(groups[i]);
+			}
+		}
+		if (match_rows.empty()) {
+			continue;
+		}
+		probe_scan->ConvertDeferred(match_rows.data(), match_rows.size());
+		next_match = 0;
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Returns every pair of a probe row and a row of its group in the built
+ * table, taking the columns of the scan tuple from either.
+ */
+bool
+PixelsFdwUpperState::NextJoined(TupleTableSlot *slot) {
+	while (join_row == UINT32_MAX) {
+		if (next_match >= match_rows.size()) {
+			match_rows.clear();
+			if (!ProbeBatch()) {
+				return false;
+			}
+		}
+		ExecClearTuple(probe_slot);
+		probe_scan->FillDeferred(probe_slot, next_match);
+		probe_scan->FillSlot(probe_slot, match_positions[next_match]);
+		join_row = group_first[match_groups[next_match]];
+		next_match++;
+	}
+	ExecStoreMinimalTuple(join_rows[join_row], top_slot, false);
+	slot_getallattrs(top_slot);
+	for (size_t i = 0; i < tlist_sides.size(); i++) {
+		TupleTableSlot *from = tlist_sides[i] == 0 ? top_slot : probe_slot;
+		slot->tts_values[i] = from->tts_values[tlist_attnums[i]];
+		slot->tts_isnull[i] = from->tts_isnull[tlist_attnums[i]];
+	}
+	join_row = row_next[join_row];
+	ExecStoreVirtualTuple(slot);
+	return true;
+}
+
+/*
+ * Returns the groups one after the other; their keys and results are built
+ * in a context that only has to outlive the row.
+ */
+bool
+PixelsFdwUpperState::next(TupleTableSlot *slot) {
+	if (kind == PIXELS_UPPER_LIMIT) {
+		if (!computed) {
+			ComputeLimit();
+			computed = true;
+		}
+		return NextLimited(slot);
+	}
+	if (kind == PIXELS_UPPER_JOIN) {
+		if (!computed) {
+			ComputeJoinTable();
+			computed = true;
+		}
+		return NextJoined(slot);
+	}
+	if (kind == PIXELS_UPPER_TOPN) {
+		if (!computed) {
+			ComputeTopN();
+			computed = true;
+		}
+		if (top_sort) {
+			/* the bound of the sort leaves LIMIT rows past the OFFSET */
+			if (!tuplesort_gettupleslot(top_sort, true, false, top_slot, NULL)) {
+				return false;
+			}
+			ProjectTableRow(top_slot, slot);
+			return true;
+		}
+		if (next_row >= top_rows.size()) {
+			return false;
+		}
+		ExecStoreMinimalTuple(top_rows[next_row++].tuple, top_slot, false);
+		ProjectTableRow(top_slot, slot);
+		return true;
+	}
+	if (!computed) {
+		ComputeAggregates();
+		computed = true;
+	}
+	if (next_group >= group_count) {
+		return false;
+	}
+	if (kind == PIXELS_UPPER_METADATA) {
+		for (int i = 0; i < values.size(); i++) {
+			slot->tts_values[i] = values[i];
+			slot->tts_isnull[i] = nulls[i];
+		}
+	} else {
+		MemoryContextReset(row_cxt);
+		MemoryContext oldcxt = MemoryContextSwitchTo(row_cxt);
+		for (int i = 0; i < tlist_keys.size(); i++) {
+			if (tlist_keys[i] >= 0) {
+				slot->tts_values[i] = group_table->GetKey(tlist_keys[i], next_group, &slot->tts_isnull[i]);
+			} else {
+				slot->tts_values[i] = FinalizeAggregate(aggregates[tlist_aggregates[i]], next_group,
+														&slot->tts_isnull[i]);
+			}
+		}
+		MemoryContextSwitchTo(oldcxt);
+	}
+	next_group++;
+	ExecStoreVirtualTuple(slot);
+	return true;
+}
+
+void
+PixelsFdwUpperState::rescan() {
+	next_group = 0;
+	if (kind == PIXELS_UPPER_JOIN) {
+		/* the tables are scanned without Params, the built table stays */
+		probe_scan->rescan();
+		ExecClearTuple(probe_slot);
+		ExecClearTuple(top_slot);
+		match_rows.clear();
+		next_match = 0;
+		join_row = UINT32_MAX;
+		return;
+	}
+	if (kind == PIXELS_UPPER_LIMIT || kind == PIXELS_UPPER_TOPN) {
+		/* the limits may depend on Params that changed */
+		table_scan->rescan();
+		if (kind == PIXELS_UPPER_TOPN) {
+			ExecClearTuple(top_slot);
+			top_rows.clear();
+			next_row = 0;
+			MemoryContextReset(result_cxt);
+			if (top_sort) {
+				tuplesort_end(top_sort);
+				top_sort = nullptr;
+			}
+		}
+		computed = false;
+		return;
+	}
+	if (kind != PIXELS_UPPER_AGGREGATE) {
+		return;
+	}
+	table_scan->rescan();
+	for (auto &state : aggregates) {
+		state.counts.clear();
+		state.sums.clear();
+		state.sum_overflows.clear();
+		state.bounds.clear();
+	}
+	if (group_table) {
+		group_table->Reset();
+		group_count = 0;
+	}
+	ResizeAggregates(group_count);
+	MemoryContextReset(result_cxt);
+	computed = false;
+}
+
+PixelsUpperKind
+PixelsFdwUpperState::getKind() {
+	return kind;
+}
+
+PixelsFdwUpperState*
+createPixelsFdwUpperState(ForeignScanState *node,
+						  List *files,
+						  List *filters,
+						  set<int> attrs_used,
+						  List *upper) {
+	return new PixelsFdwUpperState(node, files, filters, attrs_used, upper);
+}
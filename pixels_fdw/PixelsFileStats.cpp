@@ -0,0 +1,168 @@
+//
+// Footer statistics of the pixels files of a table.
+//
+
+#include "PixelsFileStats.hpp"
+#include "physical/StorageFactory.h"
+#include "PixelsReaderBuilder.h"
+#include "PixelsFooterCache.h"
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <list>
+#include <thread>
+#include <unordered_map>
+
+struct PixelsCachedFileStats {
+    std::shared_ptr<const PixelsFileStats> stats;
+    //! Position of the path in pixels_file_stats_lru
+    std::list<std::string>::iterator lru;
+};
+
+/* footers read by this backend, by path, and the paths used last first */
+static std::unordered_map<std::string, PixelsCachedFileStats> pixels_file_stats_cache;
+static std::list<std::string> pixels_file_stats_lru;
+static uint64_t pixels_file_stats_generation = 0;
+
+static void
+PixelsReadFileStats(PixelsFileStats &stats, std::shared_ptr<::Storage> storage) {
+    auto footerCache = std::make_shared<PixelsFooterCache>();
+    auto builder = std::make_shared<PixelsReaderBuilder>();
+    std::shared_ptr<PixelsReader> reader = builder->setPath(stats.path)
+                                                  ->setStorage(storage)
+                                                  ->setPixelsFooterCache(footerCache)
+                                                  ->build();
+    stats.row_count = reader->getNumberOfRows();
+    stats.schema = reader->getFileSchema();
+    stats.footer = reader->getFooter();
+    stats.data_bytes = 0;
+    for (int rg_id = 0; rg_id < stats.footer.rowgroupinfos_size(); rg_id++) {
+        stats.data_bytes += stats.footer.rowgroupinfos(rg_id).datalength();
+    }
+
+    /* one row group footer is taken as representative of the whole file */
+    size_t column_num = stats.schema->getChildren().size();
+    stats.column_bytes.assign(column_num, column_num > 0 ? stats.data_bytes / column_num : 0);
+    if (stats.footer.rowgroupinfos_size() > 0 && column_num > 0) {
+        auto rg_footer = reader->getRowGroupFooter(0);
+        const auto &rg_index = rg_footer.rowgroupindexentry();
+        if (rg_index.columnchunkindexentries_size() == column_num) {
+            uint64_t rg_bytes = 0;
+            for (int i = 0; i < column_num; i++) {
+                rg_bytes += rg_index.columnchunkindexentries(i).chunklength();
+            }
+            for (int i = 0; i < column_num && rg_bytes > 0; i++) {
+                stats.column_bytes[i] = (uint64_t) ((double) stats.data_bytes *
+                                                    rg_index.columnchunkindexentries(i).chunklength() / rg_bytes);
+            }
+        }
+    }
+    reader->close();
+}
+
+static void
+PixelsForgetFileStats(std::unordered_map<std::string, PixelsCachedFileStats>::iterator it) {
+    pixels_file_stats_lru.erase(it->second.lru);
+    pixels_file_stats_cache.erase(it);
+}
+
+static void
+PixelsRememberFileStats(const std::shared_ptr<const PixelsFileStats> &stats) {
+    auto it = pixels_file_stats_cache.find(stats->path);
+    if (it != pixels_file_stats_cache.end()) {
+        PixelsForgetFileStats(it);
+    }
+    pixels_file_stats_lru.push_front(stats->path);
+    pixels_file_stats_cache[stats->path] = PixelsCachedFileStats{stats, pixels_file_stats_lru.begin()};
+}
+
+/*
+ * Drops the footers used last longest ago, but none of the `kept` ones in
+ * front of the list: a table walked in the same order every time would
+ * otherwise evict each of its files just before it is needed again.
+ */
+static void
+PixelsTrimFileStats(size_t kept) {
+    size_t limit = std::max<size_t>(pixels_file_stats_cache_size, kept);
+    while (pixels_file_stats_cache.size() > limit) {
+        PixelsForgetFileStats(pixels_file_stats_cache.find(pixels_file_stats_lru.back()));
+    }
+}
+
+std::vector<std::shared_ptr<const PixelsFileStats>>
+PixelsLoadFileStats(const std::vector<std::string> &files) {
+    std::vector<std::shared_ptr<const PixelsFileStats>> result(files.size());
+    std::vector<std::shared_ptr<PixelsFileStats>> missing;
+    std::vector<size_t> missing_index;
+
+    /* a cached footer is used as long as the file has not changed since */
+    for (size_t i = 0; i < files.size(); i++) {
+        struct stat st;
+        bool has_stat = stat(files[i].c_str(), &st) == 0;
+        auto it = pixels_file_stats_cache.find(files[i]);
+        if (it != pixels_file_stats_cache.end()) {
+            const auto &cached = it->second.stats;
+            if (has_stat && cached->mtime == st.st_mtime && cached->size == st.st_size) {
+                pixels_file_stats_lru.splice(pixels_file_stats_lru.begin(), pixels_file_stats_lru, it->second.lru);
+                result[i] = cached;
+                continue;
+            }
+            /* the file is gone or changed, its footer is read again if it can be */
+            PixelsForgetFileStats(it);
+        }
+        auto stats = std::make_shared<PixelsFileStats>();
+        stats->path = files[i];
+        if (has_stat) {
+            stats->mtime = st.st_mtime;
+            stats->size = st.st_size;
+        }
+        missing.emplace_back(stats);
+        missing_index.emplace_back(i);
+    }
+    if (missing.empty()) {
+        PixelsTrimFileStats(files.size());
+        return result;
+    }
+
+    std::shared_ptr<::Storage> storage = StorageFactory::getInstance()->getStorage(::Storage::file);
+    size_t thread_num = std::min<size_t>({missing.size(),
+                                          std::max(1u, std::thread::hardware_concurrency()),
+                                          PIXELS_FDW_FOOTER_THREADS});
+    std::atomic<size_t> next_file(0);
+    std::vector<std::exception_ptr> errors(thread_num);
+    auto read_footers = [&](size_t thread_id) {
+        try {
+            for (size_t j = next_file++; j < missing.size(); j = next_file++) {
+                PixelsReadFileStats(*missing[j], storage);
+            }
+        } catch (...) {
+            errors[thread_id] = std::current_exception();
+            /* the other threads stop after the file at hand */
+            next_file = missing.size();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t thread_id = 1; thread_id < thread_num; thread_id++) {
+        threads.emplace_back(read_footers, thread_id);
+    }
+    read_footers(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (auto &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    for (size_t j = 0; j < missing.size(); j++) {
+        missing[j]->generation = ++pixels_file_stats_generation;
+        if (missing[j]->mtime >= 0) {
+            PixelsRememberFileStats(missing[j]);
+        }
+        result[missing_index[j]] = missing[j];
+    }
+    PixelsTrimFileStats(files.size());
+    return result;
+}
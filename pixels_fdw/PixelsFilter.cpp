@@ -1,5 +1,6 @@
 
 #include "PixelsFilter.hpp"
+#include <strings.h>
 
 
 PixelsFilter::PixelsFilter(PixelsFilterType type,
@@ -68,6 +69,10 @@ PixelsFilter *PixelsFilter::copy() {
     return new PixelsFilter(pixelsFilterType, column_name, integer_value, decimal_value, string_value);
 }
 
+void PixelsFilter::setStrideVerdict(PixelsFilterVerdict verdict) {
+    stride_verdict = verdict;
+}
+
 template<class T, class OP>
 int PixelsFilter::CompareAvx2(void * data,
                               T constant) {
@@ -81,6 +86,9 @@ int PixelsFilter::CompareAvx2(void * data,
         if constexpr(std::is_same<OP, PixelsFilterOp::Equals>()) {
             mask = _mm256_cmpeq_epi32(vector, constants);
             return _mm256_movemask_ps((__m256)mask);
+        } else if constexpr(std::is_same<OP, PixelsFilterOp::NotEquals>()) {
+            mask = _mm256_cmpeq_epi32(vector, constants);
+            return ~_mm256_movemask_ps((__m256)mask);
         } else if constexpr(std::is_same<OP, PixelsFilterOp::LessThan>()) {
             mask = _mm256_cmpgt_epi32(constants, vector);
             return _mm256_movemask_ps((__m256)mask);
@@ -105,6 +113,12 @@ int PixelsFilter::CompareAvx2(void * data,
             mask = _mm256_cmpeq_epi64(vector_next, constants);
             result += _mm256_movemask_pd((__m256d)mask) << 4;
             return result;
+        } else if constexpr(std::is_same<OP, PixelsFilterOp::NotEquals>()) {
+            mask = _mm256_cmpeq_epi64(vector, constants);
+            result = _mm256_movemask_pd((__m256d)mask);
+            mask = _mm256_cmpeq_epi64(vector_next, constants);
+            result += _mm256_movemask_pd((__m256d)mask) << 4;
+            return ~result;
         } else if constexpr(std::is_same<OP, PixelsFilterOp::LessThan>()) {
             mask = _mm256_cmpgt_epi64(constants, vector);
             result = _mm256_movemask_pd((__m256d)mask);
@@ -193,6 +207,22 @@ void PixelsFilter::TemplatedFilterOperation(std::shared_ptr<ColumnVector> vector
             }
             break;
         }
+        case TypeDescription::TIMESTAMP: {
+            long constant_value = (long)ivalue;
+            auto timestampColumnVector = std::static_pointer_cast<TimestampColumnVector>(vector);
+            int i = 0;
+#ifdef ENABLE_SIMD_FILTER
+            for (; i < vector->length - vector->length % 8; i += 8) {
+                uint8_t mask = CompareAvx2<uint64_t, OP>(timestampColumnVector->times + i, constant_value);
+                filter_mask.setByteAligned(i, mask);
+            }
+#endif
+            for (; i < vector->length; i++) {
+                filter_mask.set(i, OP::Operation(timestampColumnVector->times[i],
+                                                 constant_value));
+            }
+            break;
+        }
         case TypeDescription::DECIMAL: {
             auto decimalColumnVector = std::static_pointer_cast<DecimalColumnVector>(vector);
             int scale = decimalColumnVector->getScale();
@@ -201,7 +231,7 @@ void PixelsFilter::TemplatedFilterOperation(std::shared_ptr<ColumnVector> vector
             int i = 0;
 #ifdef ENABLE_SIMD_FILTER
             for (; i < vector->length - vector->length % 8; i += 8) {
-                uint8_t mask = CompareAvx2<uint64_t, OP>(decimalColumnVector->vector + i, constant_value);
+                uint8_t mask = CompareAvx2<uint64_t, OP>(decimalColumnVector->vector + i, long_value);
                 filter_mask.setByteAligned(i, mask);
             }
 #endif
@@ -244,6 +274,7 @@ void PixelsFilter::FilterOperationSwitch(std::shared_ptr<ColumnVector> vector,
             TemplatedFilterOperation<OP>(vector, ivalue, dvalue, svalue, filter_mask, type);
             break;
         case TypeDescription::LONG:
+        case TypeDescription::TIMESTAMP:
             TemplatedFilterOperation<OP>(vector, ivalue, dvalue, svalue, filter_mask, type);
             break;
         case TypeDescription::DECIMAL:
@@ -265,6 +296,13 @@ void
 PixelsFilter::ApplyFilter(std::shared_ptr<ColumnVector> vector,
                           PixelsBitMask& filterMask,
                           std::shared_ptr<TypeDescription> type) {
+    if (stride_verdict == PixelsFilterVerdict::ALL) {
+        return;
+    }
+    if (stride_verdict == PixelsFilterVerdict::NONE) {
+        memset(filterMask.mask, 0, (filterMask.maskLength + 7) / 8);
+        return;
+    }
     switch (pixelsFilterType) {
         case PixelsFilterType::CONJUNCTION_AND: {
             if (lchild) {
@@ -273,23 +311,25 @@ PixelsFilter::ApplyFilter(std::shared_ptr<ColumnVector> vector,
                 filterMask.And(lchildMask);
             }
             if (rchild) {
-                PixelsBitMask lchildMask(filterMask.maskLength);
-                lchild->ApplyFilter(vector, lchildMask, type);
-                filterMask.And(lchildMask);
+                PixelsBitMask rchildMask(filterMask.maskLength);
+                rchild->ApplyFilter(vector, rchildMask, type);
+                filterMask.And(rchildMask);
             }
             break;
         }
         case PixelsFilterType::CONJUNCTION_OR: {
             PixelsBitMask orMask(filterMask.maskLength);
+            /* the children OR their rows into an empty mask */
+            memset(orMask.mask, 0, (filterMask.maskLength + 7) / 8);
             if (lchild) {
                 PixelsBitMask lchildMask(filterMask.maskLength);
                 lchild->ApplyFilter(vector, lchildMask, type);
                 orMask.Or(lchildMask);
             }
             if (rchild) {
-                PixelsBitMask lchildMask(filterMask.maskLength);
-                lchild->ApplyFilter(vector, lchildMask, type);
-                orMask.Or(lchildMask);
+                PixelsBitMask rchildMask(filterMask.maskLength);
+                rchild->ApplyFilter(vector, rchildMask, type);
+                orMask.Or(rchildMask);
             }
             filterMask.And(orMask);
             break;
@@ -314,12 +354,144 @@ PixelsFilter::ApplyFilter(std::shared_ptr<ColumnVector> vector,
             FilterOperationSwitch<PixelsFilterOp::LessThan>(vector, integer_value, decimal_value, string_value, filterMask, type);
             break;
         }
+        case PixelsFilterType::COMPARE_NE: {
+            FilterOperationSwitch<PixelsFilterOp::NotEquals>(vector, integer_value, decimal_value, string_value, filterMask, type);
+            break;
+        }
         default:
             assert(0);
             break;
     }
 }
 
+/*
+ * Verdict of a comparison with `constant` for a column chunk whose non-null
+ * values lie in [min, max]. Null rows never pass a comparison, so a chunk
+ * with nulls can at best have some rows passing.
+ */
+template <class T>
+PixelsFilterVerdict
+PixelsFilter::CheckRange(const T &min, const T &max, const T &constant, bool has_null) {
+    bool none = false;
+    bool all = false;
+    switch (pixelsFilterType) {
+        case PixelsFilterType::COMPARE_EQ:
+            none = constant < min || constant > max;
+            all = min == constant && max == constant;
+            break;
+        case PixelsFilterType::COMPARE_NE:
+            none = min == constant && max == constant;
+            all = constant < min || constant > max;
+            break;
+        case PixelsFilterType::COMPARE_LT:
+            none = !(min < constant);
+            all = max < constant;
+            break;
+        case PixelsFilterType::COMPARE_LTEQ:
+            none = min > constant;
+            all = !(max > constant);
+            break;
+        case PixelsFilterType::COMPARE_GT:
+            none = !(max > constant);
+            all = min > constant;
+            break;
+        case PixelsFilterType::COMPARE_GTEQ:
+            none = max < constant;
+            all = !(min < constant);
+            break;
+        default:
+            break;
+    }
+    if (none) {
+        return PixelsFilterVerdict::NONE;
+    }
+    return all && !has_null ? PixelsFilterVerdict::ALL : PixelsFilterVerdict::SOME;
+}
+
+PixelsFilterVerdict
+PixelsFilter::CheckStatistics(const pixels::proto::ColumnStatistic &stats,
+                              std::shared_ptr<TypeDescription> type) {
+    switch (pixelsFilterType) {
+        case PixelsFilterType::CONJUNCTION_AND: {
+            PixelsFilterVerdict left = lchild ? lchild->CheckStatistics(stats, type) : PixelsFilterVerdict::ALL;
+            PixelsFilterVerdict right = rchild ? rchild->CheckStatistics(stats, type) : PixelsFilterVerdict::ALL;
+            return std::min(left, right);
+        }
+        case PixelsFilterType::CONJUNCTION_OR: {
+            PixelsFilterVerdict left = lchild ? lchild->CheckStatistics(stats, type) : PixelsFilterVerdict::NONE;
+            PixelsFilterVerdict right = rchild ? rchild->CheckStatistics(stats, type) : PixelsFilterVerdict::NONE;
+            return std::max(left, right);
+        }
+        default:
+            break;
+    }
+
+    bool has_null = stats.has_hasnull() ? stats.hasnull() : true;
+    /* a chunk of nulls only */
+    if (stats.has_numberofvalues() && stats.numberofvalues() == 0 && has_null) {
+        return PixelsFilterVerdict::NONE;
+    }
+    switch (type->getCategory()) {
+        case TypeDescription::SHORT:
+        case TypeDescription::INT:
+        case TypeDescription::LONG:
+            if (!stats.has_intstatistics()) {
+                break;
+            }
+            return CheckRange<long>(stats.intstatistics().minimum(),
+                                    stats.intstatistics().maximum(),
+                                    integer_value, has_null);
+        case TypeDescription::DATE:
+            if (!stats.has_datestatistics()) {
+                break;
+            }
+            return CheckRange<long>(stats.datestatistics().minimum(),
+                                    stats.datestatistics().maximum(),
+                                    integer_value, has_null);
+        case TypeDescription::TIMESTAMP:
+            if (!stats.has_timestampstatistics()) {
+                break;
+            }
+            return CheckRange<long>(stats.timestampstatistics().minimum(),
+                                    stats.timestampstatistics().maximum(),
+                                    integer_value, has_null);
+        case TypeDescription::STRING:
+        case TypeDescription::CHAR:
+        case TypeDescription::VARCHAR:
+            if (!stats.has_stringstatistics()) {
+                break;
+            }
+            return CheckRange<string_t>(string_t(stats.stringstatistics().minimum()),
+                                        string_t(stats.stringstatistics().maximum()),
+                                        string_value, has_null);
+        default:
+            break;
+    }
+    return PixelsFilterVerdict::SOME;
+}
+
+PixelsFilterVerdict
+PixelsCheckRowGroup(const std::vector<PixelsFilter*> &filters,
+                    const pixels::proto::RowGroupStatistic &stats,
+                    std::shared_ptr<TypeDescription> schema) {
+    PixelsFilterVerdict verdict = PixelsFilterVerdict::ALL;
+    const auto &field_names = schema->getFieldNames();
+    for (auto filter : filters) {
+        for (int i = 0; i < field_names.size() && i < stats.columnchunkstats_size(); i++) {
+            if (strcasecmp(field_names.at(i).c_str(), filter->getColumnName().c_str()) != 0) {
+                continue;
+            }
+            verdict = std::min(verdict, filter->CheckStatistics(stats.columnchunkstats(i),
+                                                                schema->getChildren().at(i)));
+            break;
+        }
+        if (verdict == PixelsFilterVerdict::NONE) {
+            break;
+        }
+    }
+    return verdict;
+}
+
 PixelsFilter *createPixelsFilter(PixelsFilterType type,
                                  std::string cname,
                                  long ivalue,
@@ -0,0 +1,315 @@
+//
+// Hash table of the groups of an aggregation computed over the batches,
+// also the table a join builds on one side and probes with the other.
+//
+
+#include "PixelsGroupTable.hpp"
+#include "PixelsUpper.hpp"
+#include <functional>
+
+extern "C" {
+#include "utils/builtins.h"
+}
+
+/* the finalizer of MurmurHash3, spreading the bits of integer keys */
+static inline uint64_t
+PixelsHashInt(uint64_t value) {
+	value ^= value >> 33;
+	value *= UINT64_C(0xff51afd7ed558ccd);
+	value ^= value >> 33;
+	value *= UINT64_C(0xc4ceb9fe1a85ec53);
+	value ^= value >> 33;
+	return value;
+}
+
+static inline uint64_t
+PixelsCombineHash(uint64_t hash, uint64_t value) {
+	return hash ^ (value + UINT64_C(0x9e3779b97f4a7c15) + (hash << 6) + (hash >> 2));
+}
+
+template <class T>
+static void
+PixelsLoadKeyValues(const T *data, const uint32_t *rows, uint64_t count, int64_t *values) {
+	if (rows) {
+		for (uint64_t i = 0; i < count; i++) {
+			values[i] = data[rows[i]];
+		}
+	} else {
+		for (uint64_t i = 0; i < count; i++) {
+			values[i] = data[i];
+		}
+	}
+}
+
+void
+PixelsLoadIntegerKeys(const std::shared_ptr<ColumnVector> &column_vector,
+					  TypeDescription::Category category,
+					  const uint32_t *rows,
+					  uint64_t count,
+					  int64_t *values,
+					  uint8_t *nulls) {
+	switch (category) {
+		case TypeDescription::SHORT:
+		case TypeDescription::INT:
+			PixelsLoadKeyValues(std::static_pointer_cast<LongColumnVector>(column_vector)->intVector,
+								rows, count, values);
+			break;
+		case TypeDescription::LONG:
+			PixelsLoadKeyValues(std::static_pointer_cast<LongColumnVector>(column_vector)->longVector,
+								rows, count, values);
+			break;
+		case TypeDescription::DATE:
+			PixelsLoadKeyValues(std::static_pointer_cast<DateColumnVector>(column_vector)->dates,
+								rows, count, values);
+			break;
+		default:
+			PixelsLoadKeyValues(std::static_pointer_cast<TimestampColumnVector>(column_vector)->times,
+								rows, count, values);
+			break;
+	}
+	if (column_vector->noNulls) {
+		memset(nulls, 0, count);
+		return;
+	}
+	for (uint64_t i = 0; i < count; i++) {
+		nulls[i] = column_vector->isNull[rows ? rows[i] : i] != 0;
+	}
+}
+
+PixelsGroupTable::PixelsGroupTable(const vector<PixelsGroupKey> &keys,
+								   PixelsFdwExecutionState &scan)
+	: scan(scan) {
+	for (auto &key : keys) {
+		KeyColumn column;
+		auto type = scan.GetColumnType(key.attnum);
+		if (!type) {
+			throw PixelsReaderException("grouping column is not in the pixels file");
+		}
+		column.key = key;
+		switch (type->getCategory()) {
+			case TypeDescription::SHORT:
+			case TypeDescription::INT:
+			case TypeDescription::LONG:
+			case TypeDescription::DATE:
+			case TypeDescription::TIMESTAMP:
+				column.is_string = false;
+				break;
+			case TypeDescription::VARCHAR:
+			case TypeDescription::CHAR:
+				column.is_string = true;
+				break;
+			default:
+				throw PixelsReaderException("pixels_fdw cannot group by this column type");
+		}
+		columns.emplace_back(std::move(column));
+	}
+	Reset();
+}
+
+void
+PixelsGroupTable::Reset() {
+	slots.assign(PIXELS_FDW_GROUP_TABLE_MIN_SLOTS, Slot{0, 0});
+	mask = PIXELS_FDW_GROUP_TABLE_MIN_SLOTS - 1;
+	group_hashes.clear();
+	for (auto &column : columns) {
+		column.values.clear();
+		column.strings.clear();
+		column.nulls.clear();
+	}
+}
+
+uint32_t
+PixelsGroupTable::GroupCount() {
+	return group_hashes.size();
+}
+
+void
+PixelsGroupTable::LoadKeys(KeyColumn &column,
+						   PixelsFdwExecutionState &from,
+						   int attnum,
+						   const uint32_t *rows,
+						   uint64_t count) {
+	auto column_vector = from.GetColumnVector(attnum);
+	auto type = from.GetColumnType(attnum);
+	column.batch_nulls.resize(count);
+	if (!column.is_string) {
+		column.batch_values.resize(count);
+		PixelsLoadIntegerKeys(column_vector, type->getCategory(), rows, count,
+							  column.batch_values.data(), column.batch_nulls.data());
+		return;
+	}
+	const string_t *data = (const string_t *) std::static_pointer_cast<BinaryColumnVector>(column_vector)->vector;
+	column.batch_strings.resize(count);
+	for (uint64_t i = 0; i < count; i++) {
+		column.batch_strings[i] = data[rows ? rows[i] : i];
+	}
+	if (column_vector->noNulls) {
+		memset(column.batch_nulls.data(), 0, count);
+		return;
+	}
+	for (uint64_t i = 0; i < count; i++) {
+		column.batch_nulls[i] = column_vector->isNull[rows ? rows[i] : i] != 0;
+	}
+}
+
+bool
+PixelsGroupTable::KeysEqual(uint64_t row, uint32_t group) {
+	for (auto &column : columns) {
+		if (column.batch_nulls[row] || column.nulls[group]) {
+			if (column.batch_nulls[row] != column.nulls[group]) {
+				return false;
+			}
+			continue;
+		}
+		if (column.is_string) {
+			const string_t &value = column.batch_strings[row];
+			const std::string &key = column.strings[group];
+			if (value.GetSize() != key.size() || memcmp(value.GetData(), key.data(), key.size()) != 0) {
+				return false;
+			}
+		} else if (column.batch_values[row] != column.values[group]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+uint32_t
+PixelsGroupTable::AddGroup(uint64_t row, uint64_t hash) {
+	uint32_t group = group_hashes.size();
+	for (auto &column : columns) {
+		bool isnull = column.batch_nulls[row];
+		column.nulls.emplace_back(isnull);
+		if (column.is_string) {
+			const string_t &value = column.batch_strings[row];
+			column.strings.emplace_back(isnull ? std::string() : std::string(value.GetData(), value.GetSize()));
+		} else {
+			column.values.emplace_back(isnull ? 0 : column.batch_values[row]);
+		}
+	}
+	group_hashes.emplace_back(hash);
+	return group;
+}
+
+/* doubles the slots once they are half full, the hashes are kept by group */
+void
+PixelsGroupTable::Grow() {
+	slots.assign(slots.size() * 2, Slot{0, 0});
+	mask = slots.size() - 1;
+	for (uint32_t group = 0; group < group_hashes.size(); group++) {
+		uint64_t index = group_hashes[group] & mask;
+		while (slots[index].group != 0) {
+			index = (index + 1) & mask;
+		}
+		slots[index] = Slot{group_hashes[group], group + 1};
+	}
+}
+
+/* hashes the keys of the batch, column after column */
+void
+PixelsGroupTable::HashKeys(uint64_t count) {
+	hashes.assign(count, 0);
+	for (auto &column : columns) {
+		const uint8_t *nulls = column.batch_nulls.data();
+		if (column.is_string) {
+			const string_t *values = column.batch_strings.data();
+			std::hash<std::string_view> hasher;
+			for (uint64_t i = 0; i < count; i++) {
+				uint64_t hash = nulls[i] ? 0 : hasher(std::string_view(values[i].GetData(), values[i].GetSize()));
+				hashes[i] = PixelsCombineHash(hashes[i], hash);
+			}
+		} else {
+			const int64_t *values = column.batch_values.data();
+			for (uint64_t i = 0; i < count; i++) {
+				hashes[i] = PixelsCombineHash(hashes[i], nulls[i] ? 0 : PixelsHashInt(values[i]));
+			}
+		}
+	}
+}
+
+void
+PixelsGroupTable::FindGroups(const uint32_t *rows, uint64_t count, uint32_t *groups) {
+	for (auto &column : columns) {
+		LoadKeys(column, scan, column.key.attnum, rows, count);
+	}
+	HashKeys(count);
+
+	for (uint64_t i = 0; i < count; i++) {
+		uint64_t hash = hashes[i];
+		uint64_t index = hash & mask;
+		while (true) {
+			const Slot &slot = slots[index];
+			if (slot.group == 0) {
+				groups[i] = AddGroup(i, hash);
+				slots[index] = Slot{hash, groups[i] + 1};
+				if (group_hashes.size() * 2 > slots.size()) {
+					Grow();
+				}
+				break;
+			}
+			if (slot.hash == hash && KeysEqual(i, slot.group - 1)) {
+				groups[i] = slot.group - 1;
+				break;
+			}
+			index = (index + 1) & mask;
+		}
+	}
+}
+
+void
+PixelsGroupTable::LookupGroups(PixelsFdwExecutionState &probe,
+							   const vector<int> &attnums,
+							   const uint32_t *rows,
+							   uint64_t count,
+							   uint32_t *groups) {
+	for (size_t k = 0; k < columns.size(); k++) {
+		LoadKeys(columns[k], probe, attnums[k], rows, count);
+	}
+	HashKeys(count);
+
+	for (uint64_t i = 0; i < count; i++) {
+		groups[i] = PIXELS_FDW_NO_GROUP;
+		bool has_null = false;
+		for (auto &column : columns) {
+			has_null |= column.batch_nulls[i] != 0;
+		}
+		if (has_null) {
+			continue;
+		}
+		uint64_t hash = hashes[i];
+		uint64_t index = hash & mask;
+		while (slots[index].group != 0) {
+			const Slot &slot = slots[index];
+			if (slot.hash == hash && KeysEqual(i, slot.group - 1)) {
+				groups[i] = slot.group - 1;
+				break;
+			}
+			index = (index + 1) & mask;
+		}
+	}
+}
+
+Datum
+PixelsGroupTable::GetKey(int key, uint32_t group, bool *isnull) {
+	KeyColumn &column = columns[key];
+	*isnull = column.nulls[group];
+	if (*isnull) {
+		return (Datum) 0;
+	}
+	if (column.is_string) {
+		const std::string &value = column.strings[group];
+		return PointerGetDatum(cstring_to_text_with_len(value.data(), value.size()));
+	}
+	return pixels_statistic_datum(column.key.type, column.values[group]);
+}
+
+size_t
+PixelsGroupTable::EstimateGroupSize(const vector<Oid> &key_types) {
+	/* two slots, the hash and the null flag of every key per group */
+	size_t size = 2 * sizeof(Slot) + sizeof(uint64_t);
+	for (Oid type : key_types) {
+		size += sizeof(uint8_t);
+		size += (type == TEXTOID || type == VARCHAROID) ? sizeof(std::string) : sizeof(int64_t);
+	}
+	return size;
+}
@@ -0,0 +1,1280 @@
+//
+// Pushdown of the plan steps above a pixels table scan.
+//
+
+#include "PixelsUpper.hpp"
+#include "PixelsFdwPlanState.hpp"
+#include "PixelsColumnConverter.hpp"
+#include "PixelsGroupTable.hpp"
+#include <cmath>
+#include <strings.h>
+
+extern "C"
+{
+#include "access/htup_details.h"
+#include "access/sysattr.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_aggregate.h"
+#include "catalog/pg_type.h"
+#include "executor/nodeHash.h"
+#include "miscadmin.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "optimizer/cost.h"
+#include "optimizer/pathnode.h"
+#include "optimizer/planmain.h"
+#include "optimizer/restrictinfo.h"
+#include "optimizer/tlist.h"
+#include "parser/parsetree.h"
+#include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/fmgroids.h"
+#include "utils/lsyscache.h"
+#include "utils/pg_locale.h"
+#include "utils/selfuncs.h"
+#include "utils/timestamp.h"
+}
+
+bool
+pixels_aggregate_kind(Aggref *aggref, PixelsAggregateKind *kind, Expr **arg)
+{
+    char       *name;
+    Expr       *expr;
+
+    if (aggref->aggkind != AGGKIND_NORMAL || aggref->aggsplit != AGGSPLIT_SIMPLE ||
+        aggref->aggdistinct != NIL || aggref->aggorder != NIL ||
+        aggref->aggfilter != NULL || aggref->aggvariadic ||
+        get_func_namespace(aggref->aggfnoid) != PG_CATALOG_NAMESPACE)
+        return false;
+    name = get_func_name(aggref->aggfnoid);
+    if (aggref->aggstar)
+    {
+        *kind = PIXELS_AGG_COUNT_STAR;
+        *arg = NULL;
+        return strcmp(name, "count") == 0;
+    }
+
+    if (list_length(aggref->args) != 1)
+        return false;
+    expr = ((TargetEntry *) linitial(aggref->args))->expr;
+    while (IsA(expr, RelabelType))
+        expr = ((RelabelType *) expr)->arg;
+    *arg = expr;
+
+    if (strcmp(name, "count") == 0)
+        *kind = PIXELS_AGG_COUNT;
+    else if (strcmp(name, "sum") == 0)
+        *kind = PIXELS_AGG_SUM;
+    else if (strcmp(name, "avg") == 0)
+        *kind = PIXELS_AGG_AVG;
+    else if (strcmp(name, "min") == 0)
+        *kind = PIXELS_AGG_MIN;
+    else if (strcmp(name, "max") == 0)
+        *kind = PIXELS_AGG_MAX;
+    else
+        return false;
+    return true;
+}
+
+/* a column of the table itself */
+static bool
+pixels_is_column(Expr *expr)
+{
+    return IsA(expr, Var) && ((Var *) expr)->varattno > 0 && ((Var *) expr)->varlevelsup == 0;
+}
+
+static bool
+pixels_is_numeric_type(Oid type)
+{
+    return type == INT2OID || type == INT4OID || type == INT8OID || type == NUMERICOID;
+}
+
+/* precision and scale of the NUMERIC typmod, the widest decimal if there is none */
+static void
+pixels_numeric_typmod(int32 typmod, int *precision, int *scale)
+{
+    if (typmod < (int32) VARHDRSZ)
+    {
+        *precision = PIXELS_FDW_MAX_LONG_DEC_WIDTH;
+        *scale = 0;
+        return;
+    }
+    *precision = ((typmod - VARHDRSZ) >> 16) & 0xffff;
+    *scale = (((typmod - VARHDRSZ) & 0x7ff) ^ 1024) - 1024;
+}
+
+/* scaled value of a NUMERIC constant, false if it has more than 38 digits */
+static bool
+pixels_numeric_const(Const *constant, __int128 *value, int *precision, int *scale)
+{
+    Numeric     num = DatumGetNumeric(constant->constvalue);
+    char       *str;
+    bool        negative = false;
+    bool        fraction = false;
+
+    if (numeric_is_nan(num) || numeric_is_inf(num))
+        return false;
+    str = DatumGetCString(DirectFunctionCall1(numeric_out, constant->constvalue));
+    *value = 0;
+    *precision = 0;
+    *scale = 0;
+    for (char *c = str; *c; c++)
+    {
+        if (*c == '-')
+            negative = true;
+        else if (*c == '.')
+            fraction = true;
+        else
+        {
+            if (++*precision > PIXELS_FDW_MAX_LONG_DEC_WIDTH)
+                return false;
+            *value = *value * 10 + (*c - '0');
+            if (fraction)
+                (*scale)++;
+        }
+    }
+    if (negative)
+        *value = -*value;
+    return true;
+}
+
+/* digits and scale of the result of an operator, false if it may not fit */
+static bool
+pixels_arg_bounds(PixelsAggregateArg &arg)
+{
+    const PixelsAggregateArg &left = *arg.left;
+    const PixelsAggregateArg &right = *arg.right;
+
+    if (arg.op == PIXELS_ARG_MUL)
+    {
+        arg.precision = left.precision + right.precision;
+        arg.scale = left.scale + right.scale;
+    }
+    else
+    {
+        arg.scale = std::max(left.scale, right.scale);
+        arg.precision = std::max(left.precision - left.scale, right.precision - right.scale) +
+                        arg.scale + 1;
+    }
+    return arg.precision <= PIXELS_FDW_MAX_LONG_DEC_WIDTH;
+}
+
+std::unique_ptr<PixelsAggregateArg>
+pixels_compile_aggregate_arg(Expr *expr)
+{
+    auto        arg = std::make_unique<PixelsAggregateArg>();
+
+    while (IsA(expr, RelabelType))
+        expr = ((RelabelType *) expr)->arg;
+
+    if (pixels_is_column(expr))
+    {
+        Var        *var = (Var *) expr;
+
+        arg->op = PIXELS_ARG_COLUMN;
+        arg->type = var->vartype;
+        arg->attnum = var->varattno - 1;
+        arg->scale = 0;
+        switch (var->vartype)
+        {
+            case INT2OID:
+                arg->precision = 5;
+                break;
+            case INT4OID:
+                arg->precision = 10;
+                break;
+            case INT8OID:
+            case DATEOID:
+            case TIMESTAMPOID:
+            case TIMESTAMPTZOID:
+                arg->precision = 19;
+                break;
+            case NUMERICOID:
+                pixels_numeric_typmod(var->vartypmod, &arg->precision, &arg->scale);
+                break;
+            case TEXTOID:
+            case VARCHAROID:
+            case BPCHAROID:
+                /* only ever counted */
+                arg->precision = 0;
+                break;
+            default:
+                return nullptr;
+        }
+        return arg;
+    }
+
+    if (IsA(expr, Const) && ((Const *) expr)->consttype == NUMERICOID &&
+        !((Const *) expr)->constisnull)
+    {
+        arg->op = PIXELS_ARG_CONST;
+        arg->type = NUMERICOID;
+        if (!pixels_numeric_const((Const *) expr, &arg->value, &arg->precision, &arg->scale))
+            return nullptr;
+        return arg;
+    }
+
+    /* NUMERIC arithmetic is exact, so it is computed the same on scaled integers */
+    if (IsA(expr, OpExpr) && list_length(((OpExpr *) expr)->args) == 2)
+    {
+        OpExpr     *op = (OpExpr *) expr;
+
+        switch (get_opcode(op->opno))
+        {
+            case F_NUMERIC_ADD:
+                arg->op = PIXELS_ARG_ADD;
+                break;
+            case F_NUMERIC_SUB:
+                arg->op = PIXELS_ARG_SUB;
+                break;
+            case F_NUMERIC_MUL:
+                arg->op = PIXELS_ARG_MUL;
+                break;
+            default:
+                return nullptr;
+        }
+        arg->type = NUMERICOID;
+        arg->left = pixels_compile_aggregate_arg((Expr *) linitial(op->args));
+        arg->right = pixels_compile_aggregate_arg((Expr *) lsecond(op->args));
+        if (!arg->left || !arg->right ||
+            arg->left->type != NUMERICOID || arg->right->type != NUMERICOID ||
+            !pixels_arg_bounds(*arg))
+            return nullptr;
+        return arg;
+    }
+    return nullptr;
+}
+
+bool
+pixels_bind_aggregate_arg(PixelsAggregateArg &arg,
+                          const std::vector<std::shared_ptr<TypeDescription>> &column_types)
+{
+    switch (arg.op)
+    {
+        case PIXELS_ARG_CONST:
+            return true;
+        case PIXELS_ARG_COLUMN:
+        {
+            auto        type = column_types.at(arg.attnum);
+
+            if (!type)
+                return false;
+            arg.scale = 0;
+            switch (type->getCategory())
+            {
+                case TypeDescription::SHORT:
+                    arg.precision = 5;
+                    break;
+                case TypeDescription::INT:
+                    arg.precision = 10;
+                    break;
+                case TypeDescription::LONG:
+                case TypeDescription::DATE:
+                case TypeDescription::TIMESTAMP:
+                    arg.precision = 19;
+                    break;
+                case TypeDescription::DECIMAL:
+                    /* the column vector holds one long per value */
+                    if (type->getPrecision() > PIXELS_FDW_MAX_DEC_WIDTH)
+                        return false;
+                    arg.precision = type->getPrecision();
+                    arg.scale = type->getScale();
+                    break;
+                default:
+                    /* values of other columns are not read, only their nulls */
+                    return !pixels_is_numeric_type(arg.type) && arg.type != DATEOID &&
+                           arg.type != TIMESTAMPOID && arg.type != TIMESTAMPTZOID;
+            }
+            return true;
+        }
+        default:
+            return pixels_bind_aggregate_arg(*arg.left, column_types) &&
+                   pixels_bind_aggregate_arg(*arg.right, column_types) &&
+                   pixels_arg_bounds(arg);
+    }
+}
+
+bool
+pixels_vectorized_aggregate(Aggref *aggref)
+{
+    PixelsAggregateKind kind;
+    Expr       *expr;
+    std::unique_ptr<PixelsAggregateArg> arg;
+
+    if (!pixels_aggregate_kind(aggref, &kind, &expr))
+        return false;
+    if (expr == NULL)
+        return true;
+    arg = pixels_compile_aggregate_arg(expr);
+    if (!arg)
+        return false;
+    switch (kind)
+    {
+        case PIXELS_AGG_SUM:
+        case PIXELS_AGG_AVG:
+            return pixels_is_numeric_type(arg->type);
+        case PIXELS_AGG_MIN:
+        case PIXELS_AGG_MAX:
+            return pixels_is_numeric_type(arg->type) || arg->type == DATEOID ||
+                   arg->type == TIMESTAMPOID || arg->type == TIMESTAMPTZOID;
+        default:
+            return true;
+    }
+}
+
+Datum
+pixels_statistic_datum(Oid type, int64_t value)
+{
+    switch (type)
+    {
+        case INT2OID:
+            return Int16GetDatum((int16) value);
+        case INT4OID:
+            return Int32GetDatum((int32) value);
+        case DATEOID:
+            return DateADTGetDatum(value + (UNIX_EPOCH_JDATE - POSTGRES_EPOCH_JDATE));
+        case TIMESTAMPOID:
+        case TIMESTAMPTZOID:
+            return TimestampGetDatum(value - PIXELS_UNIX_EPOCH_USECS);
+        default:
+            return Int64GetDatum(value);
+    }
+}
+
+bool
+pixels_footer_aggregate(const std::vector<std::shared_ptr<const PixelsFileStats>> &file_stats,
+                        PixelsAggregateKind kind,
+                        const char *column,
+                        Oid type,
+                        Datum *value,
+                        bool *isnull)
+{
+    int64       count = 0;
+    bool        found = false;
+    int64_t     int_result = 0;
+    std::string string_result;
+    bool        is_string = type == TEXTOID || type == VARCHAROID;
+
+    if (kind != PIXELS_AGG_COUNT_STAR && kind != PIXELS_AGG_COUNT &&
+        kind != PIXELS_AGG_MIN && kind != PIXELS_AGG_MAX)
+        return false;
+    if ((kind == PIXELS_AGG_MIN || kind == PIXELS_AGG_MAX) && !is_string &&
+        type != INT2OID && type != INT4OID && type != INT8OID &&
+        type != DATEOID && type != TIMESTAMPOID && type != TIMESTAMPTZOID)
+        return false;
+
+    for (auto &stats : file_stats)
+    {
+        const auto &footer = stats->footer;
+        int         col = -1;
+
+        if (kind == PIXELS_AGG_COUNT_STAR)
+        {
+            count += stats->row_count;
+            continue;
+        }
+        const auto &field_names = stats->schema->getFieldNames();
+        for (int i = 0; i < field_names.size(); i++)
+        {
+            if (strcasecmp(field_names.at(i).c_str(), column) == 0)
+            {
+                col = i;
+                break;
+            }
+        }
+        if (col < 0)
+            return false;
+
+        for (int rg_id = 0; rg_id < footer.rowgroupinfos_size(); rg_id++)
+        {
+            if (rg_id >= footer.rowgroupstats_size() ||
+                col >= footer.rowgroupstats(rg_id).columnchunkstats_size())
+                return false;
+            const auto &chunk = footer.rowgroupstats(rg_id).columnchunkstats(col);
+            if (!chunk.has_numberofvalues())
+                return false;
+            if (kind == PIXELS_AGG_COUNT)
+            {
+                count += chunk.numberofvalues();
+                continue;
+            }
+            if (chunk.numberofvalues() == 0)
+                continue;
+
+            if (is_string)
+            {
+                if (!chunk.has_stringstatistics())
+                    return false;
+                const std::string &bound = kind == PIXELS_AGG_MIN ?
+                                           chunk.stringstatistics().minimum() :
+                                           chunk.stringstatistics().maximum();
+                if (!found || (kind == PIXELS_AGG_MIN ? bound < string_result : bound > string_result))
+                    string_result = bound;
+                found = true;
+                continue;
+            }
+
+            int64_t     minimum;
+            int64_t     maximum;
+            if (type == DATEOID)
+            {
+                if (!chunk.has_datestatistics())
+                    return false;
+                minimum = chunk.datestatistics().minimum();
+                maximum = chunk.datestatistics().maximum();
+            }
+            else if (type == TIMESTAMPOID || type == TIMESTAMPTZOID)
+            {
+                if (!chunk.has_timestampstatistics())
+                    return false;
+                minimum = chunk.timestampstatistics().minimum();
+                maximum = chunk.timestampstatistics().maximum();
+            }
+            else
+            {
+                if (!chunk.has_intstatistics())
+                    return false;
+                minimum = chunk.intstatistics().minimum();
+                maximum = chunk.intstatistics().maximum();
+            }
+            if (kind == PIXELS_AGG_MIN)
+                int_result = found ? std::min(int_result, minimum) : minimum;
+            else
+                int_result = found ? std::max(int_result, maximum) : maximum;
+            found = true;
+        }
+    }
+
+    if (value == NULL)
+        return true;
+    if (kind == PIXELS_AGG_COUNT_STAR || kind == PIXELS_AGG_COUNT)
+    {
+        *value = Int64GetDatum(count);
+        *isnull = false;
+    }
+    else if (!found)
+    {
+        *value = (Datum) 0;
+        *isnull = true;
+    }
+    else
+    {
+        *value = is_string ?
+                 PointerGetDatum(cstring_to_text_with_len(string_result.data(), string_result.size())) :
+                 pixels_statistic_datum(type, int_result);
+        *isnull = false;
+    }
+    return true;
+}
+
+/*
+ * Checks that an aggregate can be answered from the footers: the string
+ * bounds are in byte order, so min and max of strings need the C collation.
+ */
+static bool
+pixels_metadata_aggregate(Aggref *aggref,
+                          Oid relid,
+                          const std::vector<std::shared_ptr<const PixelsFileStats>> &file_stats)
+{
+    PixelsAggregateKind kind;
+    Expr       *expr;
+    Var        *arg;
+    Oid         type;
+
+    if (!pixels_aggregate_kind(aggref, &kind, &expr))
+        return false;
+    if (expr == NULL)
+        return pixels_footer_aggregate(file_stats, kind, NULL, InvalidOid, NULL, NULL);
+    if (!pixels_is_column(expr))
+        return false;
+    arg = (Var *) expr;
+    type = arg->vartype;
+    if ((type == TEXTOID || type == VARCHAROID) &&
+        (kind == PIXELS_AGG_MIN || kind == PIXELS_AGG_MAX) &&
+        !(OidIsValid(aggref->inputcollid) && lc_collate_is_c(aggref->inputcollid)))
+        return false;
+    return pixels_footer_aggregate(file_stats, kind, get_attname(relid, arg->varattno, false),
+                                   type, NULL, NULL);
+}
+
+/* whether a Param of the clause is only set while the plan runs */
+static bool
+pixels_contain_exec_param(Node *node, void *context)
+{
+    if (node == NULL)
+        return false;
+    if (IsA(node, Param))
+        return ((Param *) node)->paramkind != PARAM_EXTERN;
+    return expression_tree_walker(node, (bool (*)()) pixels_contain_exec_param, context);
+}
+
+/*
+ * Restriction clauses of the table for the upper scan to check itself, or
+ * false if some of them cannot be checked on the rows of a batch.
+ */
+static bool
+pixels_upper_quals(RelOptInfo *input_rel, List **quals)
+{
+    Bitmapset  *attrs = NULL;
+    int         attr = -1;
+
+    if (extract_actual_clauses(input_rel->baserestrictinfo, true) != NIL)
+        return false;
+    *quals = (List *) copyObject(extract_actual_clauses(input_rel->baserestrictinfo, false));
+    if (contain_subplans((Node *) *quals) ||
+        pixels_contain_exec_param((Node *) *quals, NULL))
+        return false;
+    pull_varattnos((Node *) *quals, input_rel->relid, &attrs);
+    while ((attr = bms_next_member(attrs, attr)) >= 0)
+    {
+        if (attr + FirstLowInvalidHeapAttributeNumber <= 0)
+            return false;
+    }
+    /* setrefs.c does not look into fdw_private */
+    fix_opfuncids((Node *) *quals);
+    return true;
+}
+
+/*
+ * Grouping columns of the query, or false if some grouping expression is
+ * no plain column of a type the group table takes, compared with the
+ * default equality of the type.
+ */
+static bool
+pixels_group_keys(PlannerInfo *root, List **group_exprs, std::vector<Oid> *key_types)
+{
+    ListCell   *lc;
+
+    foreach (lc, root->parse->groupClause)
+    {
+        SortGroupClause *sgc = (SortGroupClause *) lfirst(lc);
+        Expr       *expr = (Expr *) get_sortgroupclause_expr(sgc, root->processed_tlist);
+        Var        *var;
+
+        while (IsA(expr, RelabelType))
+            expr = ((RelabelType *) expr)->arg;
+        if (!pixels_is_column(expr))
+            return false;
+        var = (Var *) expr;
+        switch (get_opcode(sgc->eqop))
+        {
+            case F_INT2EQ:
+            case F_INT4EQ:
+            case F_INT8EQ:
+            case F_DATE_EQ:
+            case F_TIMESTAMP_EQ:
+                if (var->vartype != INT2OID && var->vartype != INT4OID &&
+                    var->vartype != INT8OID && var->vartype != DATEOID &&
+                    var->vartype != TIMESTAMPOID)
+                    return false;
+                break;
+            case F_TIMESTAMPTZ_EQ:
+                if (var->vartype != TIMESTAMPTZOID)
+                    return false;
+                break;
+            case F_TEXTEQ:
+                /* the keys are compared byte by byte */
+                if ((var->vartype != TEXTOID && var->vartype != VARCHAROID) ||
+                    !get_collation_isdeterministic(var->varcollid))
+                    return false;
+                break;
+            default:
+                return false;
+        }
+        *group_exprs = lappend(*group_exprs, var);
+        key_types->emplace_back(var->vartype);
+    }
+    return true;
+}
+
+/*
+ * Aggregates over a table are computed by the scan itself. Without groups
+ * and filters, count(*), and count, min or max of a column whose row group
+ * statistics are all there are answered from the footers. Otherwise plain
+ * count, sum, avg, min and max of numeric, date and timestamp columns, and
+ * of NUMERIC arithmetic on them, are computed over the column vectors of the
+ * batches, so that no tuple is formed for the rows aggregated. Groups of
+ * integer, date, timestamp and string columns are kept in a hash table,
+ * which has to fit the memory a hash aggregation may take.
+ */
+static void
+pixels_add_aggregate_paths(PlannerInfo *root,
+                           RelOptInfo *input_rel,
+                           RelOptInfo *grouped_rel,
+                           GroupPathExtraData *extra)
+{
+    Query      *parse = root->parse;
+    PixelsFdwPlanState *fdw_private = (PixelsFdwPlanState *) input_rel->fdw_private;
+    PathTarget *target = root->upper_targets[UPPERREL_GROUP_AGG];
+    Oid         relid = planner_rt_fetch(input_rel->relid, root)->relid;
+    List       *having = (List *) extra->havingQual;
+    List       *exprs;
+    List       *group_exprs = NIL;
+    std::vector<Oid> key_types;
+    List       *aggs = NIL;
+    List       *quals = NIL;
+    List       *scan_tlist = NIL;
+    List       *attrs_used = NIL;
+    Bitmapset  *attrs = NULL;
+    int         attr;
+    bool        metadata;
+    bool        vectorized = true;
+    double      num_groups = 1;
+    List       *upper;
+    List       *plan_private;
+    ListCell   *lc;
+    ForeignPath *path;
+    Path       *input_path = input_rel->cheapest_total_path;
+    Cost        total_cost;
+
+    if (parse->groupingSets != NIL || parse->hasTargetSRFs ||
+        !bms_is_empty(input_rel->lateral_relids))
+        return;
+    if (!pixels_group_keys(root, &group_exprs, &key_types))
+        return;
+
+    exprs = list_concat(list_copy(target->exprs), having);
+    metadata = group_exprs == NIL &&
+        input_rel->baserestrictinfo == NIL && fdw_private->pushdown_filters == NIL;
+    foreach (lc, pull_var_clause((Node *) exprs, PVC_INCLUDE_AGGREGATES | PVC_INCLUDE_PLACEHOLDERS))
+    {
+        Node       *node = (Node *) lfirst(lc);
+
+        /* columns outside the aggregates are grouping columns */
+        if (IsA(node, Var) && list_member(group_exprs, node))
+            continue;
+        if (!IsA(node, Aggref))
+            return;
+        metadata = metadata &&
+            pixels_metadata_aggregate((Aggref *) node, relid, fdw_private->getFileStats());
+        vectorized = vectorized && pixels_vectorized_aggregate((Aggref *) node);
+        aggs = lappend(aggs, node);
+    }
+    if (!metadata && (!vectorized || !pixels_upper_quals(input_rel, &quals)))
+        return;
+    if (group_exprs != NIL)
+    {
+        size_t      group_size = PixelsGroupTable::EstimateGroupSize(key_types) +
+                                 list_length(aggs) * PIXELS_FDW_AGGREGATE_GROUP_SIZE;
+
+        num_groups = estimate_num_groups(root, group_exprs, input_rel->rows, NULL, NULL);
+        if (num_groups * group_size > get_hash_memory_limit())
+            return;
+    }
+    /* the grouping columns come first, the executor takes the others for aggregates */
+    scan_tlist = add_to_flat_tlist(scan_tlist, group_exprs);
+    scan_tlist = add_to_flat_tlist(scan_tlist, aggs);
+
+    if (metadata)
+    {
+        upper = list_make3(makeInteger(PIXELS_UPPER_METADATA), list_make1_oid(relid), NIL);
+        plan_private = list_make4(fdw_private->getFilesList(), NIL, NIL, upper);
+        /* one look at every row group statistic */
+        total_cost = fdw_private->getFileStats().size() * cpu_operator_cost + cpu_tuple_cost;
+    }
+    else
+    {
+        pull_varattnos((Node *) quals, input_rel->relid, &attrs);
+        pull_varattnos((Node *) scan_tlist, input_rel->relid, &attrs);
+        attr = -1;
+        while ((attr = bms_next_member(attrs, attr)) >= 0)
+            attrs_used = lappend_int(attrs_used, attr);
+        upper = list_make3(makeInteger(PIXELS_UPPER_AGGREGATE), list_make1_oid(relid), quals);
+        plan_private = list_make4(fdw_private->getFilesList(), fdw_private->pushdown_filters,
+                                  attrs_used, upper);
+        /*
+         * The rows are read and checked as by the table scan, but none is
+         * handed up: each one that passes costs an operator per grouping
+         * column and aggregate, and only the groups become tuples.
+         */
+        total_cost = input_path->total_cost - input_path->rows * cpu_tuple_cost +
+                     input_path->rows * (list_length(group_exprs) + list_length(aggs)) * cpu_operator_cost +
+                     num_groups * cpu_tuple_cost;
+    }
+
+    path = create_foreign_upper_path(root,
+                                     grouped_rel,
+                                     target,
+                                     num_groups,
+                                     total_cost,
+                                     total_cost,
+                                     NIL,
+                                     NULL,
+                                     list_make4(plan_private, scan_tlist, having,
+                                                metadata ? NIL : fdw_private->pushdown_params));
+    add_path(grouped_rel, (Path *) path);
+}
+
+/*
+ * Sort keys of the query as integer lists of (attribute number, descending,
+ * nulls first), or false if some key is no plain column of an integer, date
+ * or timestamp type sorted by the default order of the type.
+ */
+static bool
+pixels_sort_keys(PlannerInfo *root, List **sort_keys)
+{
+    ListCell   *lc;
+
+    foreach (lc, root->parse->sortClause)
+    {
+        SortGroupClause *sgc = (SortGroupClause *) lfirst(lc);
+        Expr       *expr = (Expr *) get_sortgroupclause_expr(sgc, root->processed_tlist);
+        Var        *var;
+        bool        descending;
+        Oid         type;
+
+        while (IsA(expr, RelabelType))
+            expr = ((RelabelType *) expr)->arg;
+        if (!pixels_is_column(expr))
+            return false;
+        var = (Var *) expr;
+        switch (get_opcode(sgc->sortop))
+        {
+            case F_INT2LT:
+            case F_INT2GT:
+                type = INT2OID;
+                break;
+            case F_INT4LT:
+            case F_INT4GT:
+                type = INT4OID;
+                break;
+            case F_INT8LT:
+            case F_INT8GT:
+                type = INT8OID;
+                break;
+            case F_DATE_LT:
+            case F_DATE_GT:
+                type = DATEOID;
+                break;
+            case F_TIMESTAMP_LT:
+            case F_TIMESTAMP_GT:
+                type = TIMESTAMPOID;
+                break;
+            case F_TIMESTAMPTZ_LT:
+            case F_TIMESTAMPTZ_GT:
+                type = TIMESTAMPTZOID;
+                break;
+            default:
+                return false;
+        }
+        if (var->vartype != type)
+            return false;
+        switch (get_opcode(sgc->sortop))
+        {
+            case F_INT2GT:
+            case F_INT4GT:
+            case F_INT8GT:
+            case F_DATE_GT:
+            case F_TIMESTAMP_GT:
+            case F_TIMESTAMPTZ_GT:
+                descending = true;
+                break;
+            default:
+                descending = false;
+                break;
+        }
+        *sort_keys = lappend(*sort_keys,
+                             list_make3_int(var->varattno, descending, sgc->nulls_first));
+    }
+    return *sort_keys != NIL;
+}
+
+/* whether a LIMIT or OFFSET expression can be computed when the scan starts */
+static bool
+pixels_limit_expr(Node *expr)
+{
+    return expr == NULL ||
+        (!contain_var_clause(expr) && !contain_volatile_functions(expr) &&
+         !contain_subplans(expr) && !pixels_contain_exec_param(expr, NULL));
+}
+
+/*
+ * A LIMIT right above the table scan is taken by the scan, which then
+ * stops handing rows up once enough of them passed the quals. Knowing that
+ * only a few row groups are needed, it reads no row group ahead of the one
+ * it is returning rows from; with neither quals nor filters to drop rows it
+ * does not even schedule the row groups past the limit.
+ *
+ * With an ORDER BY on integer, date or timestamp columns in between, the
+ * scan keeps the first rows in a heap instead of a Sort above it doing so.
+ * It visits the row groups best first by their statistics and ends at the
+ * first one that cannot hold a row the heap would take. The path is only
+ * offered when the heap is expected to fit in work_mem; should it outgrow
+ * it anyway, the scan hands its rows to a tuplesort.
+ */
+static void
+pixels_add_final_paths(PlannerInfo *root,
+                       RelOptInfo *input_rel,
+                       RelOptInfo *final_rel,
+                       FinalPathExtraData *extra,
+                       bool ordered)
+{
+    Query      *parse = root->parse;
+    PixelsFdwPlanState *fdw_private = (PixelsFdwPlanState *) input_rel->fdw_private;
+    PathTarget *target = root->upper_targets[UPPERREL_FINAL];
+    Oid         relid = planner_rt_fetch(input_rel->relid, root)->relid;
+    List       *quals = NIL;
+    List       *scan_tlist = NIL;
+    List       *attrs_used = NIL;
+    Bitmapset  *attrs = NULL;
+    int         attr;
+    Node       *limit_count;
+    Node       *limit_offset;
+    List       *sort_keys = NIL;
+    List       *upper;
+    List       *plan_private;
+    ListCell   *lc;
+    ForeignPath *path;
+    Path       *input_path = input_rel->cheapest_total_path;
+    double      rows = input_path->rows;
+    Cost        startup_cost = input_path->startup_cost;
+    Cost        total_cost = input_path->total_cost;
+
+    if (!extra->limit_needed || parse->limitOption != LIMIT_OPTION_COUNT ||
+        parse->rowMarks != NIL || parse->hasTargetSRFs ||
+        !bms_is_empty(input_rel->lateral_relids))
+        return;
+    if (!pixels_limit_expr(parse->limitCount) || !pixels_limit_expr(parse->limitOffset))
+        return;
+    /* the heap of a top-N scan needs a bound */
+    if (ordered && (parse->limitCount == NULL ||
+                    (IsA(parse->limitCount, Const) && ((Const *) parse->limitCount)->constisnull) ||
+                    !pixels_sort_keys(root, &sort_keys)))
+        return;
+    foreach (lc, pull_var_clause((Node *) target->exprs, PVC_INCLUDE_PLACEHOLDERS))
+    {
+        Var        *var = (Var *) lfirst(lc);
+
+        if (!IsA(var, Var) || var->varno != input_rel->relid || var->varattno <= 0)
+            return;
+        scan_tlist = add_to_flat_tlist(scan_tlist, list_make1(var));
+    }
+    if (!pixels_upper_quals(input_rel, &quals))
+        return;
+
+    limit_count = (Node *) copyObject(parse->limitCount);
+    limit_offset = (Node *) copyObject(parse->limitOffset);
+    fix_opfuncids(limit_count);
+    fix_opfuncids(limit_offset);
+    foreach (lc, sort_keys)
+        attrs = bms_add_member(attrs, linitial_int((List *) lfirst(lc)) -
+                               FirstLowInvalidHeapAttributeNumber);
+    pull_varattnos((Node *) quals, input_rel->relid, &attrs);
+    pull_varattnos((Node *) scan_tlist, input_rel->relid, &attrs);
+    attr = -1;
+    while ((attr = bms_next_member(attrs, attr)) >= 0)
+        attrs_used = lappend_int(attrs_used, attr);
+    upper = list_make5(makeInteger(ordered ? PIXELS_UPPER_TOPN : PIXELS_UPPER_LIMIT),
+                       list_make1_oid(relid), quals, limit_count, limit_offset);
+    if (ordered)
+        upper = lappend(upper, sort_keys);
+    plan_private = list_make4(fdw_private->getFilesList(), fdw_private->pushdown_filters,
+                              attrs_used, upper);
+
+    if (ordered)
+    {
+        /*
+         * Every row that passes is read and compared with the last row
+         * kept, as a bounded Sort would, but none becomes a tuple unless it
+         * gets into the heap; nothing is returned before the scan is done.
+         */
+        double      bound = extra->count_est > 0 ?
+                            extra->count_est + Max(extra->offset_est, 0) : rows * 0.1;
+
+        bound = clamp_row_est(Min(bound, rows));
+        /* the heap is kept in memory; past work_mem a Sort does better */
+        if (bound * (MAXALIGN(input_rel->reltarget->width) + MAXALIGN(SizeofMinimalTupleHeader)) >
+            work_mem * 1024.0)
+            return;
+        total_cost += rows * (list_length(sort_keys) * cpu_operator_cost - cpu_tuple_cost) +
+                      bound * (log2(bound) + 1) * 2.0 * cpu_operator_cost + bound * cpu_tuple_cost;
+        /* only the row count is adjusted, the costs are all paid upfront */
+        startup_cost = total_cost;
+        adjust_limit_rows_costs(&rows, &startup_cost, &total_cost,
+                                extra->offset_est, extra->count_est);
+    }
+    else
+    {
+        /*
+         * The scan stops as a Limit over it would, but the rows it skips or
+         * returns are not handed through another node.
+         */
+        adjust_limit_rows_costs(&rows, &startup_cost, &total_cost,
+                                extra->offset_est, extra->count_est);
+        total_cost -= rows * cpu_tuple_cost;
+        total_cost = Max(total_cost, startup_cost);
+    }
+
+    path = create_foreign_upper_path(root,
+                                     final_rel,
+                                     target,
+                                     rows,
+                                     startup_cost,
+                                     total_cost,
+                                     ordered ? root->sort_pathkeys : NIL,
+                                     NULL,
+                                     list_make4(plan_private, scan_tlist, NIL,
+                                                fdw_private->pushdown_params));
+    add_path(final_rel, (Path *) path);
+}
+
+/* fdw_private of the ordered relation right above a pixels table scan */
+typedef struct PixelsOrderedRel
+{
+    RelOptInfo *scan_rel;
+} PixelsOrderedRel;
+
+void
+pixels_add_upper_paths(PlannerInfo *root,
+                       UpperRelationKind stage,
+                       RelOptInfo *input_rel,
+                       RelOptInfo *output_rel,
+                       void *extra)
+{
+    /* a LIMIT above an ORDER BY right above a pixels table scan */
+    if (stage == UPPERREL_FINAL && input_rel->reloptkind == RELOPT_UPPER_REL &&
+        input_rel->fdw_private != NULL)
+    {
+        pixels_add_final_paths(root, ((PixelsOrderedRel *) input_rel->fdw_private)->scan_rel,
+                               output_rel, (FinalPathExtraData *) extra, true);
+        return;
+    }
+
+    /* only the steps right above a pixels table scan */
+    if (input_rel->reloptkind != RELOPT_BASEREL || input_rel->fdw_private == NULL)
+        return;
+
+    switch (stage)
+    {
+        case UPPERREL_GROUP_AGG:
+            pixels_add_aggregate_paths(root, input_rel, output_rel, (GroupPathExtraData *) extra);
+            break;
+        case UPPERREL_ORDERED:
+            {
+                /* the sort is only taken together with the LIMIT above it */
+                PixelsOrderedRel *ordered = (PixelsOrderedRel *) palloc0(sizeof(PixelsOrderedRel));
+
+                ordered->scan_rel = input_rel;
+                output_rel->fdw_private = ordered;
+                break;
+            }
+        case UPPERREL_FINAL:
+            pixels_add_final_paths(root, input_rel, output_rel, (FinalPathExtraData *) extra, false);
+            break;
+        default:
+            break;
+    }
+}
+
+/* fdw_private of a join of two pixels tables, once its paths are added */
+typedef struct PixelsJoinedRel
+{
+    bool        considered;
+} PixelsJoinedRel;
+
+/*
+ * Columns of the two tables compared by an equality the join table takes,
+ * outer column first, or false for any other clause.
+ */
+static bool
+pixels_join_key(RestrictInfo *rinfo, Index outer_relid, Index inner_relid,
+                Var **outer_key, Var **inner_key)
+{
+    OpExpr     *op;
+    Expr       *left;
+    Expr       *right;
+    Var        *outer_var;
+    Var        *inner_var;
+
+    if (rinfo->pseudoconstant || !IsA(rinfo->clause, OpExpr))
+        return false;
+    op = (OpExpr *) rinfo->clause;
+    if (list_length(op->args) != 2)
+        return false;
+    left = (Expr *) linitial(op->args);
+    right = (Expr *) lsecond(op->args);
+    while (IsA(left, RelabelType))
+        left = ((RelabelType *) left)->arg;
+    while (IsA(right, RelabelType))
+        right = ((RelabelType *) right)->arg;
+    if (!pixels_is_column(left) || !pixels_is_column(right))
+        return false;
+    if (((Var *) left)->varno == outer_relid && ((Var *) right)->varno == inner_relid)
+    {
+        outer_var = (Var *) left;
+        inner_var = (Var *) right;
+    }
+    else if (((Var *) left)->varno == inner_relid && ((Var *) right)->varno == outer_relid)
+    {
+        outer_var = (Var *) right;
+        inner_var = (Var *) left;
+    }
+    else
+        return false;
+
+    switch (get_opcode(op->opno))
+    {
+        case F_INT2EQ:
+        case F_INT4EQ:
+        case F_INT8EQ:
+        case F_INT24EQ:
+        case F_INT42EQ:
+        case F_INT28EQ:
+        case F_INT82EQ:
+        case F_INT48EQ:
+        case F_INT84EQ:
+            /* integers of any width are compared as kept in the files */
+            if ((outer_var->vartype != INT2OID && outer_var->vartype != INT4OID &&
+                 outer_var->vartype != INT8OID) ||
+                (inner_var->vartype != INT2OID && inner_var->vartype != INT4OID &&
+                 inner_var->vartype != INT8OID))
+                return false;
+            break;
+        case F_DATE_EQ:
+        case F_TIMESTAMP_EQ:
+        case F_TIMESTAMPTZ_EQ:
+            if (outer_var->vartype != inner_var->vartype ||
+                (outer_var->vartype != DATEOID && outer_var->vartype != TIMESTAMPOID &&
+                 outer_var->vartype != TIMESTAMPTZOID))
+                return false;
+            break;
+        case F_TEXTEQ:
+            /* the keys are compared byte by byte */
+            if ((outer_var->vartype != TEXTOID && outer_var->vartype != VARCHAROID) ||
+                (inner_var->vartype != TEXTOID && inner_var->vartype != VARCHAROID) ||
+                !get_collation_isdeterministic(op->inputcollid))
+                return false;
+            break;
+        default:
+            return false;
+    }
+    *outer_key = outer_var;
+    *inner_key = inner_var;
+    return true;
+}
+
+/* attrs_used of one table of the join, for its scan */
+static List *
+pixels_join_attrs_used(Index relid, List *scan_tlist, List *quals, List *keys)
+{
+    Bitmapset  *attrs = NULL;
+    List       *attrs_used = NIL;
+    int         attr = -1;
+
+    pull_varattnos((Node *) scan_tlist, relid, &attrs);
+    pull_varattnos((Node *) quals, relid, &attrs);
+    pull_varattnos((Node *) keys, relid, &attrs);
+    while ((attr = bms_next_member(attrs, attr)) >= 0)
+        attrs_used = lappend_int(attrs_used, attr);
+    return attrs_used;
+}
+
+/*
+ * An inner join of two pixels tables on equalities of integer, date,
+ * timestamp or string columns is a hash join done by the scan itself: the
+ * smaller table is read into a hash table keyed on its columns, and the
+ * batches of the other table are looked up in it column vector by column
+ * vector, so that its rows only become tuples once they joined. The hash
+ * table has to fit the memory a hash join may take, and both tables have
+ * to be scanned without parameters.
+ */
+void
+pixels_add_join_paths(PlannerInfo *root,
+                      RelOptInfo *joinrel,
+                      RelOptInfo *outerrel,
+                      RelOptInfo *innerrel,
+                      JoinType jointype,
+                      JoinPathExtraData *extra)
+{
+    PixelsJoinedRel *joined;
+    PixelsFdwPlanState *outer_state = (PixelsFdwPlanState *) outerrel->fdw_private;
+    PixelsFdwPlanState *inner_state = (PixelsFdwPlanState *) innerrel->fdw_private;
+    RelOptInfo *build_rel;
+    RelOptInfo *probe_rel;
+    PixelsFdwPlanState *build_state;
+    PixelsFdwPlanState *probe_state;
+    List       *outer_quals = NIL;
+    List       *inner_quals = NIL;
+    List       *outer_keys = NIL;
+    List       *inner_keys = NIL;
+    List       *build_keys;
+    List       *probe_keys;
+    List       *build_attnos = NIL;
+    List       *probe_attnos = NIL;
+    List       *other_quals = NIL;
+    List       *scan_tlist = NIL;
+    List       *sides = NIL;
+    List       *attnos = NIL;
+    std::vector<Oid> key_types;
+    QualCost    qual_cost;
+    double      build_rows;
+    double      probe_rows;
+    size_t      row_size;
+    int         nkeys;
+    Cost        build_cost;
+    Cost        probe_cost;
+    Cost        startup_cost;
+    Cost        total_cost;
+    List       *upper;
+    List       *plan_private;
+    ListCell   *lc;
+    ForeignPath *path;
+
+    /* the join is the same whichever table is outer */
+    if (joinrel->fdw_private != NULL)
+        return;
+    joined = (PixelsJoinedRel *) palloc0(sizeof(PixelsJoinedRel));
+    joined->considered = true;
+    joinrel->fdw_private = joined;
+
+    if (jointype != JOIN_INNER || root->rowMarks != NIL ||
+        outerrel->reloptkind != RELOPT_BASEREL || innerrel->reloptkind != RELOPT_BASEREL ||
+        outer_state == NULL || inner_state == NULL ||
+        !bms_is_empty(joinrel->lateral_relids) ||
+        outer_state->pushdown_params != NIL || inner_state->pushdown_params != NIL)
+        return;
+    if (!pixels_upper_quals(outerrel, &outer_quals) ||
+        !pixels_upper_quals(innerrel, &inner_quals))
+        return;
+
+    foreach (lc, extra->restrictlist)
+    {
+        RestrictInfo *rinfo = lfirst_node(RestrictInfo, lc);
+        Var        *outer_key;
+        Var        *inner_key;
+
+        if (pixels_join_key(rinfo, outerrel->relid, innerrel->relid, &outer_key, &inner_key))
+        {
+            outer_keys = lappend(outer_keys, outer_key);
+            inner_keys = lappend(inner_keys, inner_key);
+            continue;
+        }
+        if (rinfo->pseudoconstant)
+            return;
+        other_quals = lappend(other_quals, rinfo->clause);
+    }
+    if (outer_keys == NIL)
+        return;
+
+    /* the scan tuple only holds plain columns of the two tables */
+    foreach (lc, pull_var_clause((Node *) list_concat(list_copy(joinrel->reltarget->exprs), other_quals),
+                                 PVC_INCLUDE_PLACEHOLDERS))
+    {
+        Expr       *node = (Expr *) lfirst(lc);
+
+        if (!pixels_is_column(node))
+            return;
+        scan_tlist = add_to_flat_tlist(scan_tlist, list_make1(node));
+    }
+
+    /* the table taking less memory is built on */
+    if (innerrel->rows * innerrel->reltarget->width <= outerrel->rows * outerrel->reltarget->width)
+    {
+        build_rel = innerrel;
+        build_state = inner_state;
+        build_keys = inner_keys;
+        probe_rel = outerrel;
+        probe_state = outer_state;
+        probe_keys = outer_keys;
+    }
+    else
+    {
+        build_rel = outerrel;
+        build_state = outer_state;
+        build_keys = outer_keys;
+        probe_rel = innerrel;
+        probe_state = inner_state;
+        probe_keys = inner_keys;
+    }
+    nkeys = list_length(build_keys);
+    foreach (lc, build_keys)
+    {
+        key_types.emplace_back(((Var *) lfirst(lc))->vartype);
+        build_attnos = lappend_int(build_attnos, ((Var *) lfirst(lc))->varattno);
+    }
+    foreach (lc, probe_keys)
+        probe_attnos = lappend_int(probe_attnos, ((Var *) lfirst(lc))->varattno);
+    build_rows = build_rel->rows;
+    probe_rows = probe_rel->rows;
+    row_size = PixelsGroupTable::EstimateGroupSize(key_types) + sizeof(uint32) +
+               MAXALIGN(SizeofMinimalTupleHeader) + MAXALIGN(build_rel->reltarget->width);
+    if (build_rows * row_size > get_hash_memory_limit())
+        return;
+
+    foreach (lc, scan_tlist)
+    {
+        Var        *var = (Var *) ((TargetEntry *) lfirst(lc))->expr;
+
+        sides = lappend_int(sides, var->varno == build_rel->relid ? 0 : 1);
+        attnos = lappend_int(attnos, var->varattno);
+    }
+
+    upper = list_make5(makeInteger(PIXELS_UPPER_JOIN),
+                       list_make2_oid(planner_rt_fetch(build_rel->relid, root)->relid,
+                                      planner_rt_fetch(probe_rel->relid, root)->relid),
+                       build_rel == innerrel ? inner_quals : outer_quals,
+                       build_rel == innerrel ? outer_quals : inner_quals,
+                       list_make3(probe_state->getFilesList(), probe_state->pushdown_filters,
+                                  pixels_join_attrs_used(probe_rel->relid, scan_tlist,
+                                                         build_rel == innerrel ? outer_quals : inner_quals,
+                                                         probe_keys)));
+    upper = lappend(upper, build_attnos);
+    upper = lappend(upper, probe_attnos);
+    upper = lappend(upper, sides);
+    upper = lappend(upper, attnos);
+    plan_private = list_make4(build_state->getFilesList(), build_state->pushdown_filters,
+                              pixels_join_attrs_used(build_rel->relid, scan_tlist,
+                                                     build_rel == innerrel ? inner_quals : outer_quals,
+                                                     build_keys),
+                              upper);
+
+    /*
+     * Both tables are read as by their scans. The rows of the built table
+     * are hashed and kept as tuples before the first row is returned; those
+     * of the probed table are only hashed, and the joined rows become tuples
+     * checked by the remaining join clauses.
+     */
+    cost_qual_eval(&qual_cost, other_quals, root);
+    build_cost = build_rel->cheapest_total_path->total_cost + build_rows * nkeys * cpu_operator_cost;
+    probe_cost = probe_rel->cheapest_total_path->total_cost - probe_rows * cpu_tuple_cost +
+                 probe_rows * nkeys * cpu_operator_cost;
+    startup_cost = build_cost + probe_rel->cheapest_total_path->startup_cost;
+    total_cost = build_cost + probe_cost + qual_cost.startup +
+                 joinrel->rows * (cpu_tuple_cost + qual_cost.per_tuple);
+
+    path = create_foreign_join_path(root,
+                                    joinrel,
+                                    NULL,
+                                    joinrel->rows,
+                                    startup_cost,
+                                    total_cost,
+                                    NIL,
+                                    NULL,
+                                    NULL,
+                                    list_make4(plan_private, scan_tlist, other_quals, NIL));
+    add_path(joinrel, (Path *) path);
+}
+
+/*
+ * The scan tuple of an upper ForeignScan holds the aggregates and grouping
+ * expressions computed by the scan, the columns of a limited scan, or those
+ * of the two tables of a join; the plan's target list and HAVING quals, or
+ * the remaining join clauses, are evaluated over it.
+ */
+ForeignScan *
+pixels_make_upper_plan(ForeignPath *best_path,
+                       List *tlist,
+                       Plan *outer_plan)
+{
+    List       *path_private = best_path->fdw_private;
+
+    return make_foreignscan(tlist,
+                            (List *) lthird(path_private),
+                            0,
+                            (List *) lfourth(path_private),
+                            (List *) linitial(path_private),
+                            (List *) lsecond(path_private),
+                            NIL,
+                            outer_plan);
+}
@@ -0,0 +1,176 @@
+//
+// Conversion of Pixels column vectors into Postgres Datums.
+//
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <string_view>
+#include <unordered_map>
+#include "TypeDescription.h"
+#include "vector/ColumnVector.h"
+#include "vector/LongColumnVector.h"
+#include "vector/DateColumnVector.h"
+#include "vector/DecimalColumnVector.h"
+#include "vector/BinaryColumnVector.h"
+#include "vector/TimestampColumnVector.h"
+#include "exception/PixelsReaderException.h"
+#include "string_t.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "fmgr.h"
+#include "utils/date.h"
+#include "utils/timestamp.h"
+#include "utils/numeric.h"
+}
+
+//! Widest decimal stored as one long per value
+#define PIXELS_FDW_MAX_DEC_WIDTH 18
+//! Most decimal digits a 128-bit integer holds
+#define PIXELS_FDW_MAX_LONG_DEC_WIDTH 38
+
+//! NUMERIC of value / 10^scale, for values of up to 38 decimal digits
+Datum PixelsMakeNumericDatum(__int128 value, int scale);
+
+//! Postgres timestamps count from 2000-01-01 instead of 1970-01-01
+#define PIXELS_UNIX_EPOCH_USECS \
+	((int64) (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * USECS_PER_DAY)
+
+//! Most distinct values of a string column cached for one morsel
+#define PIXELS_FDW_STRING_CACHE_SIZE 1024
+
+class PixelsColumnConverter;
+
+/*
+ * Varlenas of the distinct values of a string column, keyed by their bytes.
+ * The reader hands dictionary-encoded columns out as plain string vectors,
+ * so such columns are recognized by their values repeating: each distinct
+ * value is built once per morsel and every row refers to the cached Datum.
+ * A column with more distinct values than the cache holds stops using it
+ * until the next morsel.
+ */
+class PixelsStringCache {
+public:
+	PixelsStringCache(MemoryContext context, size_t capacity);
+	//! Returns the cached Datum of the value, or 0 once the cache is full
+	Datum Lookup(const string_t &value);
+	void Reset();
+
+	bool enabled;
+
+private:
+	//! Holds the cached varlenas, reset together with the cache
+	MemoryContext context;
+	size_t capacity;
+	std::unordered_map<std::string_view, Datum> entries;
+};
+
+//! Converts `count` values of the bound column vector, taking the rows listed
+//! in `selection` or the first `count` rows if it is null
+typedef void (*PixelsConvertFunction)(PixelsColumnConverter &converter,
+									  const uint32_t *selection,
+									  uint64_t count);
+
+class PixelsDatumOp {
+public:
+	struct Int16 {
+		static inline Datum Operation(const int &value, const PixelsColumnConverter &converter) {
+			return Int16GetDatum((int16) value);
+		}
+	};
+
+	struct Int32 {
+		static inline Datum Operation(const int &value, const PixelsColumnConverter &converter) {
+			return Int32GetDatum(value);
+		}
+	};
+
+	struct Int64 {
+		static inline Datum Operation(const long &value, const PixelsColumnConverter &converter) {
+			return Int64GetDatum(value);
+		}
+	};
+
+	struct Date {
+		static inline Datum Operation(const int &value, const PixelsColumnConverter &converter) {
+			return DateADTGetDatum(value + (UNIX_EPOCH_JDATE - POSTGRES_EPOCH_JDATE));
+		}
+	};
+
+	//! Pixels keeps microseconds since the Unix epoch, for TIMESTAMP and
+	//! TIMESTAMPTZ alike
+	struct Timestamp {
+		static inline Datum Operation(const long &value, const PixelsColumnConverter &converter) {
+			return TimestampGetDatum(value - PIXELS_UNIX_EPOCH_USECS);
+		}
+	};
+
+	struct Decimal {
+		static Datum Operation(const long &value, const PixelsColumnConverter &converter);
+	};
+};
+
+/*
+ * One entry of the converter table of a scan. The conversion functions are
+ * picked once per projected column from its type; per batch the converter is
+ * bound to the typed data of the column vector and fills `values` and `nulls`
+ * densely for the selected rows of the batch in one tight loop. Batches
+ * whose vector reports no nulls take a variant that never looks at the null
+ * flags; the others decode the flags first and only convert the valid rows.
+ */
+class PixelsColumnConverter {
+public:
+	PixelsColumnConverter(std::shared_ptr<TypeDescription> type,
+	                      int attnum,
+	                      int vector_index);
+	void Bind(const std::shared_ptr<ColumnVector> &vector);
+	void Convert(const uint32_t *selection, uint64_t count);
+	void Reserve(uint64_t count);
+	//! Caches the values of string columns in `context` across batches
+	void EnableStringCache(MemoryContext context);
+	void ResetStringCache();
+
+	//! Slot attribute the column is materialized into
+	int attnum;
+	//! Index of the column vector in the VectorizedRowBatch
+	int vector_index;
+	int scale;
+	std::unique_ptr<Datum[]> values;
+	std::unique_ptr<bool[]> nulls;
+	uint64_t capacity = 0;
+
+	//! Typed values and null flags of the bound column vector
+	const void *data = nullptr;
+	const uint8_t *is_null = nullptr;
+	bool has_nulls = false;
+	std::unique_ptr<PixelsStringCache> string_cache;
+
+private:
+	void DecodeNulls(const uint32_t *selection, uint64_t count);
+	template <class T, class OP, bool NULLABLE>
+	static void TemplatedConvert(PixelsColumnConverter &converter,
+								 const uint32_t *selection,
+								 uint64_t count);
+	template <bool NULLABLE>
+	static void ConvertString(PixelsColumnConverter &converter,
+							  const uint32_t *selection,
+							  uint64_t count);
+	template <bool NULLABLE>
+	static uint64_t CacheStrings(PixelsColumnConverter &converter,
+								 const uint32_t *selection,
+								 uint64_t count);
+	template <bool NULLABLE>
+	static void BuildStrings(PixelsColumnConverter &converter,
+							 const uint32_t *selection,
+							 uint64_t begin,
+							 uint64_t count);
+	template <class T, class OP>
+	void SetConvertFunctions();
+
+	TypeDescription::Category category;
+	//! Used for batches without nulls in the column
+	PixelsConvertFunction convert;
+	//! Used otherwise, after the null flags of the selected rows are decoded
+	PixelsConvertFunction convert_nulls;
+};
@@ -0,0 +1,43 @@
+//
+// Translation of planner restriction clauses into PixelsFilter trees.
+//
+#pragma once
+
+#include "PixelsFilter.hpp"
+#include "PixelsColumnConverter.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "nodes/pathnodes.h"
+#include "nodes/pg_list.h"
+}
+
+/*
+ * Filter trees travel through the plan in serialized form, one node being
+ * the list
+ * (type, column name, integer value, decimal value, string value, lchild,
+ *  rchild, param).
+ * `param` is NIL when the comparison value is known at plan time. Otherwise
+ * it is (index into fdw_exprs, value type, column type, column typmod), and
+ * the value is filled in when the scan begins, or on every rescan for the
+ * join clauses of a parameterized path.
+ */
+List *pixels_serialize_filter(PixelsFilter *filter);
+PixelsFilter *pixels_deserialize_filter(List *serialized,
+                                        Datum *param_values,
+                                        bool *param_nulls);
+
+//! Filter trees, one per column, for the clauses the pixels reader can
+//! evaluate; the values of Params are appended to `params`
+List *pixels_deparse_filters(RelOptInfo *baserel,
+                             Oid foreigntableid,
+                             List *clauses,
+                             List **params);
+//! Same for the join clauses of a parameterized path, whose values may be
+//! expressions over the outer relations, computed on every rescan
+List *pixels_deparse_join_filters(RelOptInfo *baserel,
+                                  Oid foreigntableid,
+                                  List *clauses,
+                                  List **params);
+//! Combines the serialized filter trees of the same column with AND
+List *pixels_merge_filters(List *filters);
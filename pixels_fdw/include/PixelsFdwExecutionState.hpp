@@ -4,8 +4,6 @@
 #pragma once
 
 #define STANDARD_VECTOR_SIZE 2048U
-#define PIXELS_FDW_MAX_DEC_WIDTH 18
-#define PIXELS_FDW_MAX_COLUMN_LENGTH INT64_MAX
 
 #include <fstream>
 #include <iostream>
@@ -17,6 +15,7 @@
 #include "PixelsReadLocalState.hpp"
 #include "PixelsReadBindData.hpp"
 #include "PixelsFilter.hpp"
+#include "PixelsFileStats.hpp"
 #include "physical/storage/LocalFS.h"
 #include "physical/natives/ByteBuffer.h"
 #include "physical/natives/DirectRandomAccessFile.h"
@@ -52,10 +51,28 @@ extern "C" {
 #include "catalog/pg_type.h"
 #include "executor/tuptable.h"
 #include "executor/spi.h"
+#include "access/parallel.h"
+#include "port/atomics.h"
+#include "storage/shmem.h"
+#include "utils/memutils.h"
 }
 
+#include "PixelsColumnConverter.hpp"
+
 using namespace std;
 
+//! Morsel cursor shared by every backend that takes part in a scan. For a
+//! parallel scan the leader places it in the DSM segment, otherwise it lives
+//! in backend-local memory owned by PixelsReadGlobalState.
+struct PixelsParallelScanDesc {
+	//! Index of the next morsel up for scanning
+	pg_atomic_uint32 next_morsel;
+
+	uint32 morsel_sum;
+
+	PixelsMorsel morsels[FLEXIBLE_ARRAY_MEMBER];
+};
+
 
 class PixelsFdwExecutionState {
 public:
@@ -74,32 +91,118 @@ public:
 	static vector<int> PixelsGetColumnMap(const shared_ptr<TypeDescription> file_schema,
 										  set<int> attrs_used,
 										  TupleDesc tupleDesc);
+	static void PixelsScanInitMorsels(const PixelsReadBindData &bind_data,
+									  PixelsReadGlobalState &parallel_state);
+	static void PixelsScanInitCursor(const PixelsReadBindData &bind_data,
+									 PixelsReadGlobalState &parallel_state);
+	static void PixelsResolveFilters(vector<PixelsFilter*> &filters,
+									 const shared_ptr<TypeDescription> file_schema);
+	static vector<PixelsColumnConverter> PixelsGetColumnConverters(const shared_ptr<TypeDescription> file_schema,
+																   const vector<int> &column_map);
+	static Size PixelsParallelScanDescSize(uint32 morsel_sum);
+	static void PixelsParallelScanDescInit(PixelsParallelScanDesc *desc,
+										   const vector<PixelsMorsel> &morsels);
 	static bool PixelsParallelStateNext(const PixelsReadBindData &bind_data,
 	                                    PixelsReadLocalState &scan_data,
 										PixelsReadGlobalState &parallel_state,
                                         bool is_init_state = false);
     static PixelsReaderOption GetPixelsReaderOption(PixelsReadLocalState &local_state,
 													PixelsReadGlobalState &global_state);
-	void GetNextOffsets();
+	static uint64_t PixelsBuildSelection(PixelsBitMask &filterMask,
+										 uint64_t count,
+										 uint32_t *selection);
+	void GetSelection(const std::shared_ptr<PixelsRecordReaderImpl> &currPixelsRecordReader);
+	void ReadNextBatch(const std::shared_ptr<PixelsRecordReaderImpl> &currPixelsRecordReader);
 	bool GetNextBatch();
+	void RestrictRowGroups(std::unordered_map<std::string, std::vector<bool>> row_groups);
+	void SetRowLimit(uint64_t row_limit, bool exact);
+	void OrderRowGroups(int attnum, bool descending, bool nulls_first);
+	void SetSortThreshold(int64_t value);
+	void KeepFileOrder();
+	void SetRuntimeFilters(List *serialized_filters, List *param_states, ExprContext *econtext);
 	bool next(TupleTableSlot* slot);
 	void rescan();
+	/*
+	 * Batch at a time access for the upper scans, which compute over the
+	 * column vectors instead of pulling rows through next(). NextBatch moves
+	 * on to the next batch with rows that passed the pushed-down filters;
+	 * only the columns passed to LimitConversion are converted into Datums.
+	 */
+	void LimitConversion(const set<int> &attnums);
+	bool NextBatch();
+	//! Rows of the current batch that passed, nullptr when every row did
+	const uint32_t *GetSelection();
+	uint64_t GetSelectionCount();
+	//! Column vector and file type of the slot attribute, nullptr if not read
+	std::shared_ptr<ColumnVector> GetColumnVector(int attnum);
+	std::shared_ptr<TypeDescription> GetColumnType(int attnum);
+	//! Stores the converted columns of the index-th selected row in the slot
+	void FillSlot(TupleTableSlot *slot, uint64_t index);
+	//! Converts the other columns for some rows of the batch only, and puts
+	//! those of the index-th of them in the slot, ahead of FillSlot
+	void ConvertDeferred(const uint32_t *rows, uint64_t count);
+	void FillDeferred(TupleTableSlot *slot, uint64_t index);
+	Size EstimateParallelScan();
+	void InitializeParallelScan(void *coordinate);
+	void ReInitializeParallelScan(void *coordinate);
+	void AttachParallelScan(void *coordinate);
 private:
+	void ReleaseLocalScan();
+	void ResetMorsels();
+	void ResolveRuntimeFilters();
+	void ResetMorselData();
+	void InitSlot(TupleTableSlot *slot);
+	void LoadStrideVerdicts();
+	void SetStrideVerdicts();
 	vector<string> files_list;
 	vector<PixelsFilter*> filters_list;
 	set<int> attrs_used;
 	vector<int> column_map;
+	vector<PixelsColumnConverter> converters;
+	//! Columns left out by LimitConversion, converted on demand
+	vector<PixelsColumnConverter> deferred_converters;
+	//! Index in the VectorizedRowBatch of each slot attribute, -1 if not read
+	vector<int> vector_indexes;
+	vector<shared_ptr<TypeDescription>> column_types;
+	bool slot_initialized = false;
+	//! Holds the by-reference Datums of the current batch
+	MemoryContext batch_cxt;
+	//! Holds the Datums cached across the batches of the current morsel
+	MemoryContext morsel_cxt;
 	vector<Oid> types;
 	TupleDesc tuple_desc;
-	int64_t cur_row_index = -1;
-	map<int, int> masked_next_offsets;
+	//! Rows of the current batch that passed the pushed-down filters
+	vector<uint32_t> selection;
+	//! Every row of the current batch passed, the selection is the identity
+	bool selection_all = true;
+	uint64_t selection_count = 0;
+	//! Next selected row to return
+	uint64_t selection_index = 0;
 	unique_ptr<PixelsReadBindData> bind_data;
 	unique_ptr<PixelsReadLocalState> scan_data; 
 	unique_ptr<PixelsReadGlobalState> parallel_state;
+	PixelsParallelScanDesc *shared_desc = nullptr;
+	bool scan_initialized = false;
 	PixelsReaderOption reader_option;
 	vector<string> selected_column_name;
 	vector<string> selected_column_idx;
 	bool enable_filter_pushdown = true;
+	//! Verdicts of the filters for the pixel strides of the current morsel,
+	//! stride after stride; empty when the batches do not line up with strides
+	vector<PixelsFilterVerdict> stride_verdicts;
+	//! Stride of the current morsel that the next batch covers
+	size_t stride_index = 0;
+	//! Verdict of all filters for the current batch
+	PixelsFilterVerdict batch_verdict = PixelsFilterVerdict::SOME;
+	//! Serialized filters and the ExprStates of their Params, taken again
+	//! on every rescan when set by SetRuntimeFilters
+	List *runtime_filters = NIL;
+	List *runtime_params = NIL;
+	ExprContext *runtime_econtext = nullptr;
+	//! Holds the values of the filters taken at run time
+	MemoryContext runtime_cxt = nullptr;
+	//! The filters are taken again before the next fetch
+	bool runtime_pending = false;
 };
 
 PixelsFdwExecutionState* createPixelsFdwExecutionState(List* files,
@@ -0,0 +1,59 @@
+//
+// Ordered scan of a table whose pixels files are each sorted on a key.
+//
+#pragma once
+
+#include "PixelsFdwExecutionState.hpp"
+
+extern "C" {
+#include "utils/tuplesort.h"
+}
+
+//! A key the files are sorted on: the slot attribute, zero-based, and the
+//! order, with nulls where Postgres puts them by default
+struct PixelsOrderKey {
+	int attnum;
+	bool descending;
+	bool nulls_first;
+};
+
+/*
+ * Files sorted on `column`, split into runs whose files hold ranges of the
+ * column that follow one another in the sort order, so that a run is
+ * sorted when scanned file after file. Files with nulls or without
+ * statistics of the column get a run of their own. With `strict`, the
+ * ranges of a run may not even touch, for a sort on further columns.
+ */
+std::vector<std::vector<size_t>> PixelsSortedRuns(const std::vector<std::shared_ptr<const PixelsFileStats>> &file_stats,
+												  const std::string &column,
+												  bool descending,
+												  bool strict);
+
+/*
+ * Scans the files of a single run one after the other, in the order of
+ * their ranges. Runs are not merged: the reader's buffer pool is shared by
+ * every scan of the backend, so scans cannot read side by side, and the
+ * planner only orders a table whose files form one run. Should the files
+ * have changed since, the rows are sorted by a tuplesort instead.
+ */
+class PixelsFdwOrderedState {
+public:
+	PixelsFdwOrderedState(List *files,
+						  List *serialized_filters,
+						  Datum *param_values,
+						  bool *param_nulls,
+						  set<int> attrs_used,
+						  TupleDesc tuple_desc,
+						  vector<PixelsOrderKey> keys);
+	~PixelsFdwOrderedState();
+	bool next(TupleTableSlot *slot);
+	void rescan();
+private:
+	unique_ptr<PixelsFdwExecutionState> scan;
+	//! Sorts the rows of files that no longer form one run, nullptr when
+	//! they do
+	Tuplesortstate *sort = nullptr;
+	bool sorted = false;
+	//! Row taken from the sort
+	TupleTableSlot *sort_slot = nullptr;
+};
@@ -20,6 +20,7 @@
 #include "PixelsReaderImpl.h"
 #include "PixelsReaderBuilder.h"
 #include "PixelsFilter.hpp"
+#include "PixelsFileStats.hpp"
 #include <iostream>
 #include <future>
 #include <thread>
@@ -52,17 +53,33 @@ public:
 	PixelsFdwPlanState(List* files,
                        List* filters,
                        List* options);
-    ~PixelsFdwPlanState();
 	List*& getFilesList();
     List*& getFiltersList();
     uint64_t getRowCount();
+    uint64_t getTotalBytes();
+    const std::vector<std::shared_ptr<const PixelsFileStats>> &getFileStats();
+    uint64_t getScannedRowCount();
+    void EstimateRowGroupPruning(const std::vector<PixelsFilter*> &filters);
+    double EstimateScanBytes(const std::vector<std::string> &columns);
+    double EstimateLookupFraction(const std::string &column);
     Bitmapset* attrs_used;
+    //! Serialized filter trees pushed down to the reader, one per column
+    List* pushdown_filters = NIL;
+    //! Params whose values the pushed down filters compare with
+    List* pushdown_params = NIL;
+    //! Bytes the scan reads, set when the scan is costed
+    double scan_bytes = 0;
 
 private:
-	std::shared_ptr<PixelsReader> initialPixelsReader;
+	std::vector<std::shared_ptr<const PixelsFileStats>> file_stats;
 	List* files_list = NIL;
     List* filters_list = NIL;
     uint64_t row_count;
+    uint64_t total_bytes;
+    //! Rows in the row groups that survive pruning by the pushed down filters
+    uint64_t scanned_row_count;
+    //! scanned_row_count of each file, in the order of file_stats
+    std::vector<uint64_t> file_scanned_rows;
     List* plan_options;
 };
 
@@ -0,0 +1,201 @@
+//
+// Execution of an upper ForeignScan, which stands in for the plan steps
+// above a pixels table scan, or for the join of two of them.
+//
+#pragma once
+
+#include "PixelsFdwExecutionState.hpp"
+#include "PixelsGroupTable.hpp"
+#include "PixelsUpper.hpp"
+
+extern "C" {
+#include "nodes/execnodes.h"
+#include "utils/tuplesort.h"
+}
+
+//! Running state of one aggregate computed over the batches, by group
+struct PixelsAggregateState {
+	PixelsAggregateKind kind;
+	//! Type of the aggregate's result
+	Oid result_type;
+	std::unique_ptr<PixelsAggregateArg> arg;
+	//! Rows counted, values summed or compared so far
+	vector<int64> counts;
+	vector<__int128> sums;
+	//! Part of the sum that would have overflowed 128 bits, a NUMERIC
+	vector<Datum> sum_overflows;
+	//! Minimum or maximum so far, once the count is positive
+	vector<__int128> bounds;
+};
+
+//! A sort key of a top-N scan: the slot attribute, zero-based, and the order
+struct PixelsSortKey {
+	int attnum;
+	bool descending;
+	bool nulls_first;
+};
+
+//! A row kept by a top-N scan, with the values of its sort keys as kept in
+//! the file
+struct PixelsTopNRow {
+	vector<int64_t> keys;
+	vector<uint8_t> nulls;
+	MinimalTuple tuple;
+};
+
+class PixelsFdwUpperState {
+public:
+	PixelsFdwUpperState(ForeignScanState *node,
+						List *files,
+						List *filters,
+						set<int> attrs_used,
+						List *upper);
+	~PixelsFdwUpperState();
+	bool next(TupleTableSlot *slot);
+	void rescan();
+	PixelsUpperKind getKind();
+private:
+	void ComputeMetadata();
+	void InitAggregates(ForeignScanState *node,
+						List *files,
+						List *filters,
+						set<int> attrs_used,
+						List *quals);
+	void ComputeAggregates();
+	void InitLimit(ForeignScanState *node,
+				   List *files,
+				   List *filters,
+				   set<int> attrs_used,
+				   List *upper);
+	void ComputeLimit();
+	bool NextLimited(TupleTableSlot *slot);
+	void InitTopN(ForeignScanState *node,
+				  List *files,
+				  List *filters,
+				  set<int> attrs_used,
+				  List *upper);
+	void ComputeTopN();
+	void TopNBatch(const uint32_t *rows, const uint32_t *positions, uint64_t count);
+	void TopNToSort();
+	bool RowBefore(uint64_t row, const PixelsTopNRow &kept);
+	bool KeptBefore(const PixelsTopNRow &a, const PixelsTopNRow &b);
+	void ProjectTableRow(TupleTableSlot *from, TupleTableSlot *slot);
+	void InitJoin(ForeignScanState *node,
+				  List *files,
+				  List *filters,
+				  set<int> attrs_used,
+				  List *upper);
+	void ComputeJoinTable();
+	bool ProbeBatch();
+	bool NextJoined(TupleTableSlot *slot);
+	void AggregateBatch(PixelsAggregateState &state,
+						const uint32_t *rows,
+						uint64_t count,
+						const uint32_t *groups);
+	void ResizeAggregates(uint32_t group_count);
+	Datum FinalizeAggregate(PixelsAggregateState &state, uint32_t group, bool *isnull);
+	PixelsUpperKind kind;
+	Oid relid;
+	vector<string> files_list;
+	//! Entries of the scan tuple, the aggregates computed by the scan
+	List *scan_tlist;
+	//! Values of the one row answered from the footers
+	vector<Datum> values;
+	vector<bool> nulls;
+	bool computed = false;
+	//! Groups returned so far
+	uint32_t next_group = 0;
+	uint32_t group_count = 0;
+	//! Scan of the table the aggregates are computed over
+	unique_ptr<PixelsFdwExecutionState> table_scan;
+	vector<PixelsAggregateState> aggregates;
+	//! Groups of a grouped aggregation, nullptr when there is a single group
+	unique_ptr<PixelsGroupTable> group_table;
+	//! Group of each row of the current batch
+	vector<uint32_t> groups;
+	//! For each entry of the scan tuple, the grouping column or the
+	//! aggregate it holds, -1 for the other
+	vector<int> tlist_keys;
+	vector<int> tlist_aggregates;
+	//! Restriction clauses of the table, checked on the rows of each batch
+	ExprState *qual = nullptr;
+	ExprContext *qual_cxt = nullptr;
+	//! Row of the table the restriction clauses are checked on
+	TupleTableSlot *table_slot = nullptr;
+	//! Rows of the current batch that passed the restriction clauses
+	vector<uint32_t> passed;
+	//! Argument values of the current batch
+	vector<__int128> arg_values;
+	vector<uint8_t> arg_nulls;
+	//! LIMIT and OFFSET of a limited scan, nullptr when absent
+	ExprState *limit_count = nullptr;
+	ExprState *limit_offset = nullptr;
+	ExprContext *limit_cxt = nullptr;
+	//! Rows to return, -1 for all of them, and to skip first
+	int64 count = -1;
+	int64 offset = 0;
+	//! Rows of the table returned and skipped so far
+	int64 returned = 0;
+	int64 skipped = 0;
+	//! Every row read is returned or skipped, none is dropped by a filter
+	bool exact_limit = false;
+	//! Sort keys of a top-N scan and the best rows so far, as a heap with
+	//! the last of them on top; sorted once the scan is done
+	vector<PixelsSortKey> sort_keys;
+	vector<PixelsTopNRow> top_rows;
+	//! Rows a top-N scan keeps, LIMIT plus OFFSET
+	uint64_t top_bound = 0;
+	size_t next_row = 0;
+	//! Takes the rows instead of the heap once they outgrow work_mem, or
+	//! when there is no bound
+	Tuplesortstate *top_sort = nullptr;
+	//! Values of the sort keys for the rows of the current batch
+	vector<vector<int64_t>> key_values;
+	vector<vector<uint8_t>> key_nulls;
+	//! Rows of the current batch that may get into the heap
+	vector<uint32_t> candidates;
+	vector<uint32_t> candidate_rows;
+	//! Positions in the selection of the rows that passed the quals
+	vector<uint32_t> positions;
+	//! Row of the table taken from the heap, or from the rows a join keeps
+	TupleTableSlot *top_slot = nullptr;
+	//! Scan of the table a join probes with, its row and restriction
+	//! clauses, checked on the rows of each batch before the lookup
+	unique_ptr<PixelsFdwExecutionState> probe_scan;
+	TupleTableSlot *probe_slot = nullptr;
+	ExprState *probe_qual = nullptr;
+	ExprContext *probe_qual_cxt = nullptr;
+	//! Slot attributes of the probed table compared with the grouping
+	//! columns of the built one, pairwise
+	vector<int> probe_keys;
+	//! Rows of the built table, with the first row of each group and the
+	//! next row of the same group of each row, UINT32_MAX ending the chain
+	vector<MinimalTuple> join_rows;
+	vector<uint32_t> group_first;
+	vector<uint32_t> row_next;
+	//! Rows of the current probe batch whose keys are in the table: their
+	//! index in the batch, position in the selection and group
+	vector<uint32_t> match_rows;
+	vector<uint32_t> match_positions;
+	vector<uint32_t> match_groups;
+	size_t next_match = 0;
+	//! Row of the built table joined next with the probe row, UINT32_MAX
+	//! once the probe row is done with
+	uint32_t join_row = UINT32_MAX;
+	//! For each entry of the scan tuple of a join, the table it comes from,
+	//! 0 for the built one and 1 for the probed one, and its attribute,
+	//! zero-based
+	vector<int> tlist_sides;
+	vector<int> tlist_attnums;
+	//! Holds the sums carried over into NUMERICs, or the rows kept by a
+	//! top-N scan, until the scan is done with
+	MemoryContext result_cxt = nullptr;
+	//! Holds the values of the row last returned
+	MemoryContext row_cxt = nullptr;
+};
+
+PixelsFdwUpperState *createPixelsFdwUpperState(ForeignScanState *node,
+											   List *files,
+											   List *filters,
+											   set<int> attrs_used,
+											   List *upper);
@@ -0,0 +1,48 @@
+//
+// Footer statistics of the pixels files of a table, read concurrently and
+// kept by the backend for the files used last.
+//
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "TypeDescription.h"
+#include "pixels.pb.h"
+
+//! Upper bound on the threads reading footers at once
+#define PIXELS_FDW_FOOTER_THREADS 8
+//! Files whose footers the backend keeps at most, the least recently used
+//! ones being dropped first (pixels_fdw.file_stats_cache_size)
+extern "C" int pixels_file_stats_cache_size;
+
+struct PixelsFileStats {
+    std::string path;
+    //! Modification time and size of the file when the footer was read,
+    //! -1 if the file could not be stat'ed and is not cached
+    int64_t mtime = -1;
+    int64_t size = -1;
+    //! Distinct for every footer read by the backend, so that what is
+    //! derived from the footers of a table can tell when one was read again
+    uint64_t generation = 0;
+    uint64_t row_count = 0;
+    //! Bytes of column chunk data in the row groups
+    uint64_t data_bytes = 0;
+    //! Share of data_bytes taken by each column, from the chunk lengths of
+    //! the first row group, so it reflects encoding and compression
+    std::vector<uint64_t> column_bytes;
+    std::shared_ptr<TypeDescription> schema;
+    pixels::proto::Footer footer;
+};
+
+/*
+ * Statistics of `files`, in the same order. A cached footer is used as long
+ * as the file keeps its modification time and size, and dropped once the
+ * file cannot be stat'ed. The footers of `files` are never dropped to make
+ * room for each other, so a table with more files than the cache holds
+ * keeps all of them until other files are loaded. Footers that are not cached yet are read on up
+ * to PIXELS_FDW_FOOTER_THREADS threads; the threads do not touch any
+ * postgres facility, and an exception raised by one of them is rethrown in
+ * the calling thread.
+ */
+std::vector<std::shared_ptr<const PixelsFileStats>> PixelsLoadFileStats(const std::vector<std::string> &files);
@@ -6,8 +6,10 @@
 #include <bitset>
 #include "PixelsBitMask.h"
 #include "vector/ColumnVector.h"
+#include "vector/TimestampColumnVector.h"
 #include "TypeDescription.h"
 #include "string_t.hpp"
+#include "pixels.pb.h"
 #include <cmath>
 #include <immintrin.h>
 #include <avxintrin.h>
@@ -19,7 +21,15 @@ enum class PixelsFilterType : uint8_t {
     COMPARE_GTEQ,
     COMPARE_LTEQ,
     COMPARE_GT,
-    COMPARE_LT
+    COMPARE_LT,
+    COMPARE_NE
+};
+
+//! What the statistics of a column chunk tell about the rows passing a filter
+enum class PixelsFilterVerdict : uint8_t {
+    NONE = 0,   // no row can pass
+    SOME,       // the rows have to be checked
+    ALL         // every row passes
 };
 
 class PixelsFilterOp {
@@ -31,6 +41,13 @@ public:
 	    }
     };
 
+    struct NotEquals {
+	    template <class T>
+	    static inline bool Operation(const T &left, const T &right) {
+		    return !Equals::Operation(left, right);
+	    }
+    };
+
     struct GreaterThan {
 	    template <class T>
 	    static inline bool Operation(const T &left, const T &right) {
@@ -79,9 +96,14 @@ public:
     PixelsFilter *getRChild();
     void setRChild(PixelsFilter *rc);
     PixelsFilter *copy();
+    void setStrideVerdict(PixelsFilterVerdict verdict);
     void ApplyFilter(std::shared_ptr<ColumnVector> vector,
                      PixelsBitMask& filterMask,
                      std::shared_ptr<TypeDescription> type);
+    PixelsFilterVerdict CheckStatistics(const pixels::proto::ColumnStatistic &stats,
+                                        std::shared_ptr<TypeDescription> type);
+    template <class T>
+    PixelsFilterVerdict CheckRange(const T &min, const T &max, const T &constant, bool has_null);
     template <class T, class OP>
     static int CompareAvx2(void * data, T constant);
     template <class OP>
@@ -107,8 +129,17 @@ private:
     string_t string_value;
     PixelsFilter *lchild = nullptr;
     PixelsFilter *rchild = nullptr;
+    //! Verdict of the statistics of the pixel stride being filtered, lets
+    //! ApplyFilter skip the kernel when it already decides every row
+    PixelsFilterVerdict stride_verdict = PixelsFilterVerdict::SOME;
 };
 
+//! Checks the filters, one per column, against the column chunk statistics
+//! of a row group; columns are looked up in `schema` by name
+PixelsFilterVerdict PixelsCheckRowGroup(const std::vector<PixelsFilter*> &filters,
+                                        const pixels::proto::RowGroupStatistic &stats,
+                                        std::shared_ptr<TypeDescription> schema);
+
 PixelsFilter* createPixelsFilter(PixelsFilterType type,
                                  std::string cname,
                                  const long ivalue,
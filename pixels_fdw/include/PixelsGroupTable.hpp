@@ -0,0 +1,99 @@
+//
+// Hash table of the groups of an aggregation computed over the batches,
+// also the table a join builds on one side and probes with the other.
+//
+#pragma once
+
+#include "PixelsFdwExecutionState.hpp"
+#include <string_view>
+
+//! Smallest number of slots of the group table, a power of two
+#define PIXELS_FDW_GROUP_TABLE_MIN_SLOTS 1024
+//! Group of a row whose keys are not in the table
+#define PIXELS_FDW_NO_GROUP UINT32_MAX
+//! Bytes of the running state of one aggregate in one group at most
+#define PIXELS_FDW_AGGREGATE_GROUP_SIZE (sizeof(int64) + 2 * sizeof(__int128) + sizeof(Datum))
+
+//! Values of `count` rows of an integer, date or timestamp column vector as
+//! kept in the file, taking the rows listed in `rows` or the first `count`
+//! rows if it is null, and their null flags
+void PixelsLoadIntegerKeys(const std::shared_ptr<ColumnVector> &column_vector,
+						   TypeDescription::Category category,
+						   const uint32_t *rows,
+						   uint64_t count,
+						   int64_t *values,
+						   uint8_t *nulls);
+
+//! A grouping column: the slot attribute it is read into, zero-based, and
+//! its Postgres type
+struct PixelsGroupKey {
+	int attnum;
+	Oid type;
+};
+
+/*
+ * Open-addressing hash table of the groups, probed linearly. A slot holds
+ * the hash and the index of a group, so that probing stays within the slot
+ * array until the hashes match; the keys themselves are kept column by
+ * column, indexed by group. The keys of a batch are hashed one column at a
+ * time before the rows are looked up. Nulls form a group of their own, as
+ * in GROUP BY.
+ */
+class PixelsGroupTable {
+public:
+	PixelsGroupTable(const vector<PixelsGroupKey> &keys,
+					 PixelsFdwExecutionState &scan);
+	//! Sets the group of each of `count` rows of the batch, taking the rows
+	//! listed in `rows` or the first `count` rows if it is null; groups not
+	//! seen before are added
+	void FindGroups(const uint32_t *rows, uint64_t count, uint32_t *groups);
+	//! Same for rows of another scan, keyed by its slot attributes
+	//! `attnums`, without adding groups: rows whose keys are not in the
+	//! table, or hold a null, get PIXELS_FDW_NO_GROUP, as in a join
+	void LookupGroups(PixelsFdwExecutionState &probe,
+					  const vector<int> &attnums,
+					  const uint32_t *rows,
+					  uint64_t count,
+					  uint32_t *groups);
+	uint32_t GroupCount();
+	//! Value of the key-th grouping column of the group
+	Datum GetKey(int key, uint32_t group, bool *isnull);
+	void Reset();
+	//! Bytes a group takes in the table for the key types, to size it in
+	//! advance of the scan
+	static size_t EstimateGroupSize(const vector<Oid> &key_types);
+
+private:
+	struct Slot {
+		uint64_t hash;
+		//! Index of the group plus one, zero for an empty slot
+		uint32_t group;
+	};
+	//! Values of one grouping column, for the rows of a batch and by group
+	struct KeyColumn {
+		PixelsGroupKey key;
+		bool is_string;
+		vector<int64_t> batch_values;
+		vector<string_t> batch_strings;
+		vector<uint8_t> batch_nulls;
+		vector<int64_t> values;
+		vector<std::string> strings;
+		vector<uint8_t> nulls;
+	};
+	void LoadKeys(KeyColumn &column,
+				  PixelsFdwExecutionState &from,
+				  int attnum,
+				  const uint32_t *rows,
+				  uint64_t count);
+	void HashKeys(uint64_t count);
+	bool KeysEqual(uint64_t row, uint32_t group);
+	uint32_t AddGroup(uint64_t row, uint64_t hash);
+	void Grow();
+
+	PixelsFdwExecutionState &scan;
+	vector<KeyColumn> columns;
+	vector<Slot> slots;
+	uint64_t mask;
+	vector<uint64_t> group_hashes;
+	vector<uint64_t> hashes;
+};
@@ -8,6 +8,7 @@
 
 #include "PixelsReader.h"
 #include "PixelsFilter.hpp"
+#include <unordered_map>
 
 
 struct PixelsReadBindData {
@@ -16,6 +17,22 @@ struct PixelsReadBindData {
 	std::vector<std::string> files;
 	std::vector<PixelsFilter*> filters;
 	std::atomic<uint64_t> curFileId;
+	//! When not empty, only the row groups flagged here are scanned, by file
+	std::unordered_map<std::string, std::vector<bool>> row_groups;
+	//! Rows the scan is asked for at most, zero for all of them; a limited
+	//! scan takes one row group per morsel
+	uint64_t row_limit = 0;
+	//! Every row read counts towards row_limit, so that no row group past
+	//! the limit needs to be scheduled nor read ahead
+	bool row_limit_exact = false;
+	//! When not empty, the morsels are visited in the order of the best value
+	//! their row groups may hold in this column, for a sort on it
+	std::string order_column;
+	bool order_descending = false;
+	bool order_nulls_first = false;
+	//! The morsels are visited file after file in the order of `files`, for
+	//! files that are sorted one after the other
+	bool keep_file_order = false;
 };
 
 #endif // EXAMPLE_C_PIXELSREADBINDDATA_HPP
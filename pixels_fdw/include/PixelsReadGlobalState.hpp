@@ -1,26 +1,70 @@
 //
 // Created by liyu on 3/26/23.
 //
+#pragma once
 
 #include "PixelsReader.h"
+#include "PixelsFooterCache.h"
+#include "PixelsFileStats.hpp"
 #include "physical/StorageArrayScheduler.h"
 
-struct PixelsReadGlobalState {
-	std::mutex lock;
+struct PixelsParallelScanDesc;
+
+//! Unit of work handed out by the scan cursor: a range of row groups in one file
+struct PixelsMorsel {
+	//! Storage device and index of the file on that device
+	uint32_t device_id;
+	uint32_t file_index;
+
+	//! Row group range, as taken by PixelsReaderOption::setRGRange
+	uint32_t rg_start;
+	uint32_t rg_len;
+};
+
+//! Best value the rows of a morsel may hold in the column the morsels are
+//! ordered by, from the statistics of its row groups
+struct PixelsMorselBound {
+	//! False when statistics are missing, the rows may hold any value
+	bool known;
+	bool is_null;
+	int64_t value;
+};
 
+struct PixelsReadGlobalState {
 	//! The initial reader from the bind phase
 	std::shared_ptr<PixelsReader> initialPixelsReader;
 
 	//! Mutexes to wait for a file that is currently being opened
 	std::unique_ptr<std::mutex[]> file_mutexes;
 
-	//! Signal to other threads that a file failed to open, letting every thread abort.
-	bool error_opening_file = false;
-
     std::shared_ptr<StorageArrayScheduler> storageArrayScheduler;
 
-	//! Index of file currently up for scanning
-	std::vector<uint64_t> file_index;
+	//! Footers of the files opened so far, kept across rescans so that a
+	//! file is not parsed again every time the scan gets to it
+	std::shared_ptr<PixelsFooterCache> footer_cache;
+
+	//! Footer statistics of the files, in the order the morsels visit them;
+	//! loaded with the first morsels and kept across rescans, which only
+	//! prune the row groups again
+	std::vector<std::shared_ptr<const PixelsFileStats>> file_stats;
+
+	//! Morsels of the scan, only built by the backend that sets up the cursor
+	std::vector<PixelsMorsel> morsels;
+	//! Set once morsels is built, which may leave it empty when every row
+	//! group is pruned
+	bool morsels_initialized = false;
+	//! Bound of each morsel when they are ordered by a column, else empty
+	std::vector<PixelsMorselBound> morsel_bounds;
+	//! Only rows sorting before this value in the column the morsels are
+	//! ordered by are still wanted, once has_sort_threshold is set
+	int64_t sort_threshold = 0;
+	bool has_sort_threshold = false;
+
+	//! Shared scan cursor, points into the DSM segment for parallel scans
+	PixelsParallelScanDesc *parallel_desc = nullptr;
+
+	//! Backing storage of parallel_desc when the scan is not parallel
+	std::unique_ptr<char[]> local_desc;
 
 	//! Batch index of the next row group to be scanned
 	uint64_t batch_index;
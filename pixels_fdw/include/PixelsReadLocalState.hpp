@@ -6,6 +6,7 @@
 #include "PixelsReader.h"
 #include "PixelsFilter.hpp"
 #include "reader/PixelsRecordReader.h"
+#include "PixelsReadGlobalState.hpp"
 
 struct PixelsReadLocalState {
     PixelsReadLocalState() {
@@ -19,6 +20,8 @@ struct PixelsReadLocalState {
         vectorizedRowBatch = nullptr;
         currReader = nullptr;
         nextReader = nullptr;
+        curr_morsel_index = 0;
+        next_morsel_index = 0;
     }
 	std::shared_ptr<PixelsRecordReader> currPixelsRecordReader;
     std::shared_ptr<PixelsRecordReader> nextPixelsRecordReader;
@@ -36,5 +39,9 @@ struct PixelsReadLocalState {
     uint64_t next_batch_index;
     std::string next_file_name;
     std::string curr_file_name;
+    PixelsMorsel curr_morsel;
+    PixelsMorsel next_morsel;
+    uint32_t curr_morsel_index;
+    uint32_t next_morsel_index;
 
 };
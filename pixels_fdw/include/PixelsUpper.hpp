@@ -0,0 +1,128 @@
+//
+// Pushdown of the plan steps above a pixels table scan.
+//
+#pragma once
+
+#include "PixelsFileStats.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "nodes/pathnodes.h"
+#include "nodes/plannodes.h"
+#include "nodes/primnodes.h"
+#include "optimizer/optimizer.h"
+}
+
+/*
+ * What an upper ForeignScan computes in place of the plan above the scan.
+ * Its fdw_private has a fourth element,
+ * (kind, relation oid, quals[, limit count, limit offset[, sort keys]]),
+ * where quals are the restriction clauses of the table, which the upper
+ * scan checks itself since no scan node is left to check them. The limit
+ * expressions of PIXELS_UPPER_LIMIT and PIXELS_UPPER_TOPN are NULL when
+ * absent; each sort key of PIXELS_UPPER_TOPN is an integer list of
+ * (attribute number, descending, nulls first).
+ *
+ * A join of two tables is an upper scan of the table it builds on, whose
+ * fourth element is
+ * (PIXELS_UPPER_JOIN, (build oid, probe oid), build quals, probe quals,
+ *  (probe files, probe filters, probe attrs used), build keys, probe keys,
+ *  scan tuple sides, scan tuple attribute numbers),
+ * the keys being the attribute numbers compared for equality pairwise, and
+ * each entry of the scan tuple taken from the column of the given number of
+ * the build side, 0, or of the probe side, 1.
+ */
+typedef enum PixelsUpperKind
+{
+    PIXELS_UPPER_METADATA = 1,      /* aggregates answered from the footers */
+    PIXELS_UPPER_AGGREGATE,         /* aggregates computed over the batches */
+    PIXELS_UPPER_LIMIT,             /* rows of the table up to a LIMIT */
+    PIXELS_UPPER_TOPN,              /* first rows of the table in an order */
+    PIXELS_UPPER_JOIN               /* hash join with another table */
+} PixelsUpperKind;
+
+typedef enum PixelsAggregateKind
+{
+    PIXELS_AGG_COUNT_STAR = 0,
+    PIXELS_AGG_COUNT,
+    PIXELS_AGG_SUM,
+    PIXELS_AGG_AVG,
+    PIXELS_AGG_MIN,
+    PIXELS_AGG_MAX
+} PixelsAggregateKind;
+
+//! Kind and argument of a plain built-in aggregate with one argument, `arg`
+//! is NULL for count(*)
+bool pixels_aggregate_kind(Aggref *aggref, PixelsAggregateKind *kind, Expr **arg);
+
+typedef enum PixelsArgOp
+{
+    PIXELS_ARG_COLUMN,
+    PIXELS_ARG_CONST,
+    PIXELS_ARG_ADD,
+    PIXELS_ARG_SUB,
+    PIXELS_ARG_MUL
+} PixelsArgOp;
+
+/*
+ * Argument of an aggregate computed over the batches: a column, a numeric
+ * constant, or the sum, difference or product of two numeric arguments.
+ * Values are computed as integers scaled by 10^scale; the precision bounds
+ * the digits of every value, so that no value of at most 38 digits can
+ * overflow 128 bits.
+ */
+struct PixelsAggregateArg
+{
+    PixelsArgOp op;
+    //! Postgres type of the value
+    Oid         type;
+    int         precision;
+    int         scale;
+    //! Slot attribute of a column, zero-based
+    int         attnum;
+    //! Scaled value of a constant
+    __int128    value;
+    std::unique_ptr<PixelsAggregateArg> left;
+    std::unique_ptr<PixelsAggregateArg> right;
+};
+
+//! Argument tree of the expression, nullptr when it cannot be computed over
+//! the batches
+std::unique_ptr<PixelsAggregateArg> pixels_compile_aggregate_arg(Expr *expr);
+//! Sets precision and scale of the columns from the types they have in the
+//! file and recomputes them up the tree; false if some value may not fit
+bool pixels_bind_aggregate_arg(PixelsAggregateArg &arg,
+                               const std::vector<std::shared_ptr<TypeDescription>> &column_types);
+//! Whether the aggregate can be computed over the batches
+bool pixels_vectorized_aggregate(Aggref *aggref);
+
+//! Datum of a value kept in column statistics, which hold dates and
+//! timestamps in days and microseconds since the Unix epoch
+Datum pixels_statistic_datum(Oid type, int64_t value);
+
+/*
+ * Computes count(*), count, min or max of `column` from the row group
+ * statistics of the files. Returns false, leaving the result alone, when
+ * some statistics needed are missing; `value` may be NULL to only check.
+ */
+bool pixels_footer_aggregate(const std::vector<std::shared_ptr<const PixelsFileStats>> &file_stats,
+                             PixelsAggregateKind kind,
+                             const char *column,
+                             Oid type,
+                             Datum *value,
+                             bool *isnull);
+
+void pixels_add_upper_paths(PlannerInfo *root,
+                            UpperRelationKind stage,
+                            RelOptInfo *input_rel,
+                            RelOptInfo *output_rel,
+                            void *extra);
+void pixels_add_join_paths(PlannerInfo *root,
+                           RelOptInfo *joinrel,
+                           RelOptInfo *outerrel,
+                           RelOptInfo *innerrel,
+                           JoinType jointype,
+                           JoinPathExtraData *extra);
+ForeignScan *pixels_make_upper_plan(ForeignPath *best_path,
+                                    List *tlist,
+                                    Plan *outer_plan);
@@ -3,12 +3,20 @@
 
 #include "commands/explain.h"
 #include "foreign/fdwapi.h"
+#include "utils/guc.h"
 
 
 PG_MODULE_MAGIC;
 
 void _PG_init(void);
 
+/* planner cost parameters */
+double pixels_byte_cost = 1.0 / BLCKSZ;
+double pixels_value_decode_cost = 0.0005;
+
+/* footers kept by the backend, see PixelsFileStats.hpp */
+int pixels_file_stats_cache_size = 1024;
+
 /* FDW routines */
 extern void pixelsGetForeignRelSize(PlannerInfo *root,
                       RelOptInfo *baserel,
@@ -23,6 +31,17 @@ extern ForeignScan *pixelsGetForeignPlan(PlannerInfo *root,
                       List *tlist,
                       List *scan_clauses,
                       Plan *outer_plan);
+extern void pixelsGetForeignUpperPaths(PlannerInfo *root,
+                                       UpperRelationKind stage,
+                                       RelOptInfo *input_rel,
+                                       RelOptInfo *output_rel,
+                                       void *extra);
+extern void pixelsGetForeignJoinPaths(PlannerInfo *root,
+                                      RelOptInfo *joinrel,
+                                      RelOptInfo *outerrel,
+                                      RelOptInfo *innerrel,
+                                      JoinType jointype,
+                                      JoinPathExtraData *extra);
 extern TupleTableSlot *pixelsIterateForeignScan(ForeignScanState *node);
 extern void pixelsBeginForeignScan(ForeignScanState *node, int eflags);
 extern void pixelsEndForeignScan(ForeignScanState *node);
@@ -33,7 +52,63 @@ extern bool pixelsAnalyzeForeignTable (Relation relation,
 extern void pixelsExplainForeignScan(ForeignScanState *node, ExplainState *es);
 extern bool pixelsIsForeignScanParallelSafe(PlannerInfo *root, RelOptInfo *rel,
                                              RangeTblEntry *rte);
+extern Size pixelsEstimateDSMForeignScan(ForeignScanState *node,
+                                         ParallelContext *pcxt);
+extern void pixelsInitializeDSMForeignScan(ForeignScanState *node,
+                                           ParallelContext *pcxt,
+                                           void *coordinate);
+extern void pixelsReInitializeDSMForeignScan(ForeignScanState *node,
+                                             ParallelContext *pcxt,
+                                             void *coordinate);
+extern void pixelsInitializeWorkerForeignScan(ForeignScanState *node,
+                                              shm_toc *toc,
+                                              void *coordinate);
 extern Datum pixels_fdw_validator_impl(PG_FUNCTION_ARGS);
+extern void pixelsInitStatsHook(void);
+
+void
+_PG_init(void)
+{
+    DefineCustomRealVariable("pixels_fdw.byte_cost",
+                             "Sets the planner's estimate of the cost of reading one byte of a pixels file.",
+                             "The default is seq_page_cost spread over a page.",
+                             &pixels_byte_cost,
+                             1.0 / BLCKSZ,
+                             0.0,
+                             DBL_MAX,
+                             PGC_USERSET,
+                             0,
+                             NULL,
+                             NULL,
+                             NULL);
+    DefineCustomRealVariable("pixels_fdw.value_decode_cost",
+                             "Sets the planner's estimate of the cost of decoding one value of a pixels column.",
+                             NULL,
+                             &pixels_value_decode_cost,
+                             0.0005,
+                             0.0,
+                             DBL_MAX,
+                             PGC_USERSET,
+                             0,
+                             NULL,
+                             NULL,
+                             NULL);
+    DefineCustomIntVariable("pixels_fdw.file_stats_cache_size",
+                            "Sets the number of pixels file footers a backend keeps.",
+                            "The files of the table being planned or scanned are kept even past this limit.",
+                            &pixels_file_stats_cache_size,
+                            1024,
+                            0,
+                            INT_MAX,
+                            PGC_USERSET,
+                            0,
+                            NULL,
+                            NULL,
+                            NULL);
+    MarkGUCPrefixReserved("pixels_fdw");
+
+    pixelsInitStatsHook();
+}
 
 PG_FUNCTION_INFO_V1(pixels_fdw_validator);
 Datum
@@ -51,6 +126,8 @@ pixels_fdw_handler(PG_FUNCTION_ARGS)
     fdwroutine->GetForeignRelSize = pixelsGetForeignRelSize;
     fdwroutine->GetForeignPaths = pixelsGetForeignPaths;
     fdwroutine->GetForeignPlan = pixelsGetForeignPlan;
+    fdwroutine->GetForeignUpperPaths = pixelsGetForeignUpperPaths;
+    fdwroutine->GetForeignJoinPaths = pixelsGetForeignJoinPaths;
     fdwroutine->BeginForeignScan = pixelsBeginForeignScan;
     fdwroutine->IterateForeignScan = pixelsIterateForeignScan;
     fdwroutine->ReScanForeignScan = pixelsReScanForeignScan;
@@ -58,6 +135,10 @@ pixels_fdw_handler(PG_FUNCTION_ARGS)
     fdwroutine->AnalyzeForeignTable = pixelsAnalyzeForeignTable;
     fdwroutine->ExplainForeignScan = pixelsExplainForeignScan;
     fdwroutine->IsForeignScanParallelSafe = pixelsIsForeignScanParallelSafe;
+    fdwroutine->EstimateDSMForeignScan = pixelsEstimateDSMForeignScan;
+    fdwroutine->InitializeDSMForeignScan = pixelsInitializeDSMForeignScan;
+    fdwroutine->ReInitializeDSMForeignScan = pixelsReInitializeDSMForeignScan;
+    fdwroutine->InitializeWorkerForeignScan = pixelsInitializeWorkerForeignScan;
 
     PG_RETURN_POINTER(fdwroutine);
 }
@@ -1,5 +1,12 @@
 #include "PixelsFdwExecutionState.hpp"
 #include "PixelsFdwPlanState.hpp"
+#include "PixelsDeparse.hpp"
+#include "PixelsUpper.hpp"
+#include "PixelsFdwUpperState.hpp"
+#include "PixelsFdwOrderedState.hpp"
+#include <algorithm>
+#include <cmath>
+#include <strings.h>
 
 extern "C"
 {
@@ -9,9 +16,13 @@ extern "C"
 #include "access/reloptions.h"
 #include "access/sysattr.h"
 #include "catalog/pg_foreign_table.h"
+#include "catalog/pg_statistic.h"
 #include "catalog/pg_type.h"
 #include "commands/defrem.h"
+#include "commands/vacuum.h"
+#include "common/pg_prng.h"
 #include "commands/explain.h"
+#include "executor/executor.h"
 #include "executor/spi.h"
 #include "executor/tuptable.h"
 #include "foreign/foreign.h"
@@ -27,23 +38,42 @@ extern "C"
 #include "parser/parse_coerce.h"
 #include "parser/parse_func.h"
 #include "parser/parse_oper.h"
+#include "parser/scansup.h"
+#include "utils/acl.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/inval.h"
 #include "utils/jsonb.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/regproc.h"
 #include "utils/rel.h"
+#include "utils/ruleutils.h"
+#include "utils/sampling.h"
+#include "utils/selfuncs.h"
+#include "utils/syscache.h"
 #include "utils/typcache.h"
 #include "access/table.h"
 #include "optimizer/optimizer.h"
 #include "catalog/pg_am_d.h"
 #include "nodes/pathnodes.h"
+#include "access/parallel.h"
 }
 
+/* planner cost parameters, defined in pixels_fdw.c */
+extern "C" double pixels_byte_cost;
+extern "C" double pixels_value_decode_cost;
+
 #define MAX_PIXELS_OPTION_LENGTH 500
 
+/* ANALYZE decodes row groups holding this many times the rows it samples */
+#define PIXELS_FDW_ANALYZE_OVERSAMPLE 3
+
+/* upper bound on the histogram bounds made up from footer statistics */
+#define PIXELS_FDW_HISTOGRAM_BOUNDS 101
+
 static void*
-pixelsGetOption(Oid relid, char* option_name)
+pixelsGetOption(Oid relid, char* option_name, bool missing_ok = false)
 {
 	if (!option_name) {
 		elog(ERROR,
@@ -78,9 +108,10 @@ pixelsGetOption(Oid relid, char* option_name)
 			return result_option;
         }
     }
-	elog(ERROR,
-         "unknown option '%s'",
-         option_name);
+	if (!missing_ok)
+		elog(ERROR,
+			 "unknown option '%s'",
+			 option_name);
 	return nullptr;
 }
 
@@ -171,6 +202,44 @@ parse_filenames_list(const char *str, List* &filenames)
     }
 }
 
+/*
+ * Parses the sort_key option, "col [ASC|DESC][, ...]", into a list of
+ * (String column, Integer descending) pairs. Column names are folded to
+ * lower case like unquoted identifiers. Returns false on a syntax error.
+ */
+static bool
+parse_sort_key(const char *str, List* &keys)
+{
+    char       *cur = pstrdup(str);
+    char       *item;
+    char       *save_item;
+
+    keys = NIL;
+    for (item = strtok_r(cur, ",", &save_item); item; item = strtok_r(NULL, ",", &save_item))
+    {
+        char       *save_word;
+        char       *name = strtok_r(item, " \t", &save_word);
+        char       *order;
+        bool        descending = false;
+
+        if (!name)
+            return false;
+        order = strtok_r(NULL, " \t", &save_word);
+        if (order)
+        {
+            if (pg_strcasecmp(order, "desc") == 0)
+                descending = true;
+            else if (pg_strcasecmp(order, "asc") != 0)
+                return false;
+            if (strtok_r(NULL, " \t", &save_word))
+                return false;
+        }
+        keys = lappend(keys, list_make2(makeString(downcase_identifier(name, strlen(name), false, true)),
+                                        makeInteger(descending)));
+    }
+    return keys != NIL;
+}
+
 typedef enum
 {
     FT_DIGIT = 0,
@@ -319,7 +388,7 @@ parse_filter_type(const char *str,
                             double dvalue;
                             sscanf(oprand_2.first.c_str(), "%ld", &ivalue);
                             sscanf(oprand_2.first.c_str(), "%lf", &dvalue);
-                            string_t svalue = string_t(oprand_2.first.c_str());
+                            string_t svalue = string_t(pstrdup(oprand_2.first.c_str()));
                             char *cname = (char*)palloc0(oprand_1.first.size());
                             strcpy(cname, oprand_1.first.c_str());
 
@@ -331,7 +400,7 @@ parse_filter_type(const char *str,
                             double dvalue;
                             sscanf(oprand_1.first.c_str(), "%ld", &ivalue);
                             sscanf(oprand_1.first.c_str(), "%lf", &dvalue);
-                            string_t svalue = string_t(oprand_1.first.c_str());
+                            string_t svalue = string_t(pstrdup(oprand_1.first.c_str()));
                             char *cname = (char*)palloc0(oprand_2.first.size());
                             strcpy(cname, oprand_2.first.c_str());
 
@@ -360,7 +429,7 @@ parse_filter_type(const char *str,
                             double dvalue;
                             sscanf(oprand_2.first.c_str(), "%ld", &ivalue);
                             sscanf(oprand_2.first.c_str(), "%lf", &dvalue);
-                            string_t svalue = string_t(oprand_2.first.c_str());
+                            string_t svalue = string_t(pstrdup(oprand_2.first.c_str()));
                             char *cname = (char*)palloc0(oprand_1.first.size());
                             strcpy(cname, oprand_1.first.c_str());
 
@@ -372,7 +441,7 @@ parse_filter_type(const char *str,
                             double dvalue;
                             sscanf(oprand_1.first.c_str(), "%ld", &ivalue);
                             sscanf(oprand_1.first.c_str(), "%lf", &dvalue);
-                            string_t svalue = string_t(oprand_1.first.c_str());
+                            string_t svalue = string_t(pstrdup(oprand_1.first.c_str()));
                             char *cname = (char*)palloc0(oprand_2.first.size());
                             strcpy(cname, oprand_2.first.c_str());
 
@@ -401,7 +470,7 @@ parse_filter_type(const char *str,
                             double dvalue;
                             sscanf(oprand_2.first.c_str(), "%ld", &ivalue);
                             sscanf(oprand_2.first.c_str(), "%lf", &dvalue);
-                            string_t svalue = string_t(oprand_2.first.c_str());
+                            string_t svalue = string_t(pstrdup(oprand_2.first.c_str()));
                             char *cname = (char*)palloc0(oprand_1.first.size());
                             strcpy(cname, oprand_1.first.c_str());
 
@@ -413,7 +482,7 @@ parse_filter_type(const char *str,
                             double dvalue;
                             sscanf(oprand_1.first.c_str(), "%ld", &ivalue);
                             sscanf(oprand_1.first.c_str(), "%lf", &dvalue);
-                            string_t svalue = string_t(oprand_1.first.c_str());
+                            string_t svalue = string_t(pstrdup(oprand_1.first.c_str()));
                             char *cname = (char*)palloc0(oprand_2.first.size());
                             strcpy(cname, oprand_2.first.c_str());
 
@@ -442,7 +511,7 @@ parse_filter_type(const char *str,
                             double dvalue;
                             sscanf(oprand_2.first.c_str(), "%ld", &ivalue);
                             sscanf(oprand_2.first.c_str(), "%lf", &dvalue);
-                            string_t svalue = string_t(oprand_2.first.c_str());
+                            string_t svalue = string_t(pstrdup(oprand_2.first.c_str()));
                             char *cname = (char*)palloc0(oprand_1.first.size());
                             strcpy(cname, oprand_1.first.c_str());
 
@@ -454,7 +523,7 @@ parse_filter_type(const char *str,
                             double dvalue;
                             sscanf(oprand_1.first.c_str(), "%ld", &ivalue);
                             sscanf(oprand_1.first.c_str(), "%lf", &dvalue);
-                            string_t svalue = string_t(oprand_1.first.c_str());
+                            string_t svalue = string_t(pstrdup(oprand_1.first.c_str()));
                             char *cname = (char*)palloc0(oprand_2.first.size());
                             strcpy(cname, oprand_2.first.c_str());
 
@@ -483,7 +552,7 @@ parse_filter_type(const char *str,
                             double dvalue;
                             sscanf(oprand_2.first.c_str(), "%ld", &ivalue);
                             sscanf(oprand_2.first.c_str(), "%lf", &dvalue);
-                            string_t svalue = string_t(oprand_2.first.c_str());
+                            string_t svalue = string_t(pstrdup(oprand_2.first.c_str()));
                             char *cname = (char*)palloc0(oprand_1.first.size());
                             strcpy(cname, oprand_1.first.c_str());
 
@@ -495,7 +564,7 @@ parse_filter_type(const char *str,
                             double dvalue;
                             sscanf(oprand_1.first.c_str(), "%ld", &ivalue);
                             sscanf(oprand_1.first.c_str(), "%lf", &dvalue);
-                            string_t svalue = string_t(oprand_1.first.c_str());
+                            string_t svalue = string_t(pstrdup(oprand_1.first.c_str()));
                             char *cname = (char*)palloc0(oprand_2.first.size());
                             strcpy(cname, oprand_2.first.c_str());
 
@@ -592,19 +661,76 @@ pixelsGetForeignRelSize(PlannerInfo *root,
 	List* filenames = NIL;
 	parse_filenames_list(filename, filenames);
     char* filters = (char*)pixelsGetOption(foreigntableid,
-                     					   "filters");
-    PixelsFilter* all_filters;
+                     					   "filters",
+                                           true);
+    PixelsFilter* all_filters = nullptr;
 	List* refered_cols = NIL;
-	parse_filter_type(filters, all_filters, refered_cols);
     List* col_filters = NIL;
-    separate_filters(all_filters, refered_cols, col_filters);
+    if (filters) {
+        parse_filter_type(filters, all_filters, refered_cols);
+        separate_filters(all_filters, refered_cols, col_filters);
+    }
     List* options = pixelsGetOptions(foreigntableid);
 	fdw_private = createPixelsFdwPlanState(filenames,
                                            col_filters,
 										   options);
     baserel->fdw_private = fdw_private;
+
+    /*
+     * The filters of the table option and the restriction clauses the
+     * pixels reader can evaluate, one tree per column. The clauses stay in
+     * the plan quals as well: string comparisons are byte-wise and the
+     * reader treats nulls as it likes, so the filters only ever remove rows
+     * that the quals would reject.
+     */
+    ListCell *lc;
+    List *pushdown_filters = NIL;
+    foreach (lc, fdw_private->getFiltersList())
+        pushdown_filters = lappend(pushdown_filters,
+                                   pixels_serialize_filter((PixelsFilter *) lfirst(lc)));
+    pushdown_filters = list_concat(pushdown_filters,
+                                   pixels_deparse_filters(baserel, foreigntableid,
+                                                          baserel->baserestrictinfo,
+                                                          &fdw_private->pushdown_params));
+    fdw_private->pushdown_filters = pixels_merge_filters(pushdown_filters);
+
+    /* filters compared with Params are left out, their values are not known yet */
+    std::vector<PixelsFilter*> plan_filters;
+    foreach (lc, fdw_private->pushdown_filters)
+    {
+        PixelsFilter *filter = pixels_deserialize_filter((List *) lfirst(lc), NULL, NULL);
+        if (filter)
+            plan_filters.emplace_back(filter);
+    }
+    fdw_private->EstimateRowGroupPruning(plan_filters);
+    for (auto filter : plan_filters)
+        delete filter;
     baserel->tuples = fdw_private->getRowCount();
 	baserel->rows = fdw_private->getRowCount();
+    baserel->pages = ceil((double) fdw_private->getTotalBytes() / BLCKSZ);
+}
+
+/*
+ * Names of the columns in attrs_used, empty when a whole-row reference
+ * needs every column.
+ */
+static std::vector<std::string>
+pixels_scan_columns(Oid foreigntableid, Bitmapset *attrs_used)
+{
+    std::vector<std::string> columns;
+    int         attr = -1;
+
+    while ((attr = bms_next_member(attrs_used, attr)) >= 0)
+    {
+        AttrNumber  attnum = attr + FirstLowInvalidHeapAttributeNumber;
+
+        if (attnum == 0)
+            return std::vector<std::string>();
+        if (attnum < 0)
+            continue;
+        columns.emplace_back(get_attname(foreigntableid, attnum, false));
+    }
+    return columns;
 }
 
 static void
@@ -615,7 +741,10 @@ estimate_costs(PlannerInfo *root,
 			   Cost *run_cost,
                Cost *total_cost)
 {
+    RangeTblEntry      *rte = planner_rt_fetch(baserel->relid, root);
     double  			ntuples;
+    double              scanned_rows;
+    int                 column_num;
 
     ntuples = baserel->tuples * clauselist_selectivity(root,
                                 					   baserel->baserestrictinfo,
@@ -624,14 +753,22 @@ estimate_costs(PlannerInfo *root,
                                 					   NULL);
 
     /*
-     * Here we assume that parquet tuple cost is the same as regular tuple cost
-     * even though this is probably not true in many cases. Maybe we'll come up
-     * with a smarter idea later. Also we use actual number of rows in selected
-     * rowgroups to calculate cost as we need to process those rows regardless
-     * of whether they're gonna be filtered out or not.
+     * Only the projected columns of the row groups that survive pruning are
+     * read and decoded; their on-disk sizes already account for encoding and
+     * compression. Every row read is then checked against the quals, which
+     * stay in the plan, before the target list is computed for the rows
+     * that pass.
      */
-    *run_cost = fdw_private->getRowCount() * cpu_tuple_cost;
-	*startup_cost = baserel->baserestrictcost.startup;
+    std::vector<std::string> columns = pixels_scan_columns(rte->relid, fdw_private->attrs_used);
+    column_num = columns.empty() ? baserel->max_attr : columns.size();
+    scanned_rows = fdw_private->getScannedRowCount();
+    fdw_private->scan_bytes = fdw_private->EstimateScanBytes(columns);
+
+    *startup_cost = baserel->baserestrictcost.startup + baserel->reltarget->cost.startup;
+    *run_cost = fdw_private->scan_bytes * pixels_byte_cost;
+    *run_cost += scanned_rows * column_num * pixels_value_decode_cost;
+    *run_cost += scanned_rows * (cpu_tuple_cost + baserel->baserestrictcost.per_tuple);
+    *run_cost += ntuples * baserel->reltarget->cost.per_tuple;
 	*total_cost = *startup_cost + *run_cost;
 
     baserel->rows = ntuples;
@@ -663,6 +800,253 @@ extract_used_attributes(RelOptInfo *baserel)
     }
 }
 
+/*
+ * Number of workers for a partial scan. The shared scan cursor hands out
+ * row group ranges, so the scan is sized like a heap scan of as many bytes
+ * as it reads.
+ */
+static int
+pixels_parallel_workers(RelOptInfo *baserel, PixelsFdwPlanState *fdw_private)
+{
+    double      pages;
+
+    pages = ceil(fdw_private->scan_bytes / BLCKSZ);
+    return compute_parallel_worker(baserel, pages, -1,
+                                   max_parallel_workers_per_gather);
+}
+
+/*
+ * Share of the scan done by each process, same as get_parallel_divisor() in
+ * costsize.c: the leader contributes less the more workers it has to feed.
+ */
+static double
+pixels_parallel_divisor(int parallel_workers)
+{
+    double      parallel_divisor = parallel_workers;
+
+    if (parallel_leader_participation)
+    {
+        double      leader_contribution;
+
+        leader_contribution = 1.0 - (0.3 * parallel_workers);
+        if (leader_contribution > 0)
+            parallel_divisor += leader_contribution;
+    }
+    return parallel_divisor;
+}
+
+/*
+ * Path returning the rows in the order of the sort_key option, for a table
+ * whose files are each sorted on it. The pathkeys stop at the first key
+ * that is not an integer, date or timestamp, which the files' statistics
+ * do not order. The files are read one after the other in the order of
+ * their ranges of the first key, so the path is only offered when those
+ * ranges do not overlap: scans of overlapping files would have to be read
+ * side by side and merged, which the reader's buffer pool, shared by every
+ * scan of the backend, does not allow. The path keeps the sort keys as
+ * (attno, descending, nulls first) triples.
+ */
+static void
+pixels_add_sorted_path(PlannerInfo *root,
+                       RelOptInfo *baserel,
+                       Oid foreigntableid,
+                       Cost startup_cost,
+                       Cost total_cost)
+{
+    PixelsFdwPlanState *fdw_private = (PixelsFdwPlanState *) baserel->fdw_private;
+    char       *sort_key = (char *) pixelsGetOption(foreigntableid, "sort_key", true);
+    List       *keys;
+    List       *pathkeys = NIL;
+    List       *sort_keys = NIL;
+    std::string first_column;
+    ListCell   *lc;
+
+    if (!sort_key || !has_useful_pathkeys(root, baserel))
+        return;
+    if (!parse_sort_key(sort_key, keys))
+        elog(ERROR, "pixels_fdw: invalid sort_key \"%s\"", sort_key);
+
+    foreach (lc, keys)
+    {
+        char       *name = strVal(linitial((List *) lfirst(lc)));
+        bool        descending = intVal(lsecond((List *) lfirst(lc)));
+        AttrNumber  attnum = get_attnum(foreigntableid, name);
+        Oid         atttype;
+        int32       atttypmod;
+        Oid         attcollation;
+        TypeCacheEntry *typentry;
+        Oid         opno;
+        Var        *var;
+
+        if (attnum == InvalidAttrNumber)
+            ereport(ERROR,
+                    (errcode(ERRCODE_UNDEFINED_COLUMN),
+                     errmsg("pixels_fdw: sort_key column \"%s\" does not exist", name)));
+        get_atttypetypmodcoll(foreigntableid, attnum, &atttype, &atttypmod, &attcollation);
+        if (atttype != INT2OID && atttype != INT4OID && atttype != INT8OID &&
+            atttype != DATEOID && atttype != TIMESTAMPOID && atttype != TIMESTAMPTZOID)
+            break;
+        typentry = lookup_type_cache(atttype, TYPECACHE_LT_OPR | TYPECACHE_GT_OPR);
+        opno = descending ? typentry->gt_opr : typentry->lt_opr;
+        if (!OidIsValid(opno))
+            break;
+
+        /* nulls go where Postgres puts them by default, last when ascending */
+        var = makeVar(baserel->relid, attnum, atttype, atttypmod, attcollation, 0);
+        pathkeys = list_concat(pathkeys,
+                               build_expression_pathkey(root, (Expr *) var, NULL, opno,
+                                                        baserel->relids, true));
+        sort_keys = lappend(sort_keys, list_make3_int(attnum, descending, descending));
+        if (first_column.empty())
+            first_column = name;
+    }
+    if (pathkeys == NIL)
+        return;
+
+    if (PixelsSortedRuns(fdw_private->getFileStats(), first_column,
+                         intVal(lsecond((List *) linitial(keys))),
+                         list_length(sort_keys) > 1).size() != 1)
+        return;
+
+    add_path(baserel,
+             (Path *)
+             create_foreignscan_path(root,
+                                     baserel,
+                                     NULL,	/* default pathtarget */
+                                     baserel->rows,
+                                     startup_cost,
+                                     total_cost,
+                                     pathkeys,
+                                     baserel->lateral_relids,
+                                     NULL,	/* no extra plan */
+                                     sort_keys));
+}
+
+/* an equivalence class member that is a column of the relation */
+static bool
+pixels_ec_member_is_column(PlannerInfo *root, RelOptInfo *rel,
+                           EquivalenceClass *ec, EquivalenceMember *em,
+                           void *arg)
+{
+    Expr       *expr = em->em_expr;
+
+    while (IsA(expr, RelabelType))
+        expr = ((RelabelType *) expr)->arg;
+    return IsA(expr, Var) && ((Var *) expr)->varno == rel->relid &&
+           ((Var *) expr)->varattno > 0;
+}
+
+/*
+ * Share of the rows a scan reads with the join clauses pushed down, from
+ * the best equality lookup among them.
+ */
+static double
+pixels_lookup_fraction(RelOptInfo *baserel, Oid foreigntableid, List *clauses)
+{
+    PixelsFdwPlanState *fdw_private = (PixelsFdwPlanState *) baserel->fdw_private;
+    List       *params = NIL;
+    double      fraction = 1.0;
+    ListCell   *lc;
+
+    foreach (lc, pixels_deparse_join_filters(baserel, foreigntableid, clauses, &params))
+    {
+        List       *filter = (List *) lfirst(lc);
+
+        if ((PixelsFilterType) intVal(linitial(filter)) == PixelsFilterType::COMPARE_EQ)
+            fraction = std::min(fraction,
+                                fdw_private->EstimateLookupFraction(strVal(lsecond(filter))));
+    }
+    return fraction;
+}
+
+/*
+ * Parameterized paths for the table on the inner side of a nested loop.
+ * The join clauses the reader can evaluate become filters whose values are
+ * taken from the outer row on every rescan, so that a lookup only reads the
+ * row groups whose statistics admit them. One path is made for each set of
+ * outer relations such a clause needs, as postgres_fdw does.
+ */
+static void
+pixels_add_parameterized_paths(PlannerInfo *root,
+                               RelOptInfo *baserel,
+                               Oid foreigntableid,
+                               Cost startup_cost,
+                               Cost run_cost)
+{
+    PixelsFdwPlanState *fdw_private = (PixelsFdwPlanState *) baserel->fdw_private;
+    List       *clauses = NIL;
+    List       *required_outers = NIL;
+    ListCell   *lc;
+
+    foreach (lc, baserel->joininfo)
+    {
+        RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+
+        if (join_clause_is_movable_to(rinfo, baserel))
+            clauses = lappend(clauses, rinfo);
+    }
+    if (baserel->has_eclass_joins)
+        clauses = list_concat(clauses,
+                              generate_implied_equalities_for_column(root, baserel,
+                                                                     pixels_ec_member_is_column,
+                                                                     NULL,
+                                                                     baserel->lateral_referencers));
+
+    foreach (lc, clauses)
+    {
+        RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+        List       *params = NIL;
+        Relids      required_outer;
+        bool        found = false;
+        ListCell   *lc2;
+
+        if (pixels_deparse_join_filters(baserel, foreigntableid,
+                                        list_make1(rinfo), &params) == NIL)
+            continue;
+        required_outer = bms_union(rinfo->clause_relids, baserel->lateral_relids);
+        required_outer = bms_del_members(required_outer, baserel->relids);
+        if (bms_is_empty(required_outer))
+            continue;
+        foreach (lc2, required_outers)
+        {
+            if (bms_equal((Relids) lfirst(lc2), required_outer))
+                found = true;
+        }
+        if (!found)
+            required_outers = lappend(required_outers, required_outer);
+    }
+
+    foreach (lc, required_outers)
+    {
+        Relids      required_outer = (Relids) lfirst(lc);
+        ParamPathInfo *param_info = get_baserel_parampathinfo(root, baserel, required_outer);
+        double      fraction = pixels_lookup_fraction(baserel, foreigntableid,
+                                                      param_info->ppi_clauses);
+        QualCost    join_cost;
+        Cost        path_startup_cost;
+        Cost        path_total_cost;
+
+        /* the join clauses stay in the quals, checked on the rows read */
+        cost_qual_eval(&join_cost, param_info->ppi_clauses, root);
+        path_startup_cost = startup_cost + join_cost.startup;
+        path_total_cost = path_startup_cost + run_cost * fraction +
+                          fdw_private->getScannedRowCount() * fraction * join_cost.per_tuple;
+
+        add_path(baserel,
+                 (Path *)
+                 create_foreignscan_path(root,
+                                         baserel,
+                                         NULL,	/* default pathtarget */
+                                         param_info->ppi_rows,
+                                         path_startup_cost,
+                                         path_total_cost,
+                                         NIL,	/* no pathkeys */
+                                         required_outer,
+                                         NULL,	/* no extra plan */
+                                         NIL));
+    }
+}
+
 extern "C" void
 pixelsGetForeignPaths(PlannerInfo *root,
 					  RelOptInfo *baserel,
@@ -673,14 +1057,16 @@ pixelsGetForeignPaths(PlannerInfo *root,
 	Cost        run_cost;
 	Cost		total_cost;
 
+	int         parallel_workers;
+
+    extract_used_attributes(baserel);
+
 	/* Estimate costs */
 	estimate_costs(root, baserel,
                    fdw_private,
                    &startup_cost,
 				   &run_cost,
                    &total_cost);
-    
-    extract_used_attributes(baserel);
 
 	add_path(baserel, 
              (Path *)
@@ -694,7 +1080,106 @@ pixelsGetForeignPaths(PlannerInfo *root,
 									 baserel->lateral_relids,
 									 NULL,	/* no extra plan */
 									 NIL));
-	/* assume there is no parallel paths, so run_cost omitted*/
+	pixels_add_sorted_path(root, baserel, foreigntableid, startup_cost, total_cost);
+	pixels_add_parameterized_paths(root, baserel, foreigntableid, startup_cost, run_cost);
+
+	/*
+	 * Partial path for a parallel scan: the workers claim morsels from the
+	 * shared scan cursor, so the per-tuple cost is split among them.
+	 */
+	parallel_workers = pixels_parallel_workers(baserel, fdw_private);
+	if (baserel->consider_parallel && parallel_workers > 0)
+	{
+		ForeignPath *partial_path;
+		double       parallel_divisor = pixels_parallel_divisor(parallel_workers);
+
+		partial_path = create_foreignscan_path(root,
+                                               baserel,
+											   NULL,	/* default pathtarget */
+											   clamp_row_est(baserel->rows / parallel_divisor),
+											   startup_cost,
+											   startup_cost + run_cost / parallel_divisor,
+											   NIL,	/* no pathkeys */
+											   baserel->lateral_relids,
+											   NULL,	/* no extra plan */
+											   NIL);
+		partial_path->path.parallel_aware = true;
+		partial_path->path.parallel_safe = true;
+		partial_path->path.parallel_workers = parallel_workers;
+		add_partial_path(baserel, (Path *) partial_path);
+	}
+}
+
+/*
+ * Builds a scan tuple holding only the columns in tlist_attrs, so that the
+ * slot of a wide table is not cleared and filled at its full width. The
+ * entries are named after the columns, which is how the execution state
+ * finds them in the pixels file; scan_attrs gets the positions of those in
+ * read_attrs, in the form of attrs_used. The other entries are only there
+ * for the plan's target list to refer to, and stay null. Returns NIL,
+ * leaving the scan at the relation width, when a whole-row reference or a
+ * system column needs the tuple in the shape of the relation.
+ */
+static List *
+pixels_build_scan_tlist(Oid foreigntableid,
+                        Index scan_relid,
+                        Bitmapset *tlist_attrs,
+                        Bitmapset *read_attrs,
+                        List **scan_attrs)
+{
+    List       *scan_tlist = NIL;
+    int         attr;
+
+    attr = -1;
+    while ((attr = bms_next_member(tlist_attrs, attr)) >= 0)
+    {
+        if (attr + FirstLowInvalidHeapAttributeNumber <= 0)
+            return NIL;
+    }
+
+    attr = -1;
+    while ((attr = bms_next_member(tlist_attrs, attr)) >= 0)
+    {
+        AttrNumber  attnum = attr + FirstLowInvalidHeapAttributeNumber;
+        Oid         atttype;
+        int32       atttypmod;
+        Oid         attcollation;
+        TargetEntry *tle;
+
+        get_atttypetypmodcoll(foreigntableid, attnum,
+                              &atttype, &atttypmod, &attcollation);
+        tle = makeTargetEntry((Expr *) makeVar(scan_relid, attnum, atttype,
+                                               atttypmod, attcollation, 0),
+                              list_length(scan_tlist) + 1,
+                              get_attname(foreigntableid, attnum, false),
+                              false);
+        scan_tlist = lappend(scan_tlist, tle);
+        if (bms_is_member(attr, read_attrs))
+            *scan_attrs = lappend_int(*scan_attrs,
+                                      tle->resno - FirstLowInvalidHeapAttributeNumber);
+    }
+    return scan_tlist;
+}
+
+extern "C" void
+pixelsGetForeignUpperPaths(PlannerInfo *root,
+						   UpperRelationKind stage,
+						   RelOptInfo *input_rel,
+						   RelOptInfo *output_rel,
+						   void *extra)
+{
+	pixels_add_upper_paths(root, stage, input_rel, output_rel, extra);
+}
+
+extern "C" void
+pixelsGetForeignJoinPaths(PlannerInfo *root,
+						  RelOptInfo *joinrel,
+						  RelOptInfo *outerrel,
+						  RelOptInfo *innerrel,
+						  JoinType jointype,
+						  JoinPathExtraData *extra)
+{
+	pixels_add_join_paths(root, joinrel, outerrel, innerrel, jointype, extra);
 }
 
 extern "C" ForeignScan *
@@ -706,66 +1191,248 @@ pixelsGetForeignPlan(PlannerInfo *root,
 				     List *scan_clauses,
 				     Plan *outer_plan)
 {
+	if (IS_UPPER_REL(baserel) || IS_JOIN_REL(baserel))
+		return pixels_make_upper_plan(best_path, tlist, outer_plan);
+
 	PixelsFdwPlanState *fdw_private = (PixelsFdwPlanState *) baserel->fdw_private;
 	List       *params = NIL;
     List       *attrs_used = NIL;
+	List       *scan_tlist = NIL;
+	Bitmapset  *scan_attrs = bms_copy(fdw_private->attrs_used);
+	Bitmapset  *tlist_attrs;
+	List       *order_keys = NIL;
+	List       *pushdown_filters = fdw_private->pushdown_filters;
+	List       *fdw_exprs = fdw_private->pushdown_params;
 	AttrNumber  attr;
 	Index		scan_relid = baserel->relid;
+	ListCell   *lc;
 
 	/*
-	 * We have no native ability to evaluate restriction clauses, so we just
-	 * put all the scan_clauses into the plan node's qual list for the
-	 * executor to check.  So all we have to do here is strip RestrictInfo
-	 * nodes from the clauses and ignore pseudoconstants (which will be
-	 * handled elsewhere).
+	 * The filters pushed down to the reader only skip rows the quals would
+	 * reject, so all the scan_clauses still go into the plan node's qual
+	 * list for the executor to check.  So all we have to do here is strip
+	 * RestrictInfo nodes from the clauses and ignore pseudoconstants (which
+	 * will be handled elsewhere).
 	 */
 	scan_clauses = extract_actual_clauses(scan_clauses,
                                           false);
 							
-	attr = -1;
-    while ((attr = bms_next_member(fdw_private->attrs_used, attr)) >= 0)
-        attrs_used = lappend_int(attrs_used, attr);
+	/*
+	 * Only the columns of the path, the clauses and the sort keys are read.
+	 * createplan may still hand over the physical target list, whose other
+	 * columns get null entries in the scan tuple.
+	 */
+	foreach (lc, best_path->fdw_private)
+		scan_attrs = bms_add_member(scan_attrs,
+									linitial_int((List *) lfirst(lc)) - FirstLowInvalidHeapAttributeNumber);
+	pull_varattnos((Node *) scan_clauses, scan_relid, &scan_attrs);
+	tlist_attrs = bms_copy(scan_attrs);
+	pull_varattnos((Node *) tlist, scan_relid, &tlist_attrs);
+	scan_tlist = pixels_build_scan_tlist(foreigntableid, scan_relid,
+                                         tlist_attrs, scan_attrs, &attrs_used);
+	if (scan_tlist == NIL)
+	{
+		attr = -1;
+		while ((attr = bms_next_member(scan_attrs, attr)) >= 0)
+			attrs_used = lappend_int(attrs_used, attr);
+	}
+
+	/*
+	 * An ordered path reads the files in the order of its sort keys, which
+	 * are passed on as positions in the scan tuple.
+	 */
+	foreach (lc, best_path->fdw_private)
+	{
+		List       *key = (List *) lfirst(lc);
+		int         slot_index = linitial_int(key) - 1;
+		ListCell   *lc2;
+
+		foreach (lc2, scan_tlist)
+		{
+			TargetEntry *tle = (TargetEntry *) lfirst(lc2);
+
+			if (((Var *) tle->expr)->varattno == linitial_int(key))
+				slot_index = tle->resno - 1;
+		}
+		order_keys = lappend(order_keys, list_make3_int(slot_index,
+														lsecond_int(key),
+														lthird_int(key)));
+	}
+
+	/*
+	 * The join clauses of a parameterized path are pushed down as well,
+	 * their values taken from the outer row on every rescan.
+	 */
+	if (best_path->path.param_info)
+	{
+		fdw_exprs = list_copy(fdw_exprs);
+		pushdown_filters = list_concat(list_copy(pushdown_filters),
+									   pixels_deparse_join_filters(baserel, foreigntableid,
+																   best_path->path.param_info->ppi_clauses,
+																   &fdw_exprs));
+		pushdown_filters = pixels_merge_filters(pushdown_filters);
+	}
 
 	params = lappend(params, fdw_private->getFilesList());
-	params = lappend(params, fdw_private->getFiltersList());
+	params = lappend(params, pushdown_filters);
     params = lappend(params, attrs_used);
+	if (order_keys != NIL)
+		params = lappend(params, order_keys);
 
 	/* Create the ForeignScan node */
 	return make_foreignscan(tlist,
 							scan_clauses,
 							scan_relid,
-							NIL,	/* no expressions to evaluate */
+							fdw_exprs,
 							params,
-							NIL,	/* no custom tlist */
+							scan_tlist,
 							NIL,	/* no remote quals */
 							outer_plan);
 }
 
+/* whether the node is an upper scan, the scan of a table has a scan relation */
+static bool
+pixels_is_upper_scan(ForeignScanState *node)
+{
+	return ((ForeignScan *) node->ss.ps.plan)->scan.scanrelid == 0;
+}
+
+/* whether the node is the scan of a table reading its files in sort key order */
+static bool
+pixels_is_ordered_scan(ForeignScanState *node)
+{
+	return !pixels_is_upper_scan(node) &&
+		list_length(((ForeignScan *) node->ss.ps.plan)->fdw_private) > 3;
+}
+
 extern "C" void
 pixelsExplainForeignScan(ForeignScanState *node, ExplainState *es)
 {
-	char* filename = (char*)pixelsGetOption(RelationGetRelid(node->ss.ss_currentRelation),
+	List *fdw_private = ((ForeignScan *) node->ss.ps.plan)->fdw_private;
+	List *upper = pixels_is_upper_scan(node) ? (List *) lfourth(fdw_private) : NIL;
+	Oid relid = upper != NIL ? linitial_oid((List *) lsecond(upper)) :
+		RelationGetRelid(node->ss.ss_currentRelation);
+	char* filename = (char*)pixelsGetOption(relid,
                      						"filename");
 	ExplainPropertyText("Pixels File Names: ",
 						 filename,
                          es);
-	char* filters = (char*)pixelsGetOption(RelationGetRelid(node->ss.ss_currentRelation),
-                     						"filters");
-	ExplainPropertyText("Pixels Table Filters: ",
-						 filters,
-                         es);
+	char* filters = (char*)pixelsGetOption(relid,
+                     						"filters",
+                                            true);
+	if (filters)
+		ExplainPropertyText("Pixels Table Filters: ",
+							 filters,
+							 es);
+	List *pushdown_filters = (List *) lsecond(fdw_private);
+	ExplainPropertyInteger("Pixels Pushed Down Filters: ", NULL,
+						   list_length(pushdown_filters),
+						   es);
+	if (pixels_is_ordered_scan(node))
+		ExplainPropertyInteger("Pixels Sort Keys: ", NULL,
+							   list_length((List *) lfourth(fdw_private)), es);
+	if (upper != NIL) {
+		switch ((PixelsUpperKind) intVal(linitial(upper))) {
+			case PIXELS_UPPER_METADATA:
+				ExplainPropertyText("Pixels Aggregation: ", "footer statistics", es);
+				break;
+			case PIXELS_UPPER_AGGREGATE:
+			{
+				int group_keys = 0;
+				ListCell *lc;
+				foreach (lc, ((ForeignScan *) node->ss.ps.plan)->fdw_scan_tlist)
+				{
+					if (IsA(((TargetEntry *) lfirst(lc))->expr, Var))
+						group_keys++;
+				}
+				ExplainPropertyText("Pixels Aggregation: ",
+									group_keys > 0 ? "column vectors, hash table" : "column vectors",
+									es);
+				if (group_keys > 0)
+					ExplainPropertyInteger("Pixels Grouping Columns: ", NULL, group_keys, es);
+				break;
+			}
+			case PIXELS_UPPER_TOPN:
+				ExplainPropertyInteger("Pixels Top-N Sort Keys: ", NULL,
+									   list_length((List *) list_nth(upper, 5)), es);
+				/* FALLTHROUGH */
+			case PIXELS_UPPER_LIMIT:
+				if (lfourth(upper))
+					ExplainPropertyText("Pixels Limit: ",
+										deparse_expression((Node *) lfourth(upper), NIL, false, false),
+										es);
+				if (list_nth(upper, 4))
+					ExplainPropertyText("Pixels Offset: ",
+										deparse_expression((Node *) list_nth(upper, 4), NIL, false, false),
+										es);
+				break;
+			case PIXELS_UPPER_JOIN:
+			{
+				Oid probe_relid = lsecond_oid((List *) lsecond(upper));
+				char *probe_filters = (char *) pixelsGetOption(probe_relid, "filters", true);
+
+				ExplainPropertyText("Pixels Join: ", "column vectors, hash table", es);
+				ExplainPropertyInteger("Pixels Hash Keys: ", NULL,
+									   list_length((List *) list_nth(upper, 5)), es);
+				ExplainPropertyText("Pixels Probed File Names: ",
+									(char *) pixelsGetOption(probe_relid, "filename"), es);
+				if (probe_filters)
+					ExplainPropertyText("Pixels Probed Table Filters: ", probe_filters, es);
+				ExplainPropertyInteger("Pixels Probed Pushed Down Filters: ", NULL,
+									   list_length((List *) lsecond((List *) list_nth(upper, 4))), es);
+				break;
+			}
+		}
+	}
 }
 
 extern "C" void
 pixelsBeginForeignScan(ForeignScanState *node, int eflags)
 {
-	List      		*fdw_private = ((ForeignScan *)(node->ss.ps.plan))->fdw_private;
+	ForeignScan		*fsplan = (ForeignScan *) node->ss.ps.plan;
+	List      		*fdw_private = fsplan->fdw_private;
 	ListCell		*lc, *lc2;
 	List        	*filenames = NIL;
 	List        	*filters = NIL;
+	List            *serialized_filters = NIL;
 	List            *attrs_list;
     std::set<int>   attrs_used;
 	int             i = 0;
+	Datum           *param_values = NULL;
+	bool            *param_nulls = NULL;
+	List            *param_states = NIL;
+	bool            runtime_filters;
+	PixelsFilter    *filter;
+	/*
+	 * Do nothing in EXPLAIN (no ANALYZE) case.  node->fdw_state stays NULL.
+	 */
+	if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
+		return;
+
+	/*
+	 * Values of the Params compared in the pushed down filters. The scan of
+	 * a table takes them on the first fetch and again on every rescan, as
+	 * those of a parameterized path change with the outer row.
+	 */
+	if (fsplan->fdw_exprs != NIL)
+		param_states = ExecInitExprList(fsplan->fdw_exprs, (PlanState *) node);
+	runtime_filters = param_states != NIL && !pixels_is_upper_scan(node) &&
+		!pixels_is_ordered_scan(node) && !fsplan->scan.plan.parallel_aware;
+	if (param_states != NIL && !runtime_filters)
+	{
+		int         param_index = 0;
+
+		param_values = (Datum *) palloc(sizeof(Datum) * list_length(param_states));
+		param_nulls = (bool *) palloc(sizeof(bool) * list_length(param_states));
+		foreach (lc, param_states)
+		{
+			param_values[param_index] = ExecEvalExpr((ExprState *) lfirst(lc),
+													 node->ss.ps.ps_ExprContext,
+													 &param_nulls[param_index]);
+			param_index++;
+		}
+	}
+
 	foreach (lc, fdw_private)
     {
         switch(i)
@@ -774,7 +1441,7 @@ pixelsBeginForeignScan(ForeignScanState *node, int eflags)
                 filenames = (List *) lfirst(lc);
                 break;
             case 1:
-                filters = (List *) lfirst(lc);
+                serialized_filters = (List *) lfirst(lc);
                 break;
             case 2:
                 attrs_list = (List *) lfirst(lc);
@@ -784,16 +1451,57 @@ pixelsBeginForeignScan(ForeignScanState *node, int eflags)
         }
         ++i;
     }
-	PixelsFdwExecutionState *festate;
-	/*
-	 * Do nothing in EXPLAIN (no ANALYZE) case.  node->fdw_state stays NULL.
-	 */
-	if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
+	/* the files read in order are scanned with the filters resolved here */
+	if (pixels_is_ordered_scan(node))
+	{
+		TupleDesc   tupdesc = node->ss.ss_ScanTupleSlot->tts_tupleDescriptor;
+		std::vector<PixelsOrderKey> keys;
+
+		foreach (lc, (List *) lfourth(fdw_private))
+		{
+			List       *key = (List *) lfirst(lc);
+
+			keys.push_back(PixelsOrderKey{linitial_int(key),
+										  (bool) lsecond_int(key),
+										  (bool) lthird_int(key)});
+		}
+		node->fdw_state = (void *) new PixelsFdwOrderedState(filenames,
+															 serialized_filters,
+															 param_values,
+															 param_nulls,
+															 attrs_used,
+															 tupdesc,
+															 keys);
+		return;
+	}
+
+	if (!runtime_filters)
+	{
+		foreach (lc, serialized_filters)
+		{
+			filter = pixels_deserialize_filter((List *) lfirst(lc), param_values, param_nulls);
+			if (filter)
+				filters = lappend(filters, filter);
+		}
+	}
+	/* an upper scan stands in for the aggregation above the table scan */
+	if (pixels_is_upper_scan(node))
+	{
+		node->fdw_state = (void *) createPixelsFdwUpperState(node,
+															 filenames,
+															 filters,
+															 attrs_used,
+															 (List *) lfourth(fdw_private));
 		return;
+	}
+
+	PixelsFdwExecutionState *festate;
 	festate = createPixelsFdwExecutionState(filenames,
                                             filters,
                                             attrs_used,
                                             node->ss.ss_ScanTupleSlot->tts_tupleDescriptor);
+	if (runtime_filters)
+		festate->SetRuntimeFilters(serialized_filters, param_states, node->ss.ps.ps_ExprContext);
 	node->fdw_state = (void *) festate;
 }
 
@@ -806,9 +1514,17 @@ pixelsBeginForeignScan(ForeignScanState *node, int eflags)
 extern "C" TupleTableSlot *
 pixelsIterateForeignScan(ForeignScanState *node)
 {
-	PixelsFdwExecutionState *festate = (PixelsFdwExecutionState *) node->fdw_state;
 	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
 	ExecClearTuple(slot);
+	if (pixels_is_upper_scan(node)) {
+		PixelsFdwUpperState *upstate = (PixelsFdwUpperState *) node->fdw_state;
+		return upstate->next(slot) ? slot : NULL;
+	}
+	if (pixels_is_ordered_scan(node)) {
+		PixelsFdwOrderedState *ostate = (PixelsFdwOrderedState *) node->fdw_state;
+		return ostate->next(slot) ? slot : NULL;
+	}
+	PixelsFdwExecutionState *festate = (PixelsFdwExecutionState *) node->fdw_state;
 	if (festate->next(slot)) {
 		return slot;
 	}
@@ -818,6 +1534,14 @@ pixelsIterateForeignScan(ForeignScanState *node)
 extern "C" void
 pixelsReScanForeignScan(ForeignScanState *node)
 {
+	if (pixels_is_upper_scan(node)) {
+		((PixelsFdwUpperState *) node->fdw_state)->rescan();
+		return;
+	}
+	if (pixels_is_ordered_scan(node)) {
+		((PixelsFdwOrderedState *) node->fdw_state)->rescan();
+		return;
+	}
    	PixelsFdwExecutionState *festate = (PixelsFdwExecutionState *) node->fdw_state;
 	festate->rescan();
 }
@@ -825,21 +1549,590 @@ pixelsReScanForeignScan(ForeignScanState *node)
 extern "C" void
 pixelsEndForeignScan(ForeignScanState *node)
 {
+	if (pixels_is_upper_scan(node)) {
+		delete (PixelsFdwUpperState *) node->fdw_state;
+		return;
+	}
+	if (pixels_is_ordered_scan(node)) {
+		delete (PixelsFdwOrderedState *) node->fdw_state;
+		return;
+	}
     PixelsFdwExecutionState *festate = (PixelsFdwExecutionState *) node->fdw_state;
 	delete festate;
 }
 
+static std::vector<std::string>
+pixels_file_paths(Oid relid, List **filenames)
+{
+    std::vector<std::string> paths;
+    ListCell   *lc;
+
+    parse_filenames_list((char *) pixelsGetOption(relid, "filename"), *filenames);
+    foreach (lc, *filenames)
+        paths.emplace_back(strVal(lfirst(lc)));
+    return paths;
+}
+
+/*
+ * Samples the rows of row groups picked at random across the files. Row
+ * groups are picked until they hold PIXELS_FDW_ANALYZE_OVERSAMPLE times
+ * the target rows; only those are decoded, and the sample is drawn from
+ * their rows with the reservoir method of acquire_sample_rows(). The total
+ * row count is exact, it comes from the footers.
+ */
+static int
+pixels_acquire_sample_rows(Relation relation,
+                           int elevel,
+                           HeapTuple *rows,
+                           int targrows,
+                           double *totalrows,
+                           double *totaldeadrows)
+{
+    TupleDesc   tupdesc = RelationGetDescr(relation);
+    List       *filenames = NIL;
+    std::vector<std::string> paths = pixels_file_paths(RelationGetRelid(relation), &filenames);
+    auto        file_stats = PixelsLoadFileStats(paths);
+    std::vector<std::pair<size_t, int>> row_groups;
+    std::unordered_map<std::string, std::vector<bool>> picked;
+    double      picked_rows = 0;
+    int         picked_num = 0;
+    std::set<int> attrs_used;
+    PixelsFdwExecutionState *festate;
+    TupleTableSlot *slot;
+    ReservoirStateData rstate;
+    double      rowstoskip = -1;
+    double      rowsseen = 0;
+    int         numrows = 0;
+
+    *totalrows = 0;
+    *totaldeadrows = 0;
+    for (size_t i = 0; i < file_stats.size(); i++)
+    {
+        for (int rg_id = 0; rg_id < file_stats[i]->footer.rowgroupinfos_size(); rg_id++)
+            row_groups.emplace_back(i, rg_id);
+        *totalrows += file_stats[i]->row_count;
+    }
+
+    /* partial Fisher-Yates shuffle, stopped once enough rows are picked */
+    for (size_t i = 0;
+         i < row_groups.size() && picked_rows < (double) targrows * PIXELS_FDW_ANALYZE_OVERSAMPLE;
+         i++)
+    {
+        size_t      j = i + pg_prng_uint64_range(&pg_global_prng_state, 0, row_groups.size() - i - 1);
+        const PixelsFileStats &stats = *file_stats[row_groups[j].first];
+        int         rg_id = row_groups[j].second;
+
+        std::swap(row_groups[i], row_groups[j]);
+        std::vector<bool> &file_picked = picked[stats.path];
+        file_picked.resize(stats.footer.rowgroupinfos_size(), false);
+        file_picked[rg_id] = true;
+        picked_rows += stats.footer.rowgroupinfos(rg_id).numberofrows();
+        picked_num++;
+    }
+    if (picked_num == 0)
+        return 0;
+
+    for (int i = 0; i < tupdesc->natts; i++)
+    {
+        if (!TupleDescAttr(tupdesc, i)->attisdropped)
+            attrs_used.insert(i + 1 - FirstLowInvalidHeapAttributeNumber);
+    }
+    festate = createPixelsFdwExecutionState(filenames, NIL, attrs_used, tupdesc);
+    festate->RestrictRowGroups(std::move(picked));
+    slot = MakeSingleTupleTableSlot(tupdesc, &TTSOpsVirtual);
+
+    reservoir_init_selection_state(&rstate, targrows);
+    for (;;)
+    {
+        vacuum_delay_point();
+
+        ExecClearTuple(slot);
+        if (!festate->next(slot))
+            break;
+
+        if (numrows < targrows)
+            rows[numrows++] = heap_form_tuple(tupdesc, slot->tts_values, slot->tts_isnull);
+        else
+        {
+            /* same as acquire_sample_rows(): replace a random row, now and then */
+            if (rowstoskip < 0)
+                rowstoskip = reservoir_get_next_S(&rstate, rowsseen, targrows);
+            if (rowstoskip <= 0)
+            {
+                int         k = (int) (targrows * sampler_random_fract(&rstate.randstate));
+
+                Assert(k >= 0 && k < targrows);
+                heap_freetuple(rows[k]);
+                rows[k] = heap_form_tuple(tupdesc, slot->tts_values, slot->tts_isnull);
+            }
+            rowstoskip -= 1;
+        }
+        rowsseen += 1;
+    }
+    ExecDropSingleTupleTableSlot(slot);
+    delete festate;
+
+    ereport(elevel,
+            (errmsg("\"%s\": scanned %d of %zu row groups, containing %.0f rows; "
+                    "%d rows in sample, %.0f total rows",
+                    RelationGetRelationName(relation),
+                    picked_num, row_groups.size(), rowsseen,
+                    numrows, *totalrows)));
+    return numrows;
+}
+
 extern "C" bool
 pixelsAnalyzeForeignTable(Relation relation,
 						  AcquireSampleRowsFunc *func,
 						  BlockNumber *totalpages) {
-	return false;
+    List       *filenames = NIL;
+    uint64_t    data_bytes = 0;
+
+    for (auto &stats : PixelsLoadFileStats(pixels_file_paths(RelationGetRelid(relation), &filenames)))
+        data_bytes += stats->data_bytes;
+    *func = pixels_acquire_sample_rows;
+    *totalpages = (BlockNumber) std::max<double>(1, ceil((double) data_bytes / BLCKSZ));
+	return true;
+}
+
+static get_relation_stats_hook_type prev_get_relation_stats_hook = NULL;
+
+static get_attavgwidth_hook_type prev_get_attavgwidth_hook = NULL;
+
+/*
+ * Statistics of one column merged from the row group statistics of all
+ * files. The bounds are the histogram bounds picked out of the minimum and
+ * maximum of every row group, with dates and timestamps in days and
+ * microseconds since the Unix epoch, as the files keep them. The width is
+ * that of a string column, taken from its bounds, 0 for other columns.
+ */
+struct PixelsColumnSummary {
+    double      rows = 0;
+    double      nulls = 0;
+    std::vector<int64_t> int_bounds;
+    std::vector<std::string> string_bounds;
+    int32       width = 0;
+};
+
+/*
+ * Summary of a column kept for the backend, with the footers it was made
+ * from, until the relation is invalidated; also kept for foreign tables of
+ * other wrappers, which have none.
+ */
+struct PixelsCachedSummary {
+    bool        is_pixels = false;
+    bool        computed = false;
+    bool        valid = false;
+    std::vector<uint64_t> footers;
+    PixelsColumnSummary summary;
+};
+
+/* summaries by relation and column, see pixels_summary_key() */
+static std::unordered_map<uint64_t, PixelsCachedSummary> pixels_summary_cache;
+
+/*
+ * Picks up to PIXELS_FDW_HISTOGRAM_BOUNDS evenly spaced values out of the
+ * sorted distinct `values`, always keeping the first and the last.
+ */
+template <class T>
+static std::vector<T>
+pixels_histogram_bounds(std::vector<T> values)
+{
+    std::vector<T> bounds;
+
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    if (values.size() <= PIXELS_FDW_HISTOGRAM_BOUNDS)
+        return values;
+    for (int i = 0; i < PIXELS_FDW_HISTOGRAM_BOUNDS; i++)
+        bounds.emplace_back(values[(size_t) ((double) i * (values.size() - 1) /
+                                             (PIXELS_FDW_HISTOGRAM_BOUNDS - 1))]);
+    return bounds;
+}
+
+static bool
+pixels_summarize_column(const std::vector<std::shared_ptr<const PixelsFileStats>> &file_stats,
+                        const char *attname,
+                        Oid atttype,
+                        PixelsColumnSummary &summary)
+{
+    for (auto &stats : file_stats)
+    {
+        const auto &field_names = stats->schema->getFieldNames();
+        const auto &footer = stats->footer;
+        int         column = -1;
+
+        for (int i = 0; i < field_names.size(); i++)
+        {
+            if (strcasecmp(field_names.at(i).c_str(), attname) == 0)
+            {
+                column = i;
+                break;
+            }
+        }
+        if (column < 0)
+            return false;
+
+        for (int rg_id = 0; rg_id < footer.rowgroupinfos_size(); rg_id++)
+        {
+            uint64_t    rg_rows = footer.rowgroupinfos(rg_id).numberofrows();
+
+            if (rg_id >= footer.rowgroupstats_size() ||
+                column >= footer.rowgroupstats(rg_id).columnchunkstats_size())
+                return false;
+            const auto &chunk = footer.rowgroupstats(rg_id).columnchunkstats(column);
+            if (!chunk.has_numberofvalues())
+                return false;
+            summary.rows += rg_rows;
+            summary.nulls += rg_rows - std::min<uint64_t>(rg_rows, chunk.numberofvalues());
+            if (chunk.numberofvalues() == 0)
+                continue;
+
+            switch (atttype)
+            {
+                case INT2OID:
+                case INT4OID:
+                case INT8OID:
+                    if (!chunk.has_intstatistics())
+                        return false;
+                    summary.int_bounds.emplace_back(chunk.intstatistics().minimum());
+                    summary.int_bounds.emplace_back(chunk.intstatistics().maximum());
+                    break;
+                case DATEOID:
+                    if (!chunk.has_datestatistics())
+                        return false;
+                    summary.int_bounds.emplace_back(chunk.datestatistics().minimum());
+                    summary.int_bounds.emplace_back(chunk.datestatistics().maximum());
+                    break;
+                case TIMESTAMPOID:
+                case TIMESTAMPTZOID:
+                    if (!chunk.has_timestampstatistics())
+                        return false;
+                    summary.int_bounds.emplace_back(chunk.timestampstatistics().minimum());
+                    summary.int_bounds.emplace_back(chunk.timestampstatistics().maximum());
+                    break;
+                case TEXTOID:
+                case VARCHAROID:
+                    if (!chunk.has_stringstatistics())
+                        return false;
+                    summary.string_bounds.emplace_back(chunk.stringstatistics().minimum());
+                    summary.string_bounds.emplace_back(chunk.stringstatistics().maximum());
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    if (summary.rows <= 0)
+        return false;
+
+    summary.int_bounds = pixels_histogram_bounds(std::move(summary.int_bounds));
+    summary.string_bounds = pixels_histogram_bounds(std::move(summary.string_bounds));
+    if (!summary.string_bounds.empty())
+    {
+        double      length = 0;
+
+        for (auto &value : summary.string_bounds)
+            length += value.size();
+        summary.width = (int32) (length / summary.string_bounds.size()) + VARHDRSZ;
+    }
+    return true;
+}
+
+/*
+ * Builds a pg_statistic tuple for the column out of the summary: the null
+ * fraction, a histogram made of the row group bounds, and for integers and
+ * dates the number of distinct values when the value range bounds it.
+ * Strings get a histogram only under the C collation, as the bounds are in
+ * byte order.
+ */
+static HeapTuple
+pixels_form_statistic(Oid relid,
+                      AttrNumber attnum,
+                      bool inh,
+                      Oid atttype,
+                      Oid attcollation,
+                      const PixelsColumnSummary &summary)
+{
+    Datum       values[Natts_pg_statistic];
+    bool        nulls[Natts_pg_statistic];
+    std::vector<Datum> bounds;
+    double      distinct = 0;
+    int32       width = get_typlen(atttype);
+    Relation    statrel;
+    HeapTuple   tuple;
+    int16       typlen;
+    bool        typbyval;
+    char        typalign;
+
+    if (!summary.int_bounds.empty())
+    {
+        const std::vector<int64_t> &int_bounds = summary.int_bounds;
+        double      range = (double) int_bounds.back() - (double) int_bounds.front() + 1;
+
+        for (auto value : int_bounds)
+            bounds.emplace_back(pixels_statistic_datum(atttype, value));
+        if (atttype != TIMESTAMPOID && atttype != TIMESTAMPTZOID &&
+            range <= summary.rows - summary.nulls)
+            distinct = range;
+    }
+    else if (!summary.string_bounds.empty())
+    {
+        const std::vector<std::string> &string_bounds = summary.string_bounds;
+
+        width = summary.width;
+        if (lc_collate_is_c(attcollation) || string_bounds.size() == 1)
+        {
+            for (auto &value : string_bounds)
+                bounds.emplace_back(PointerGetDatum(cstring_to_text_with_len(value.data(), value.size())));
+        }
+    }
+    if (bounds.size() == 1)
+        distinct = 1;
+
+    memset(nulls, false, sizeof(nulls));
+    values[Anum_pg_statistic_starelid - 1] = ObjectIdGetDatum(relid);
+    values[Anum_pg_statistic_staattnum - 1] = Int16GetDatum(attnum);
+    values[Anum_pg_statistic_stainherit - 1] = BoolGetDatum(inh);
+    values[Anum_pg_statistic_stanullfrac - 1] = Float4GetDatum(summary.nulls / summary.rows);
+    values[Anum_pg_statistic_stawidth - 1] = Int32GetDatum(std::max(width, 0));
+    values[Anum_pg_statistic_stadistinct - 1] = Float4GetDatum(distinct);
+    for (int k = 0; k < STATISTIC_NUM_SLOTS; k++)
+    {
+        values[Anum_pg_statistic_stakind1 - 1 + k] = Int16GetDatum(0);
+        values[Anum_pg_statistic_staop1 - 1 + k] = ObjectIdGetDatum(InvalidOid);
+        values[Anum_pg_statistic_stacoll1 - 1 + k] = ObjectIdGetDatum(InvalidOid);
+        nulls[Anum_pg_statistic_stanumbers1 - 1 + k] = true;
+        nulls[Anum_pg_statistic_stavalues1 - 1 + k] = true;
+    }
+    if (bounds.size() > 1)
+    {
+        TypeCacheEntry *typentry = lookup_type_cache(atttype, TYPECACHE_LT_OPR);
+
+        if (OidIsValid(typentry->lt_opr))
+        {
+            get_typlenbyvalalign(atttype, &typlen, &typbyval, &typalign);
+            values[Anum_pg_statistic_stakind1 - 1] = Int16GetDatum(STATISTIC_KIND_HISTOGRAM);
+            values[Anum_pg_statistic_staop1 - 1] = ObjectIdGetDatum(typentry->lt_opr);
+            values[Anum_pg_statistic_stacoll1 - 1] = ObjectIdGetDatum(attcollation);
+            values[Anum_pg_statistic_stavalues1 - 1] =
+                PointerGetDatum(construct_array(bounds.data(), bounds.size(),
+                                                atttype, typlen, typbyval, typalign));
+            nulls[Anum_pg_statistic_stavalues1 - 1] = false;
+        }
+    }
+
+    statrel = table_open(StatisticRelationId, AccessShareLock);
+    tuple = heap_form_tuple(RelationGetDescr(statrel), values, nulls);
+    table_close(statrel, AccessShareLock);
+    return tuple;
+}
+
+static uint64_t
+pixels_summary_key(Oid relid, AttrNumber attnum)
+{
+    return ((uint64_t) relid << 16) | (uint16) attnum;
+}
+
+/* relcache callback: the columns or options of the relation may have changed */
+static void
+pixels_summary_invalidate(Datum arg, Oid relid)
+{
+    if (!OidIsValid(relid))
+    {
+        pixels_summary_cache.clear();
+        return;
+    }
+    for (auto it = pixels_summary_cache.begin(); it != pixels_summary_cache.end();)
+    {
+        if ((Oid) (it->first >> 16) == relid)
+            it = pixels_summary_cache.erase(it);
+        else
+            ++it;
+    }
+}
+
+/*
+ * Copies the summary of a column of a pixels table into `summary`, false
+ * if the relation is no pixels table or the footers do not cover the
+ * column. The summary is made again only once a footer of the table was
+ * read again, i.e. a file changed; the planner asks for every column of
+ * every relation many times.
+ */
+static bool
+pixels_column_summary(Oid relid, AttrNumber attnum, PixelsColumnSummary &summary)
+{
+    uint64_t    key = pixels_summary_key(relid, attnum);
+    auto        it = pixels_summary_cache.find(key);
+    List       *filenames = NIL;
+    std::vector<uint64_t> footers;
+
+    if (it == pixels_summary_cache.end())
+    {
+        Relation    rel = table_open(relid, NoLock);
+        PixelsCachedSummary entry;
+
+        entry.is_pixels = GetFdwRoutineForRelation(rel, false)->GetForeignRelSize == pixelsGetForeignRelSize;
+        table_close(rel, NoLock);
+        it = pixels_summary_cache.emplace(key, std::move(entry)).first;
+    }
+    if (!it->second.is_pixels)
+        return false;
+
+    char       *attname = get_attname(relid, attnum, false);
+    Oid         atttype = get_atttype(relid, attnum);
+    auto file_stats = PixelsLoadFileStats(pixels_file_paths(relid, &filenames));
+    for (auto &stats : file_stats)
+        footers.emplace_back(stats->generation);
+    /* the catalog lookups may have invalidated the relation */
+    it = pixels_summary_cache.find(key);
+    if (it == pixels_summary_cache.end())
+        return false;
+    PixelsCachedSummary &entry = it->second;
+    if (!entry.computed || entry.footers != footers)
+    {
+        entry.summary = PixelsColumnSummary();
+        entry.valid = pixels_summarize_column(file_stats, attname, atttype, entry.summary);
+        entry.footers = std::move(footers);
+        entry.computed = true;
+    }
+    if (entry.valid)
+        summary = entry.summary;
+    return entry.valid;
+}
+
+/*
+ * get_relation_stats_hook: columns of pixels tables that ANALYZE has not
+ * seen yet get statistics made up from the footers of their files, so that
+ * freshly created tables are estimated from their actual value ranges.
+ */
+static bool
+pixels_get_relation_stats(PlannerInfo *root,
+                          RangeTblEntry *rte,
+                          AttrNumber attnum,
+                          VariableStatData *vardata)
+{
+    HeapTuple   analyzed;
+    Oid         atttype;
+    int32       atttypmod;
+    Oid         attcollation;
+    PixelsColumnSummary summary;
+    Oid         userid;
+
+    if (prev_get_relation_stats_hook &&
+        prev_get_relation_stats_hook(root, rte, attnum, vardata))
+        return true;
+    if (rte->rtekind != RTE_RELATION || rte->relkind != RELKIND_FOREIGN_TABLE || attnum <= 0)
+        return false;
+
+    /* statistics gathered by ANALYZE win */
+    analyzed = SearchSysCache3(STATRELATTINH,
+                               ObjectIdGetDatum(rte->relid),
+                               Int16GetDatum(attnum),
+                               BoolGetDatum(rte->inh));
+    if (HeapTupleIsValid(analyzed))
+    {
+        ReleaseSysCache(analyzed);
+        return false;
+    }
+
+    if (!pixels_column_summary(rte->relid, attnum, summary))
+        return false;
+    get_atttypetypmodcoll(rte->relid, attnum, &atttype, &atttypmod, &attcollation);
+
+    vardata->statsTuple = pixels_form_statistic(rte->relid, attnum, rte->inh,
+                                                atttype, attcollation, summary);
+    vardata->freefunc = heap_freetuple;
+    /* the same check examine_simple_variable() makes for pg_statistic */
+    userid = OidIsValid(rte->checkAsUser) ? rte->checkAsUser : GetUserId();
+    vardata->acl_ok = rte->securityQuals == NIL &&
+        (pg_class_aclcheck(rte->relid, userid, ACL_SELECT) == ACLCHECK_OK ||
+         pg_attribute_aclcheck(rte->relid, attnum, userid, ACL_SELECT) == ACLCHECK_OK);
+    return true;
+}
+
+/*
+ * get_attavgwidth_hook: the planner takes the width of a column from
+ * there and pg_statistic only, not from the tuples of the hook above, so
+ * string columns of pixels tables that ANALYZE has not seen yet get the
+ * width of their bounds here.
+ */
+static int32
+pixels_get_attavgwidth(Oid relid, AttrNumber attnum)
+{
+    HeapTuple   analyzed;
+    PixelsColumnSummary summary;
+
+    if (prev_get_attavgwidth_hook)
+    {
+        int32       width = prev_get_attavgwidth_hook(relid, attnum);
+
+        if (width > 0)
+            return width;
+    }
+    if (attnum <= 0 || get_rel_relkind(relid) != RELKIND_FOREIGN_TABLE)
+        return 0;
+
+    /* statistics gathered by ANALYZE win */
+    analyzed = SearchSysCache3(STATRELATTINH,
+                               ObjectIdGetDatum(relid),
+                               Int16GetDatum(attnum),
+                               BoolGetDatum(false));
+    if (HeapTupleIsValid(analyzed))
+    {
+        ReleaseSysCache(analyzed);
+        return 0;
+    }
+    if (!pixels_column_summary(relid, attnum, summary))
+        return 0;
+    return summary.width;
+}
+
+extern "C" void
+pixelsInitStatsHook(void)
+{
+    prev_get_relation_stats_hook = get_relation_stats_hook;
+    get_relation_stats_hook = pixels_get_relation_stats;
+    prev_get_attavgwidth_hook = get_attavgwidth_hook;
+    get_attavgwidth_hook = pixels_get_attavgwidth;
+    CacheRegisterRelcacheCallback(pixels_summary_invalidate, (Datum) 0);
 }
 
 extern "C" bool
 pixelsIsForeignScanParallelSafe(PlannerInfo *root, RelOptInfo *rel,
 										  RangeTblEntry *rte) {
-	return false;
+	return true;
+}
+
+extern "C" Size
+pixelsEstimateDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt)
+{
+	PixelsFdwExecutionState *festate = (PixelsFdwExecutionState *) node->fdw_state;
+	return festate->EstimateParallelScan();
+}
+
+extern "C" void
+pixelsInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt,
+							   void *coordinate)
+{
+	PixelsFdwExecutionState *festate = (PixelsFdwExecutionState *) node->fdw_state;
+	festate->InitializeParallelScan(coordinate);
+}
+
+extern "C" void
+pixelsReInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt,
+								 void *coordinate)
+{
+	PixelsFdwExecutionState *festate = (PixelsFdwExecutionState *) node->fdw_state;
+	festate->ReInitializeParallelScan(coordinate);
+}
+
+extern "C" void
+pixelsInitializeWorkerForeignScan(ForeignScanState *node, shm_toc *toc,
+								  void *coordinate)
+{
+	PixelsFdwExecutionState *festate = (PixelsFdwExecutionState *) node->fdw_state;
+	festate->AttachParallelScan(coordinate);
 }
 
 extern "C" Datum 
@@ -872,6 +2165,17 @@ pixels_fdw_validator_impl(PG_FUNCTION_ARGS) {
 				filters_provided = true;
 			}
         }
+        else if (strcmp(def->defname, "sort_key") == 0)
+        {
+            List   *keys;
+
+            if (!parse_sort_key(defGetString(def), keys))
+                ereport(ERROR,
+                        (errcode(ERRCODE_FDW_INVALID_ATTRIBUTE_VALUE),
+                         errmsg("pixels_fdw: invalid sort_key \"%s\"",
+                                defGetString(def)),
+                         errhint("Valid sort_key is a comma-separated list of columns, each followed by an optional ASC or DESC.")));
+        }
         else
         {
             ereport(ERROR,
@@ -0,0 +1,174 @@
+--
+-- Test the pixels_fdw pushdowns: every pushed down query is checked
+-- against the same query over a local copy of the table.
+--
+CREATE EXTENSION pixels_fdw;
+CREATE SERVER pixels_server FOREIGN DATA WRAPPER pixels_fdw;
+\getenv abs_srcdir PG_ABS_SRCDIR
+\set data :abs_srcdir '/test/data/'
+\set one_file '|' :data 'example.pxl|'
+\set all_files '|' :data 'example.pxl| |' :data 'example_0.pxl| |' :data 'example_1.pxl|'
+-- the three files hold the same ten rows
+CREATE FOREIGN TABLE ex (
+    id           int,
+    name         varchar,
+    birthday     date,
+    score        decimal(15, 2)
+) SERVER pixels_server OPTIONS (filename :'all_files');
+CREATE FOREIGN TABLE ex_small (
+    id           int,
+    name         varchar,
+    birthday     date,
+    score        decimal(15, 2)
+) SERVER pixels_server OPTIONS (filename :'one_file');
+CREATE FOREIGN TABLE ex_sorted (
+    id           int,
+    name         varchar,
+    birthday     date,
+    score        decimal(15, 2)
+) SERVER pixels_server OPTIONS (filename :'all_files', sort_key 'id');
+CREATE FOREIGN TABLE ex_sorted_one (
+    id           int,
+    name         varchar,
+    birthday     date,
+    score        decimal(15, 2)
+) SERVER pixels_server OPTIONS (filename :'one_file', sort_key 'id');
+CREATE FOREIGN TABLE ex_bad (
+    id           int
+) SERVER pixels_server OPTIONS (filename :'one_file', sort_key 'id up');
+CREATE TABLE ex_local AS SELECT * FROM ex;
+CREATE TABLE ex_small_local AS SELECT * FROM ex_small;
+SELECT count(*) FROM ex_local;
+SELECT count(*) FROM ex_small_local;
+-- the plan without the file names, which depend on the source directory
+CREATE FUNCTION explain_pixels(query text) RETURNS SETOF text
+LANGUAGE plpgsql AS
+$$
+DECLARE
+    ln text;
+BEGIN
+    FOR ln IN EXECUTE 'EXPLAIN (COSTS OFF) ' || query
+    LOOP
+        CONTINUE WHEN ln ~ 'File Names';
+        RETURN NEXT ln;
+    END LOOP;
+END;
+$$;
+-- whether two queries return the same rows, in any order
+CREATE FUNCTION same_rows(q1 text, q2 text) RETURNS boolean
+LANGUAGE plpgsql AS
+$$
+DECLARE
+    differ bigint;
+BEGIN
+    EXECUTE format('SELECT count(*) FROM (((%s) EXCEPT ALL (%s)) UNION ALL ((%s) EXCEPT ALL (%s))) d',
+                   q1, q2, q2, q1) INTO differ;
+    RETURN differ = 0;
+END;
+$$;
+-- whether two queries return the same rows in the same order
+CREATE FUNCTION same_order(q1 text, q2 text) RETURNS boolean
+LANGUAGE plpgsql AS
+$$
+DECLARE
+    r1 text[];
+    r2 text[];
+BEGIN
+    EXECUTE format('SELECT array_agg(r::text) FROM (%s) r', q1) INTO r1;
+    EXECUTE format('SELECT array_agg(r::text) FROM (%s) r', q2) INTO r2;
+    RETURN r1 IS NOT DISTINCT FROM r2;
+END;
+$$;
+--
+-- Aggregates
+--
+-- answered from the footers
+SELECT explain_pixels('SELECT count(*), count(id), min(id), max(id) FROM ex');
+SELECT same_rows('SELECT count(*), count(id), min(id), max(id) FROM ex',
+                 'SELECT count(*), count(id), min(id), max(id) FROM ex_local');
+-- computed over the column vectors
+SELECT explain_pixels('SELECT count(name), sum(id), avg(id), sum(score), avg(score), min(birthday), max(score) FROM ex');
+SELECT same_rows('SELECT count(name), sum(id), avg(id), sum(score), avg(score), min(birthday), max(score) FROM ex',
+                 'SELECT count(name), sum(id), avg(id), sum(score), avg(score), min(birthday), max(score) FROM ex_local');
+-- sums past 64 bits come back as NUMERIC
+SELECT same_rows('SELECT sum(score * 10000000000000000.00), avg(score * 10000000000000000.00) FROM ex',
+                 'SELECT sum(score * 10000000000000000.00), avg(score * 10000000000000000.00) FROM ex_local');
+-- no row passes the quals: nulls but for the counts
+SELECT explain_pixels('SELECT count(*), count(id), sum(id), min(score), avg(score) FROM ex WHERE id < 0');
+SELECT same_rows('SELECT count(*), count(id), sum(id), min(score), avg(score) FROM ex WHERE id < 0',
+                 'SELECT count(*), count(id), sum(id), min(score), avg(score) FROM ex_local WHERE id < 0');
+SELECT same_rows('SELECT count(*), sum(score), max(birthday) FROM ex WHERE id > 3',
+                 'SELECT count(*), sum(score), max(birthday) FROM ex_local WHERE id > 3');
+-- grouped in a hash table
+SELECT explain_pixels('SELECT name, count(*), sum(score), max(birthday) FROM ex GROUP BY name');
+SELECT same_rows('SELECT name, count(*), sum(score), max(birthday) FROM ex GROUP BY name',
+                 'SELECT name, count(*), sum(score), max(birthday) FROM ex_local GROUP BY name');
+SELECT same_rows('SELECT id, count(name), avg(score) FROM ex WHERE score < 90 GROUP BY id HAVING count(*) > 1',
+                 'SELECT id, count(name), avg(score) FROM ex_local WHERE score < 90 GROUP BY id HAVING count(*) > 1');
+--
+-- LIMIT and OFFSET
+--
+SELECT explain_pixels('SELECT id, name FROM ex LIMIT 5 OFFSET 2');
+SELECT count(*) FROM (SELECT id, name FROM ex LIMIT 5 OFFSET 27) s;
+SELECT count(*) FROM (SELECT id, name FROM ex LIMIT NULL OFFSET 28) s;
+SELECT count(*) FROM (SELECT id, name FROM ex WHERE id > 0 LIMIT 0) s;
+-- the first rows by an ORDER BY are kept in a heap
+SELECT explain_pixels('SELECT id FROM ex ORDER BY id LIMIT 5');
+SELECT same_order('SELECT id FROM ex ORDER BY id LIMIT 5',
+                  'SELECT id FROM ex_local ORDER BY id LIMIT 5');
+SELECT same_order('SELECT id FROM ex ORDER BY id NULLS FIRST LIMIT 5',
+                  'SELECT id FROM ex_local ORDER BY id NULLS FIRST LIMIT 5');
+SELECT same_order('SELECT id FROM ex ORDER BY id DESC LIMIT 4 OFFSET 3',
+                  'SELECT id FROM ex_local ORDER BY id DESC LIMIT 4 OFFSET 3');
+SELECT same_order('SELECT id FROM ex ORDER BY id DESC NULLS LAST LIMIT 7',
+                  'SELECT id FROM ex_local ORDER BY id DESC NULLS LAST LIMIT 7');
+SELECT same_order('SELECT birthday, id FROM ex WHERE score < 90 ORDER BY birthday DESC, id LIMIT 6',
+                  'SELECT birthday, id FROM ex_local WHERE score < 90 ORDER BY birthday DESC, id LIMIT 6');
+-- no bound for the heap, sorted by PostgreSQL
+SELECT explain_pixels('SELECT id FROM ex ORDER BY id LIMIT NULL OFFSET 25');
+SELECT same_order('SELECT id FROM ex ORDER BY id LIMIT NULL OFFSET 25',
+                  'SELECT id FROM ex_local ORDER BY id LIMIT NULL OFFSET 25');
+--
+-- Sorted files
+--
+-- the files overlap, so the scan cannot return them in order
+SELECT explain_pixels('SELECT id FROM ex_sorted ORDER BY id');
+SELECT same_order('SELECT id FROM ex_sorted ORDER BY id',
+                  'SELECT id FROM ex_local ORDER BY id');
+SELECT same_order('SELECT id FROM ex_sorted WHERE id > 2 ORDER BY id DESC',
+                  'SELECT id FROM ex_local WHERE id > 2 ORDER BY id DESC');
+-- a single file is returned in order, with no Sort above the scan
+SELECT explain_pixels('SELECT id, name FROM ex_sorted_one ORDER BY id');
+SELECT same_rows('SELECT id, name FROM ex_sorted_one ORDER BY id',
+                 'SELECT id, name FROM ex_small_local');
+--
+-- Joins
+--
+-- the smaller table is hashed, the remaining clause checked on the joined rows
+SELECT explain_pixels('SELECT a.id, a.name, b.score FROM ex a JOIN ex_small b ON a.id = b.id AND a.name = b.name AND a.score <= b.score WHERE b.id > 2');
+SELECT same_rows('SELECT a.id, a.name, b.score FROM ex a JOIN ex_small b ON a.id = b.id AND a.name = b.name AND a.score <= b.score WHERE b.id > 2',
+                 'SELECT a.id, a.name, b.score FROM ex_local a JOIN ex_small_local b ON a.id = b.id AND a.name = b.name AND a.score <= b.score WHERE b.id > 2');
+SELECT same_rows('SELECT a.name, b.birthday FROM ex a JOIN ex b ON a.id = b.id',
+                 'SELECT a.name, b.birthday FROM ex_local a JOIN ex_local b ON a.id = b.id');
+SELECT same_rows('SELECT a.id, b.id FROM ex a JOIN ex_small b ON a.birthday = b.birthday AND a.id <> b.id',
+                 'SELECT a.id, b.id FROM ex_local a JOIN ex_small_local b ON a.birthday = b.birthday AND a.id <> b.id');
+-- rescans: lookups by the rows of the outer side, and the upper scans again
+SET enable_hashjoin = off;
+SET enable_mergejoin = off;
+SET enable_material = off;
+SELECT explain_pixels('SELECT l.name, e.id, e.score FROM ex_small_local l JOIN ex e ON e.id = l.id');
+SELECT same_rows('SELECT l.name, e.id, e.score FROM ex_small_local l JOIN ex e ON e.id = l.id',
+                 'SELECT l.name, e.id, e.score FROM ex_small_local l JOIN ex_local e ON e.id = l.id');
+SELECT same_rows('SELECT l.id, e.name FROM ex_small_local l JOIN ex e ON e.id = l.id AND e.score > l.score',
+                 'SELECT l.id, e.name FROM ex_small_local l JOIN ex_local e ON e.id = l.id AND e.score > l.score');
+SELECT same_rows('SELECT g, s.* FROM generate_series(1, 3) g, (SELECT count(*), sum(score) FROM ex) s',
+                 'SELECT g, s.* FROM generate_series(1, 3) g, (SELECT count(*), sum(score) FROM ex_local) s');
+SELECT same_rows('SELECT g, j.* FROM generate_series(1, 2) g, (SELECT a.id, b.name FROM ex a JOIN ex_small b ON a.id = b.id) j',
+                 'SELECT g, j.* FROM generate_series(1, 2) g, (SELECT a.id, b.name FROM ex_local a JOIN ex_small_local b ON a.id = b.id) j');
+RESET enable_hashjoin;
+RESET enable_mergejoin;
+RESET enable_material;
+DROP TABLE ex_local, ex_small_local;
+DROP FOREIGN TABLE ex, ex_small, ex_sorted, ex_sorted_one;
+DROP SERVER pixels_server;
+DROP EXTENSION pixels_fdw;